@@ -0,0 +1,816 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BVH_SSE 1
+#include <emmintrin.h>
+#endif
+
+//Half the surface area, the factor of two cancels out of every ratio the heuristic takes
+static float halfArea(const glm::vec3& min, const glm::vec3& max)
+{
+	glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+	return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+static void setSlot(BVHNode4& node, int slot, const glm::vec3& min, const glm::vec3& max)
+{
+	node.minX[slot] = min.x;
+	node.minY[slot] = min.y;
+	node.minZ[slot] = min.z;
+	node.maxX[slot] = max.x;
+	node.maxY[slot] = max.y;
+	node.maxZ[slot] = max.z;
+}
+
+//Bit per slot of the children which are outside the frustum and those wholly inside it
+static void testNodeFrustum(const BVHNode4& node, const Frustum& frustum, int& outsideMask, int& insideMask)
+{
+#if BVH_SSE
+	const __m128 half = _mm_set1_ps(0.5f);
+	__m128 minX = _mm_loadu_ps(node.minX), maxX = _mm_loadu_ps(node.maxX);
+	__m128 minY = _mm_loadu_ps(node.minY), maxY = _mm_loadu_ps(node.maxY);
+	__m128 minZ = _mm_loadu_ps(node.minZ), maxZ = _mm_loadu_ps(node.maxZ);
+	__m128 centreX = _mm_mul_ps(_mm_add_ps(minX, maxX), half), extentX = _mm_mul_ps(_mm_sub_ps(maxX, minX), half);
+	__m128 centreY = _mm_mul_ps(_mm_add_ps(minY, maxY), half), extentY = _mm_mul_ps(_mm_sub_ps(maxY, minY), half);
+	__m128 centreZ = _mm_mul_ps(_mm_add_ps(minZ, maxZ), half), extentZ = _mm_mul_ps(_mm_sub_ps(maxZ, minZ), half);
+
+	const __m128 zero = _mm_setzero_ps();
+	__m128 outside = zero;
+	__m128 crossing = zero;
+	for (const glm::vec4& plane : frustum.planes)
+	{
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(centreX, _mm_set1_ps(plane.x)), _mm_mul_ps(centreY, _mm_set1_ps(plane.y))),
+			_mm_add_ps(_mm_mul_ps(centreZ, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+		__m128 projectedExtent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(extentX, _mm_set1_ps(std::fabs(plane.x))), _mm_mul_ps(extentY, _mm_set1_ps(std::fabs(plane.y)))),
+			_mm_mul_ps(extentZ, _mm_set1_ps(std::fabs(plane.z))));
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, projectedExtent), zero));
+		crossing = _mm_or_ps(crossing, _mm_cmplt_ps(_mm_sub_ps(distance, projectedExtent), zero));
+	}
+	outsideMask = _mm_movemask_ps(outside);
+	insideMask = ~_mm_movemask_ps(crossing) & 0xF;
+#else
+	outsideMask = 0;
+	insideMask = 0;
+	for (int slot = 0; slot < 4; slot++)
+	{
+		glm::vec3 min(node.minX[slot], node.minY[slot], node.minZ[slot]);
+		glm::vec3 max(node.maxX[slot], node.maxY[slot], node.maxZ[slot]);
+		glm::vec3 centre = (min + max) * 0.5f;
+		glm::vec3 extent = (max - min) * 0.5f;
+		bool outside = false;
+		bool crossing = false;
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			float distance = glm::dot(glm::vec3(plane), centre) + plane.w;
+			float projectedExtent = glm::dot(glm::abs(glm::vec3(plane)), extent);
+			outside = outside || distance + projectedExtent < 0.0f;
+			crossing = crossing || distance - projectedExtent < 0.0f;
+		}
+		outsideMask |= outside ? 1 << slot : 0;
+		insideMask |= crossing ? 0 : 1 << slot;
+	}
+#endif
+}
+
+//Slab test of the ray against all four children, writing the entry distance of each hit
+static int testNodeRay(const BVHNode4& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float* pEntry)
+{
+#if BVH_SSE
+	__m128 originX = _mm_set1_ps(origin.x), inverseX = _mm_set1_ps(inverseDirection.x);
+	__m128 originY = _mm_set1_ps(origin.y), inverseY = _mm_set1_ps(inverseDirection.y);
+	__m128 originZ = _mm_set1_ps(origin.z), inverseZ = _mm_set1_ps(inverseDirection.z);
+	__m128 t0X = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), originX), inverseX);
+	__m128 t1X = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), originX), inverseX);
+	__m128 t0Y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), originY), inverseY);
+	__m128 t1Y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), originY), inverseY);
+	__m128 t0Z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), originZ), inverseZ);
+	__m128 t1Z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), originZ), inverseZ);
+
+	__m128 entry = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0X, t1X), _mm_min_ps(t0Y, t1Y)), _mm_max_ps(_mm_min_ps(t0Z, t1Z), _mm_setzero_ps()));
+	__m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0X, t1X), _mm_max_ps(t0Y, t1Y)), _mm_min_ps(_mm_max_ps(t0Z, t1Z), _mm_set1_ps(maxDistance)));
+	_mm_storeu_ps(pEntry, entry);
+	return _mm_movemask_ps(_mm_cmple_ps(entry, exit));
+#else
+	int hitMask = 0;
+	for (int slot = 0; slot < 4; slot++)
+	{
+		glm::vec3 t0 = (glm::vec3(node.minX[slot], node.minY[slot], node.minZ[slot]) - origin) * inverseDirection;
+		glm::vec3 t1 = (glm::vec3(node.maxX[slot], node.maxY[slot], node.maxZ[slot]) - origin) * inverseDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+		pEntry[slot] = entry;
+		hitMask |= entry <= exit ? 1 << slot : 0;
+	}
+	return hitMask;
+#endif
+}
+
+static int testNodeSphere(const BVHNode4& node, const glm::vec3& centre, float radius)
+{
+	int hitMask = 0;
+	for (int slot = 0; slot < 4; slot++)
+	{
+		glm::vec3 min(node.minX[slot], node.minY[slot], node.minZ[slot]);
+		glm::vec3 max(node.maxX[slot], node.maxY[slot], node.maxZ[slot]);
+		glm::vec3 offset = glm::max(min - centre, glm::vec3(0.0f)) + glm::max(centre - max, glm::vec3(0.0f));
+		hitMask |= glm::dot(offset, offset) <= radius * radius ? 1 << slot : 0;
+	}
+	return hitMask;
+}
+
+static bool rayHitsBox(const glm::vec3& min, const glm::vec3& max, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& entry)
+{
+	glm::vec3 t0 = (min - origin) * inverseDirection;
+	glm::vec3 t1 = (max - origin) * inverseDirection;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+	entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+	return entry <= exit;
+}
+
+static bool boxesOverlap(const glm::vec3& minA, const glm::vec3& maxA, const glm::vec3& minB, const glm::vec3& maxB)
+{
+	return minA.x <= maxB.x && minB.x <= maxA.x && minA.y <= maxB.y && minB.y <= maxA.y && minA.z <= maxB.z && minB.z <= maxA.z;
+}
+
+BVH::BVH()
+{
+	m_AbandonedNodes = 0;
+	m_SubtreeRebuilds = 0;
+}
+
+void BVH::clear()
+{
+	m_Nodes.clear();
+	m_NodeFirst.clear();
+	m_NodeCount.clear();
+	m_NodeBuildArea.clear();
+	m_PrimitiveIndices.clear();
+	m_LeafMin.clear();
+	m_LeafMax.clear();
+	m_AbandonedNodes = 0;
+}
+
+int32_t BVH::allocateNode(uint32_t first, uint32_t count)
+{
+	BVHNode4 node = {};
+	for (int slot = 0; slot < 4; slot++)
+	{
+		node.child[slot] = -1;
+	}
+	m_Nodes.push_back(node);
+	m_NodeFirst.push_back(first);
+	m_NodeCount.push_back(count);
+	m_NodeBuildArea.push_back(0.0f);
+	return (int32_t)(m_Nodes.size() - 1);
+}
+
+void BVH::build(const glm::vec3* pMin, const glm::vec3* pMax, size_t count)
+{
+	clear();
+	if (count == 0)
+	{
+		return;
+	}
+
+	m_PrimitiveIndices.resize(count);
+	std::iota(m_PrimitiveIndices.begin(), m_PrimitiveIndices.end(), 0u);
+	m_LeafMin.resize(count);
+	m_LeafMax.resize(count);
+	m_Nodes.reserve(count / 2 + 1);
+
+	buildSubtree(pMin, pMax, 0, (uint32_t)count, allocateNode(0, (uint32_t)count));
+}
+
+void BVH::buildSubtree(const glm::vec3* pMin, const glm::vec3* pMax, uint32_t first, uint32_t count, int32_t nodeIndex)
+{
+	//The build partitions the leaf boxes alongside the indices, so it reads memory in order rather than
+	//gathering from the caller's arrays
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		m_LeafMin[i] = pMin[m_PrimitiveIndices[i]];
+		m_LeafMax[i] = pMax[m_PrimitiveIndices[i]];
+	}
+
+	std::vector<BuildNode> buildNodes;
+	buildNodes.reserve(count * 2);
+	int root = buildBinary(buildNodes, first, count);
+	collapse(buildNodes, root, nodeIndex);
+}
+
+int BVH::buildBinary(std::vector<BuildNode>& buildNodes, uint32_t first, uint32_t count)
+{
+	BuildNode node;
+	node.min = glm::vec3(FLT_MAX);
+	node.max = glm::vec3(-FLT_MAX);
+	node.left = -1;
+	node.right = -1;
+	node.first = first;
+	node.count = count;
+
+	glm::vec3 centroidMin(FLT_MAX);
+	glm::vec3 centroidMax(-FLT_MAX);
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		node.min = glm::min(node.min, m_LeafMin[i]);
+		node.max = glm::max(node.max, m_LeafMax[i]);
+		glm::vec3 centroid = (m_LeafMin[i] + m_LeafMax[i]) * 0.5f;
+		centroidMin = glm::min(centroidMin, centroid);
+		centroidMax = glm::max(centroidMax, centroid);
+	}
+
+	int index = (int)buildNodes.size();
+	buildNodes.push_back(node);
+	if (count <= 1)
+	{
+		return index;
+	}
+
+	//Cost of a traversal step is taken as 1, the same as testing one primitive
+	float nodeArea = halfArea(node.min, node.max);
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	int bestBin = 0;
+	//All three axes are binned in one pass over the primitives
+	uint32_t binCounts[3][SAH_BINS] = {};
+	glm::vec3 binMin[3][SAH_BINS];
+	glm::vec3 binMax[3][SAH_BINS];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		std::fill(binMin[axis], binMin[axis] + SAH_BINS, glm::vec3(FLT_MAX));
+		std::fill(binMax[axis], binMax[axis] + SAH_BINS, glm::vec3(-FLT_MAX));
+	}
+	glm::vec3 centroidExtent = centroidMax - centroidMin;
+	glm::vec3 scale(0.0f);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		scale[axis] = centroidExtent[axis] > 0.0f ? (float)SAH_BINS / centroidExtent[axis] : 0.0f;
+	}
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		glm::vec3 centroid = (m_LeafMin[i] + m_LeafMax[i]) * 0.5f;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			int bin = std::min(SAH_BINS - 1, (int)((centroid[axis] - centroidMin[axis]) * scale[axis]));
+			binCounts[axis][bin]++;
+			binMin[axis][bin] = glm::min(binMin[axis][bin], m_LeafMin[i]);
+			binMax[axis][bin] = glm::max(binMax[axis][bin], m_LeafMax[i]);
+		}
+	}
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (centroidExtent[axis] <= 0.0f)
+		{
+			continue;
+		}
+
+		//Sweep from the right to get the cost of everything after each split, then from the left
+		float rightArea[SAH_BINS];
+		uint32_t rightCount[SAH_BINS];
+		glm::vec3 sweepMin(FLT_MAX);
+		glm::vec3 sweepMax(-FLT_MAX);
+		uint32_t sweepCount = 0;
+		for (int bin = SAH_BINS - 1; bin > 0; bin--)
+		{
+			sweepMin = glm::min(sweepMin, binMin[axis][bin]);
+			sweepMax = glm::max(sweepMax, binMax[axis][bin]);
+			sweepCount += binCounts[axis][bin];
+			rightArea[bin] = halfArea(sweepMin, sweepMax);
+			rightCount[bin] = sweepCount;
+		}
+		sweepMin = glm::vec3(FLT_MAX);
+		sweepMax = glm::vec3(-FLT_MAX);
+		sweepCount = 0;
+		for (int bin = 0; bin < SAH_BINS - 1; bin++)
+		{
+			sweepMin = glm::min(sweepMin, binMin[axis][bin]);
+			sweepMax = glm::max(sweepMax, binMax[axis][bin]);
+			sweepCount += binCounts[axis][bin];
+			if (sweepCount == 0 || rightCount[bin + 1] == 0)
+			{
+				continue;
+			}
+			float cost = 1.0f + (halfArea(sweepMin, sweepMax) * sweepCount + rightArea[bin + 1] * rightCount[bin + 1]) / nodeArea;
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = bin;
+			}
+		}
+	}
+
+	//Small enough and not worth splitting, or nothing to split on
+	if (count <= MAX_LEAF_SIZE && (bestAxis < 0 || bestCost >= (float)count))
+	{
+		return index;
+	}
+
+	uint32_t leftCount;
+	if (bestAxis >= 0)
+	{
+		//Must bin exactly as above so the split matches the counts it was chosen from
+		uint32_t left = first;
+		uint32_t right = first + count;
+		while (left < right)
+		{
+			float centroid = (m_LeafMin[left][bestAxis] + m_LeafMax[left][bestAxis]) * 0.5f;
+			if (std::min(SAH_BINS - 1, (int)((centroid - centroidMin[bestAxis]) * scale[bestAxis])) <= bestBin)
+			{
+				left++;
+			}
+			else
+			{
+				right--;
+				std::swap(m_PrimitiveIndices[left], m_PrimitiveIndices[right]);
+				std::swap(m_LeafMin[left], m_LeafMin[right]);
+				std::swap(m_LeafMax[left], m_LeafMax[right]);
+			}
+		}
+		leftCount = left - first;
+	}
+	else
+	{
+		//Every centroid is the same point, any split is as good as another
+		leftCount = count / 2;
+	}
+
+	int left = buildBinary(buildNodes, first, leftCount);
+	int right = buildBinary(buildNodes, first + leftCount, count - leftCount);
+	buildNodes[index].left = left;
+	buildNodes[index].right = right;
+	return index;
+}
+
+void BVH::collapse(const std::vector<BuildNode>& buildNodes, int buildIndex, int32_t nodeIndex)
+{
+	//Open the largest internal child until there are four, larger boxes are the ones most worth splitting
+	int candidates[4];
+	int candidateCount = 0;
+	const BuildNode& root = buildNodes[buildIndex];
+	if (root.left < 0)
+	{
+		candidates[candidateCount++] = buildIndex;
+	}
+	else
+	{
+		candidates[candidateCount++] = root.left;
+		candidates[candidateCount++] = root.right;
+	}
+	while (candidateCount < 4)
+	{
+		int largest = -1;
+		float largestArea = -1.0f;
+		for (int i = 0; i < candidateCount; i++)
+		{
+			const BuildNode& candidate = buildNodes[candidates[i]];
+			float area = halfArea(candidate.min, candidate.max);
+			if (candidate.left >= 0 && area > largestArea)
+			{
+				largest = i;
+				largestArea = area;
+			}
+		}
+		if (largest < 0)
+		{
+			break;
+		}
+		const BuildNode& opened = buildNodes[candidates[largest]];
+		candidates[largest] = opened.left;
+		candidates[candidateCount++] = opened.right;
+	}
+
+	//Built locally, recursing adds nodes and may move the array
+	BVHNode4 node = m_Nodes[nodeIndex];
+	for (int slot = 0; slot < candidateCount; slot++)
+	{
+		const BuildNode& candidate = buildNodes[candidates[slot]];
+		setSlot(node, slot, candidate.min, candidate.max);
+		if (candidate.left < 0)
+		{
+			node.child[slot] = (int32_t)candidate.first;
+			node.primitiveCount[slot] = candidate.count;
+		}
+		else
+		{
+			node.child[slot] = allocateNode(candidate.first, candidate.count);
+			node.primitiveCount[slot] = 0;
+			collapse(buildNodes, candidates[slot], node.child[slot]);
+		}
+	}
+	for (int slot = candidateCount; slot < 4; slot++)
+	{
+		node.child[slot] = -1;
+		node.primitiveCount[slot] = 0;
+	}
+	m_Nodes[nodeIndex] = node;
+	m_NodeFirst[nodeIndex] = root.first;
+	m_NodeCount[nodeIndex] = root.count;
+	m_NodeBuildArea[nodeIndex] = halfArea(root.min, root.max);
+}
+
+void BVH::refit(const glm::vec3* pMin, const glm::vec3* pMax)
+{
+	for (size_t i = 0; i < m_PrimitiveIndices.size(); i++)
+	{
+		m_LeafMin[i] = pMin[m_PrimitiveIndices[i]];
+		m_LeafMax[i] = pMax[m_PrimitiveIndices[i]];
+	}
+	if (!m_Nodes.empty())
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+		refitNode(0, min, max);
+	}
+}
+
+void BVH::refitNode(int32_t nodeIndex, glm::vec3& min, glm::vec3& max)
+{
+	min = glm::vec3(FLT_MAX);
+	max = glm::vec3(-FLT_MAX);
+	for (int slot = 0; slot < 4; slot++)
+	{
+		int32_t child = m_Nodes[nodeIndex].child[slot];
+		if (child < 0)
+		{
+			continue;
+		}
+
+		glm::vec3 childMin(FLT_MAX);
+		glm::vec3 childMax(-FLT_MAX);
+		uint32_t primitiveCount = m_Nodes[nodeIndex].primitiveCount[slot];
+		if (primitiveCount > 0)
+		{
+			for (uint32_t i = (uint32_t)child; i < (uint32_t)child + primitiveCount; i++)
+			{
+				childMin = glm::min(childMin, m_LeafMin[i]);
+				childMax = glm::max(childMax, m_LeafMax[i]);
+			}
+		}
+		else
+		{
+			refitNode(child, childMin, childMax);
+		}
+		setSlot(m_Nodes[nodeIndex], slot, childMin, childMax);
+		min = glm::min(min, childMin);
+		max = glm::max(max, childMax);
+	}
+}
+
+float BVH::getNodeArea(int32_t nodeIndex) const
+{
+	const BVHNode4& node = m_Nodes[nodeIndex];
+	glm::vec3 min(FLT_MAX);
+	glm::vec3 max(-FLT_MAX);
+	for (int slot = 0; slot < 4; slot++)
+	{
+		if (node.child[slot] >= 0)
+		{
+			min = glm::min(min, glm::vec3(node.minX[slot], node.minY[slot], node.minZ[slot]));
+			max = glm::max(max, glm::vec3(node.maxX[slot], node.maxY[slot], node.maxZ[slot]));
+		}
+	}
+	return halfArea(min, max);
+}
+
+size_t BVH::countSubtreeNodes(int32_t nodeIndex) const
+{
+	size_t count = 1;
+	const BVHNode4& node = m_Nodes[nodeIndex];
+	for (int slot = 0; slot < 4; slot++)
+	{
+		if (node.child[slot] >= 0 && node.primitiveCount[slot] == 0)
+		{
+			count += countSubtreeNodes(node.child[slot]);
+		}
+	}
+	return count;
+}
+
+void BVH::update(const glm::vec3* pMin, const glm::vec3* pMax, float threshold)
+{
+	refit(pMin, pMax);
+	if (m_Nodes.empty())
+	{
+		return;
+	}
+
+	if (getNodeArea(0) > m_NodeBuildArea[0] * threshold)
+	{
+		build(pMin, pMax, m_PrimitiveIndices.size());
+		return;
+	}
+	updateNode(pMin, pMax, 0, threshold);
+
+	//Rebuilt subtrees are appended, the nodes they replaced are only reclaimed by building from scratch
+	if (m_AbandonedNodes * 2 > m_Nodes.size())
+	{
+		build(pMin, pMax, m_PrimitiveIndices.size());
+	}
+}
+
+void BVH::updateNode(const glm::vec3* pMin, const glm::vec3* pMax, int32_t nodeIndex, float threshold)
+{
+	for (int slot = 0; slot < 4; slot++)
+	{
+		//Not a reference, rebuilding may move the node array
+		int32_t child = m_Nodes[nodeIndex].child[slot];
+		if (child < 0 || m_Nodes[nodeIndex].primitiveCount[slot] > 0)
+		{
+			continue;
+		}
+
+		//The slot's box is the child's bounds, already refit
+		const BVHNode4& node = m_Nodes[nodeIndex];
+		float area = halfArea(glm::vec3(node.minX[slot], node.minY[slot], node.minZ[slot]), glm::vec3(node.maxX[slot], node.maxY[slot], node.maxZ[slot]));
+		if (area > m_NodeBuildArea[child] * threshold)
+		{
+			//The subtree's root is rebuilt in place so the box in this node is still right, its primitives
+			//are the same ones
+			m_AbandonedNodes += countSubtreeNodes(child) - 1;
+			buildSubtree(pMin, pMax, m_NodeFirst[child], m_NodeCount[child], child);
+			m_SubtreeRebuilds++;
+		}
+		else
+		{
+			updateNode(pMin, pMax, child, threshold);
+		}
+	}
+}
+
+float BVH::getCost() const
+{
+	if (m_Nodes.empty())
+	{
+		return 0.0f;
+	}
+
+	float cost = 0.0f;
+	std::vector<int32_t> stack(1, 0);
+	while (!stack.empty())
+	{
+		int32_t nodeIndex = stack.back();
+		stack.pop_back();
+		const BVHNode4& node = m_Nodes[nodeIndex];
+		for (int slot = 0; slot < 4; slot++)
+		{
+			if (node.child[slot] < 0)
+			{
+				continue;
+			}
+			float area = halfArea(glm::vec3(node.minX[slot], node.minY[slot], node.minZ[slot]), glm::vec3(node.maxX[slot], node.maxY[slot], node.maxZ[slot]));
+			if (node.primitiveCount[slot] > 0)
+			{
+				cost += area * node.primitiveCount[slot];
+			}
+			else
+			{
+				cost += area;
+				stack.push_back(node.child[slot]);
+			}
+		}
+	}
+	float rootArea = getNodeArea(0);
+	return rootArea > 0.0f ? 1.0f + cost / rootArea : 0.0f;
+}
+
+void BVH::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& results) const
+{
+	if (m_Nodes.empty())
+	{
+		return;
+	}
+
+	std::vector<int32_t> stack;
+	stack.reserve(64);
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const BVHNode4& node = m_Nodes[stack.back()];
+		stack.pop_back();
+
+		int outsideMask;
+		int insideMask;
+		testNodeFrustum(node, frustum, outsideMask, insideMask);
+		for (int slot = 0; slot < 4; slot++)
+		{
+			int32_t child = node.child[slot];
+			if (child < 0 || (outsideMask & (1 << slot)))
+			{
+				continue;
+			}
+
+			uint32_t primitiveCount = node.primitiveCount[slot];
+			if (insideMask & (1 << slot))
+			{
+				//Wholly inside, everything below is visible without testing
+				uint32_t first = primitiveCount > 0 ? (uint32_t)child : m_NodeFirst[child];
+				uint32_t count = primitiveCount > 0 ? primitiveCount : m_NodeCount[child];
+				results.insert(results.end(), m_PrimitiveIndices.begin() + first, m_PrimitiveIndices.begin() + first + count);
+			}
+			else if (primitiveCount > 0)
+			{
+				for (uint32_t i = (uint32_t)child; i < (uint32_t)child + primitiveCount; i++)
+				{
+					glm::vec3 centre = (m_LeafMin[i] + m_LeafMax[i]) * 0.5f;
+					glm::vec3 extent = (m_LeafMax[i] - m_LeafMin[i]) * 0.5f;
+					//Same test as cullFrustum, box or enclosing sphere behind any plane
+					float radius = glm::length(extent);
+					bool outside = false;
+					for (const glm::vec4& plane : frustum.planes)
+					{
+						float distance = glm::dot(glm::vec3(plane), centre) + plane.w;
+						if (distance + std::min(radius, glm::dot(glm::abs(glm::vec3(plane)), extent)) < 0.0f)
+						{
+							outside = true;
+							break;
+						}
+					}
+					if (!outside)
+					{
+						results.push_back(m_PrimitiveIndices[i]);
+					}
+				}
+			}
+			else
+			{
+				stack.push_back(child);
+			}
+		}
+	}
+}
+
+void BVH::queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<uint32_t>& results) const
+{
+	if (m_Nodes.empty())
+	{
+		return;
+	}
+
+	glm::vec3 inverseDirection = 1.0f / direction;
+	std::vector<int32_t> stack;
+	stack.reserve(64);
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const BVHNode4& node = m_Nodes[stack.back()];
+		stack.pop_back();
+
+		float entry[4];
+		int hitMask = testNodeRay(node, origin, inverseDirection, maxDistance, entry);
+		for (int slot = 0; slot < 4; slot++)
+		{
+			int32_t child = node.child[slot];
+			if (child < 0 || !(hitMask & (1 << slot)))
+			{
+				continue;
+			}
+
+			uint32_t primitiveCount = node.primitiveCount[slot];
+			if (primitiveCount > 0)
+			{
+				for (uint32_t i = (uint32_t)child; i < (uint32_t)child + primitiveCount; i++)
+				{
+					float primitiveEntry;
+					if (rayHitsBox(m_LeafMin[i], m_LeafMax[i], origin, inverseDirection, maxDistance, primitiveEntry))
+					{
+						results.push_back(m_PrimitiveIndices[i]);
+					}
+				}
+			}
+			else
+			{
+				stack.push_back(child);
+			}
+		}
+	}
+}
+
+bool BVH::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, uint32_t& hitIndex, float& hitDistance) const
+{
+	if (m_Nodes.empty())
+	{
+		return false;
+	}
+
+	glm::vec3 inverseDirection = 1.0f / direction;
+	bool hit = false;
+	hitDistance = maxDistance;
+
+	struct StackEntry
+	{
+		int32_t node;
+		float entry;
+	};
+	std::vector<StackEntry> stack;
+	stack.reserve(64);
+	stack.push_back({ 0, 0.0f });
+	while (!stack.empty())
+	{
+		StackEntry current = stack.back();
+		stack.pop_back();
+		//A closer hit was found after this node was pushed
+		if (current.entry > hitDistance)
+		{
+			continue;
+		}
+
+		const BVHNode4& node = m_Nodes[current.node];
+		float entry[4];
+		int hitMask = testNodeRay(node, origin, inverseDirection, hitDistance, entry);
+
+		//Push internal children farthest first so the nearest is popped next
+		StackEntry children[4];
+		int childCount = 0;
+		for (int slot = 0; slot < 4; slot++)
+		{
+			int32_t child = node.child[slot];
+			if (child < 0 || !(hitMask & (1 << slot)))
+			{
+				continue;
+			}
+
+			uint32_t primitiveCount = node.primitiveCount[slot];
+			if (primitiveCount > 0)
+			{
+				for (uint32_t i = (uint32_t)child; i < (uint32_t)child + primitiveCount; i++)
+				{
+					float primitiveEntry;
+					if (rayHitsBox(m_LeafMin[i], m_LeafMax[i], origin, inverseDirection, hitDistance, primitiveEntry) && primitiveEntry <= hitDistance)
+					{
+						hit = true;
+						hitIndex = m_PrimitiveIndices[i];
+						hitDistance = primitiveEntry;
+					}
+				}
+			}
+			else
+			{
+				children[childCount++] = { child, entry[slot] };
+			}
+		}
+		std::sort(children, children + childCount, [](const StackEntry& a, const StackEntry& b) { return a.entry > b.entry; });
+		stack.insert(stack.end(), children, children + childCount);
+	}
+	return hit;
+}
+
+void BVH::querySphere(const glm::vec3& centre, float radius, std::vector<uint32_t>& results) const
+{
+	if (m_Nodes.empty())
+	{
+		return;
+	}
+
+	glm::vec3 sphereMin = centre - glm::vec3(radius);
+	glm::vec3 sphereMax = centre + glm::vec3(radius);
+	std::vector<int32_t> stack;
+	stack.reserve(64);
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const BVHNode4& node = m_Nodes[stack.back()];
+		stack.pop_back();
+
+		int hitMask = testNodeSphere(node, centre, radius);
+		for (int slot = 0; slot < 4; slot++)
+		{
+			int32_t child = node.child[slot];
+			if (child < 0 || !(hitMask & (1 << slot)))
+			{
+				continue;
+			}
+
+			uint32_t primitiveCount = node.primitiveCount[slot];
+			if (primitiveCount > 0)
+			{
+				for (uint32_t i = (uint32_t)child; i < (uint32_t)child + primitiveCount; i++)
+				{
+					//Cheap box rejection before the exact distance
+					if (!boxesOverlap(m_LeafMin[i], m_LeafMax[i], sphereMin, sphereMax))
+					{
+						continue;
+					}
+					glm::vec3 offset = glm::max(m_LeafMin[i] - centre, glm::vec3(0.0f)) + glm::max(centre - m_LeafMax[i], glm::vec3(0.0f));
+					if (glm::dot(offset, offset) <= radius * radius)
+					{
+						results.push_back(m_PrimitiveIndices[i]);
+					}
+				}
+			}
+			else
+			{
+				stack.push_back(child);
+			}
+		}
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "FrustumCulling.h"
+
+//Four children's boxes side by side, so one SSE instruction tests all four against a plane or ray slab.
+//128 bytes, two cache lines per node
+struct BVHNode4
+{
+	float minX[4];
+	float minY[4];
+	float minZ[4];
+	float maxX[4];
+	float maxY[4];
+	float maxZ[4];
+	//Node index for internal children, first entry of the primitive list for leaves, -1 for empty slots
+	int32_t child[4];
+	//Zero for internal children, otherwise the number of primitives in the leaf
+	uint32_t primitiveCount[4];
+};
+
+//Bounding volume hierarchy over the AABBs of scene objects. Built top down with the binned surface area heuristic
+//as a binary tree and then collapsed into 4 wide nodes stored depth first in one array.
+//Objects which move can be refit, which keeps the topology and only grows boxes, and update() rebuilds just the
+//subtrees whose boxes have grown too far since they were built
+class BVH
+{
+public:
+	static const uint32_t MAX_LEAF_SIZE = 4;
+	static const int SAH_BINS = 16;
+
+	BVH();
+
+	//Builds over count boxes, query results are indices into these arrays
+	void build(const glm::vec3* pMin, const glm::vec3* pMax, size_t count);
+	//Same objects with new boxes, the tree shape is kept
+	void refit(const glm::vec3* pMin, const glm::vec3* pMax);
+	//Refits and then rebuilds each subtree whose surface area has grown by more than threshold times since it was
+	//built. Falls back to a full build once abandoned nodes make up half the array
+	void update(const glm::vec3* pMin, const glm::vec3* pMax, float threshold = 2.0f);
+	void clear();
+
+	//Appends every object whose box intersects the frustum
+	void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& results) const;
+	//Appends every object whose box the ray passes through within maxDistance, direction need not be normalised
+	//but maxDistance is measured in multiples of it
+	void queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<uint32_t>& results) const;
+	//Nearest box along the ray, visiting children front to back and skipping those beyond the closest hit so far
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, uint32_t& hitIndex, float& hitDistance) const;
+	//Appends every object whose box overlaps the sphere
+	void querySphere(const glm::vec3& centre, float radius, std::vector<uint32_t>& results) const;
+
+	size_t getNodeCount() const { return m_Nodes.size(); };
+	size_t getObjectCount() const { return m_PrimitiveIndices.size(); };
+	//Nodes left behind by incremental rebuilds
+	size_t getAbandonedNodeCount() const { return m_AbandonedNodes; };
+	unsigned int getSubtreeRebuildCount() const { return m_SubtreeRebuilds; };
+	//Surface area heuristic cost of the whole tree relative to the root, lower traverses faster
+	float getCost() const;
+private:
+	struct BuildNode
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+		int left;
+		int right;
+		uint32_t first;
+		uint32_t count;
+	};
+
+	//Binary SAH build over the leaf entries [first, first + count), reordering that range
+	int buildBinary(std::vector<BuildNode>& buildNodes, uint32_t first, uint32_t count);
+	//Turns the binary tree under buildIndex into 4 wide nodes, writing the root at nodeIndex
+	void collapse(const std::vector<BuildNode>& buildNodes, int buildIndex, int32_t nodeIndex);
+	int32_t allocateNode(uint32_t first, uint32_t count);
+	//Builds the primitives [first, first + count) into a subtree whose root is written at nodeIndex
+	void buildSubtree(const glm::vec3* pMin, const glm::vec3* pMax, uint32_t first, uint32_t count, int32_t nodeIndex);
+
+	void refitNode(int32_t nodeIndex, glm::vec3& min, glm::vec3& max);
+	void updateNode(const glm::vec3* pMin, const glm::vec3* pMax, int32_t nodeIndex, float threshold);
+	size_t countSubtreeNodes(int32_t nodeIndex) const;
+	float getNodeArea(int32_t nodeIndex) const;
+
+	std::vector<BVHNode4> m_Nodes;
+	//Primitives each node covers and its surface area when built, only read by update()
+	std::vector<uint32_t> m_NodeFirst;
+	std::vector<uint32_t> m_NodeCount;
+	std::vector<float> m_NodeBuildArea;
+
+	//Object indices in leaf order, with a copy of their boxes in the same order for leaf tests
+	std::vector<uint32_t> m_PrimitiveIndices;
+	std::vector<glm::vec3> m_LeafMin;
+	std::vector<glm::vec3> m_LeafMax;
+
+	size_t m_AbandonedNodes;
+	unsigned int m_SubtreeRebuilds;
+};
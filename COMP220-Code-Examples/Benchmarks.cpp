@@ -0,0 +1,1157 @@
+#include "Benchmarks.h"
+
+#include <GL\glew.h>
+#include <SDL_opengl.h>
+
+#include <SDL.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "BVH.h"
+#include "FrustumCulling.h"
+#include "GeometryArena.h"
+#include "EntityComponentSystem.h"
+#include "FrameAllocator.h"
+#include "GLStateCache.h"
+#include "JobSystem.h"
+#include "OcclusionCulling.h"
+#include "SceneGraph.h"
+#include "Mesh.h"
+#include "Model.h"
+#include "ProgramBinaryCache.h"
+#include "RenderQueue.h"
+#include "Shader.h"
+#include "ShaderBatch.h"
+#include "ShaderVariants.h"
+#include "StreamingBuffer.h"
+#include "Texture.h"
+
+//Compiles the same set of distinct programs with a growing number of driver compiler threads
+static void benchmarkShaderCompile()
+{
+	const int PROGRAM_COUNT = 64;
+
+	std::string vertexCode;
+	std::string fragmentCode;
+	if (!readShaderFile("BasicVert.glsl", vertexCode) || !readShaderFile("BasicFrag.glsl", fragmentCode))
+	{
+		return;
+	}
+
+	if (!(GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile))
+	{
+		printf("Parallel shader compile is not supported, only one thread count will be measured\n");
+	}
+
+	//The binary cache would hide the compile cost entirely
+	std::string cacheDirectory = getProgramBinaryCacheDirectory();
+	setProgramBinaryCacheDirectory("");
+
+	unsigned int run = 0;
+	for (GLuint threads : { 1u, 2u, 4u, 8u, 16u })
+	{
+		ShaderBatch batch;
+		batch.setMaxCompilerThreads(threads);
+		for (int i = 0; i < PROGRAM_COUNT; i++)
+		{
+			//A unique define per program and run stops the driver's own cache from short circuiting the compile
+			std::vector<std::string> defines = { "BENCHMARK_VARIANT " + std::to_string(run * PROGRAM_COUNT + i) };
+			batch.addSource("benchmark", injectDefines(vertexCode, defines), injectDefines(fragmentCode, defines));
+		}
+		batch.wait();
+		printf("shader_compile: %2u threads, %d programs, %.2fms\n", threads, PROGRAM_COUNT, batch.getCompileTime());
+		run++;
+
+		if (!(GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile))
+		{
+			break;
+		}
+	}
+
+	setProgramBinaryCacheDirectory(cacheDirectory);
+}
+
+static double millisecondsSince(uint64_t start)
+{
+	return (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+//Records and sorts a frame's worth of draws with randomised keys, the GL submission itself is not timed
+static void benchmarkRenderQueueSort()
+{
+	const int FRAMES = 100;
+	std::mt19937 random(1234);
+
+	for (int drawCount : { 10000, 50000, 100000 })
+	{
+		RenderQueue queue;
+		queue.reserve(drawCount);
+
+		double recordTime = 0.0;
+		double sortTime = 0.0;
+		for (int frame = 0; frame < FRAMES; frame++)
+		{
+			uint64_t start = SDL_GetPerformanceCounter();
+			for (int i = 0; i < drawCount; i++)
+			{
+				DrawCommand command = {};
+				command.sortKey = makeSortKey(random() % 4, random() % 32, random() % 256, random() % 1024, (float)(random() % 1000) * 0.1f);
+				queue.submit(command);
+			}
+			recordTime += millisecondsSince(start);
+
+			start = SDL_GetPerformanceCounter();
+			queue.sort();
+			sortTime += millisecondsSince(start);
+			queue.clear();
+		}
+		printf("render_queue: %6d draws, record %.3fms, sort %.3fms per frame\n", drawCount, recordTime / FRAMES, sortTime / FRAMES);
+	}
+}
+
+//Unit cube in the geometry arena, the shape does not matter for measuring submission cost
+static Mesh* createCubeMesh()
+{
+	Vertex vertices[8];
+	for (int i = 0; i < 8; i++)
+	{
+		vertices[i] = { (i & 1) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f, (i & 4) ? 0.5f : -0.5f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f };
+	}
+	unsigned int indices[36] =
+	{
+		0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+		2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5
+	};
+
+	Mesh* pMesh = new Mesh();
+	pMesh->init();
+	pMesh->copyBufferData(vertices, 8, indices, 36);
+	return pMesh;
+}
+
+//Draws a collection of separate meshes with one draw call each and then with a single multi draw indirect
+static void benchmarkMultiDrawIndirect()
+{
+	const int FRAMES = 200;
+
+	GLuint programID = LoadShaders("IndirectVert.glsl", "BasicFrag.glsl");
+	GLint Result = GL_FALSE;
+	glGetProgramiv(programID, GL_LINK_STATUS, &Result);
+	if (Result != GL_TRUE)
+	{
+		printf("multi_draw_indirect: IndirectVert.glsl did not link, the driver probably lacks GL 4.3 and gl_DrawID\n");
+		glDeleteProgram(programID);
+		return;
+	}
+	getGLState().useProgram(programID);
+
+	for (int meshCount : { 1000, 10000 })
+	{
+		MeshCollection collection;
+		for (int i = 0; i < meshCount; i++)
+		{
+			collection.addMesh(createCubeMesh());
+			collection.setModelMatrix(i, glm::scale(glm::mat4(1.0f), glm::vec3(0.01f)));
+		}
+		if (!collection.buildIndirect())
+		{
+			printf("multi_draw_indirect: not supported by this driver\n");
+			break;
+		}
+
+		for (int indirect = 0; indirect < 2; indirect++)
+		{
+			collection.setUseIndirect(indirect != 0);
+			double submitTime = 0.0;
+			double frameTime = 0.0;
+			for (int frame = 0; frame < FRAMES; frame++)
+			{
+				uint64_t start = SDL_GetPerformanceCounter();
+				collection.render();
+				submitTime += millisecondsSince(start);
+				glFinish();
+				frameTime += millisecondsSince(start);
+			}
+			printf("multi_draw_indirect: %5d meshes, %-9s submit %.3fms, submit+gpu %.3fms per frame\n", meshCount,
+				indirect ? "indirect" : "per-mesh", submitTime / FRAMES, frameTime / FRAMES);
+		}
+		collection.destroy();
+	}
+
+	getGLState().useProgram(0);
+	getGLState().deleteProgram(programID);
+}
+
+//Streams a full set of instance transforms every frame and draws them all with one instanced call
+static void benchmarkInstancing()
+{
+	const int FRAMES = 100;
+
+	GLuint programID = LoadShaders("InstancedVert.glsl", "BasicFrag.glsl");
+	getGLState().useProgram(programID);
+	Mesh* pCube = createCubeMesh();
+
+	for (int instanceCount : { 1000, 10000, 100000 })
+	{
+		std::vector<InstanceData> instances(instanceCount);
+		for (int i = 0; i < instanceCount; i++)
+		{
+			glm::vec3 position((float)(i % 100) * 0.02f - 1.0f, (float)((i / 100) % 100) * 0.02f - 1.0f, (float)(i / 10000) * 0.1f);
+			instances[i].transform = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(0.005f));
+			instances[i].colour = glm::vec4(1.0f);
+			instances[i].custom = glm::vec4(0.0f);
+		}
+
+		double submitTime = 0.0;
+		double frameTime = 0.0;
+		for (int frame = 0; frame < FRAMES; frame++)
+		{
+			uint64_t start = SDL_GetPerformanceCounter();
+			pCube->renderInstanced(instances.data(), instanceCount);
+			submitTime += millisecondsSince(start);
+			glFinish();
+			frameTime += millisecondsSince(start);
+		}
+		printf("instancing: %6d instances, upload+submit %.3fms, with gpu %.3fms per frame\n", instanceCount,
+			submitTime / FRAMES, frameTime / FRAMES);
+	}
+
+	delete pCube;
+	getGLState().useProgram(0);
+	getGLState().deleteProgram(programID);
+}
+
+//Same instanced draw as above but without a glFinish per frame, so the CPU runs ahead and the cost of keeping
+//in flight instance data safe shows: orphaning a buffer each frame versus writing into a fenced persistent ring
+static void benchmarkStreaming()
+{
+	const int FRAMES = 300;
+	const int INSTANCE_COUNT = 10000;
+
+	GLuint programID = LoadShaders("InstancedVert.glsl", "BasicFrag.glsl");
+	getGLState().useProgram(programID);
+	Mesh* pCube = createCubeMesh();
+
+	std::vector<InstanceData> instances(INSTANCE_COUNT);
+	for (int i = 0; i < INSTANCE_COUNT; i++)
+	{
+		glm::vec3 position((float)(i % 100) * 0.02f - 1.0f, (float)(i / 100) * 0.02f - 1.0f, 0.0f);
+		instances[i].transform = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(0.005f));
+		instances[i].colour = glm::vec4(1.0f);
+		instances[i].custom = glm::vec4(0.0f);
+	}
+
+	glFinish();
+	uint64_t start = SDL_GetPerformanceCounter();
+	for (int frame = 0; frame < FRAMES; frame++)
+	{
+		pCube->renderInstanced(instances.data(), INSTANCE_COUNT);
+		glFlush();
+	}
+	glFinish();
+	printf("streaming: orphaned buffer %.3fms per frame\n", millisecondsSince(start) / FRAMES);
+
+	StreamingBuffer streamingBuffer;
+	if (streamingBuffer.init(INSTANCE_COUNT * sizeof(InstanceData)))
+	{
+		start = SDL_GetPerformanceCounter();
+		for (int frame = 0; frame < FRAMES; frame++)
+		{
+			streamingBuffer.beginFrame();
+			pCube->renderInstanced(streamingBuffer, instances.data(), INSTANCE_COUNT);
+			streamingBuffer.endFrame();
+			glFlush();
+		}
+		glFinish();
+		printf("streaming: %s ring %.3fms per frame, %.3fms waiting on fences\n",
+			streamingBuffer.isPersistent() ? "persistent" : "unsynchronised", millisecondsSince(start) / FRAMES,
+			streamingBuffer.getWaitTime());
+		streamingBuffer.destroy();
+	}
+
+	delete pCube;
+	getGLState().useProgram(0);
+	getGLState().deleteProgram(programID);
+}
+
+//Streams meshes of random sizes in and out of the geometry arena until it is badly fragmented, then counts the
+//frames and time compaction takes to bring the free space back into one piece
+static void benchmarkArenaCompaction()
+{
+	const int MESH_COUNT = 4000;
+
+	std::mt19937 random(1234);
+	std::uniform_int_distribution<unsigned int> vertexCounts(24, 2000);
+	std::vector<Vertex> vertices(2000);
+	std::vector<unsigned int> indices(6000);
+
+	std::vector<Mesh*> meshes;
+	for (int i = 0; i < MESH_COUNT; i++)
+	{
+		unsigned int vertexCount = vertexCounts(random);
+		Mesh* pMesh = new Mesh();
+		pMesh->copyBufferData(vertices.data(), vertexCount, indices.data(), vertexCount * 3);
+		meshes.push_back(pMesh);
+	}
+	//Unload every other mesh, leaving holes throughout the buffers
+	for (int i = 0; i < MESH_COUNT; i += 2)
+	{
+		delete meshes[i];
+		meshes[i] = nullptr;
+	}
+
+	//Their ranges only go back to the free lists once no queued frame could still draw from them
+	GeometryArena& arena = getGeometryArena();
+	for (unsigned int i = 0; i < arena.getRetireFrames(); i++)
+	{
+		arena.compact(0);
+	}
+	arena.printStats();
+
+	int frames = 0;
+	double compactTime = 0.0;
+	while (frames < 1000)
+	{
+		uint64_t start = SDL_GetPerformanceCounter();
+		arena.compact();
+		glFinish();
+		compactTime += millisecondsSince(start);
+		frames++;
+		if (arena.getBytesMovedLastFrame() == 0 && arena.getVertexAllocator().getFragmentation() < 0.1f &&
+			arena.getIndexAllocator().getFragmentation() < 0.1f)
+		{
+			break;
+		}
+	}
+	//Let the retired ranges go back to the free lists
+	for (unsigned int i = 0; i < arena.getRetireFrames(); i++)
+	{
+		arena.compact(0);
+	}
+	printf("arena_compaction: %d frames, %.3fms per frame including gpu copies\n", frames, compactTime / frames);
+	arena.printStats();
+
+	for (Mesh* pMesh : meshes)
+	{
+		delete pMesh;
+	}
+}
+
+//Culls a million randomly placed boxes against a camera frustum with the scalar kernel, the 8 wide AVX2 kernel and
+//the AVX2 kernel spread over every core, checking all three agree
+static void benchmarkFrustumCulling()
+{
+	const int ITERATIONS = 20;
+	const size_t OBJECT_COUNT = 1000000;
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> positions(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> sizes(0.5f, 5.0f);
+	CullingBounds bounds;
+	bounds.reserve(OBJECT_COUNT);
+	for (size_t i = 0; i < OBJECT_COUNT; i++)
+	{
+		glm::vec3 centre(positions(random), positions(random), positions(random));
+		glm::vec3 extent(sizes(random));
+		bounds.add(centre - extent, centre + extent);
+	}
+
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 400.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = extractFrustum(projection * view);
+
+	std::vector<uint8_t> scalarVisible(OBJECT_COUNT);
+	std::vector<uint8_t> visible(OBJECT_COUNT);
+
+	uint64_t start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < ITERATIONS; i++)
+	{
+		cullFrustum(frustum, bounds, 0, OBJECT_COUNT, scalarVisible.data(), CULLING_SCALAR);
+	}
+	double scalarTime = millisecondsSince(start) / ITERATIONS;
+	size_t visibleCount = 0;
+	for (uint8_t isVisible : scalarVisible)
+	{
+		visibleCount += isVisible;
+	}
+	printf("frustum_culling: %zu objects, %zu visible\n", OBJECT_COUNT, visibleCount);
+	printf("frustum_culling: scalar %.3fms\n", scalarTime);
+
+	if (isAVX2Supported())
+	{
+		start = SDL_GetPerformanceCounter();
+		for (int i = 0; i < ITERATIONS; i++)
+		{
+			cullFrustum(frustum, bounds, 0, OBJECT_COUNT, visible.data(), CULLING_AVX2);
+		}
+		double simdTime = millisecondsSince(start) / ITERATIONS;
+		printf("frustum_culling: avx2 %.3fms (%.1fx)%s\n", simdTime, scalarTime / simdTime,
+			visible == scalarVisible ? "" : " MISMATCH");
+	}
+	else
+	{
+		printf("frustum_culling: avx2 not supported on this cpu\n");
+	}
+
+	start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < ITERATIONS; i++)
+	{
+		cullFrustumParallel(frustum, bounds, visible.data());
+	}
+	double parallelTime = millisecondsSince(start) / ITERATIONS;
+	printf("frustum_culling: parallel %.3fms (%.1fx)%s\n", parallelTime, scalarTime / parallelTime,
+		visible == scalarVisible ? "" : " MISMATCH");
+}
+
+//Builds a BVH over randomly placed boxes and times frustum, ray and sphere queries against a linear scan of the
+//same boxes, then how long refitting and incrementally rebuilding take once a third of the boxes move
+static void benchmarkBVH()
+{
+	const size_t OBJECT_COUNT = 250000;
+	const int QUERY_COUNT = 200;
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> positions(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> sizes(0.5f, 5.0f);
+	std::vector<glm::vec3> mins(OBJECT_COUNT);
+	std::vector<glm::vec3> maxs(OBJECT_COUNT);
+	CullingBounds bounds;
+	bounds.reserve(OBJECT_COUNT);
+	for (size_t i = 0; i < OBJECT_COUNT; i++)
+	{
+		glm::vec3 centre(positions(random), positions(random), positions(random));
+		glm::vec3 extent(sizes(random));
+		mins[i] = centre - extent;
+		maxs[i] = centre + extent;
+		bounds.add(mins[i], maxs[i]);
+	}
+
+	BVH bvh;
+	uint64_t start = SDL_GetPerformanceCounter();
+	bvh.build(mins.data(), maxs.data(), OBJECT_COUNT);
+	printf("bvh: %zu objects, build %.1fms, %zu nodes, SAH cost %.1f\n", OBJECT_COUNT, millisecondsSince(start), bvh.getNodeCount(), bvh.getCost());
+
+	//Frustum, against the SIMD linear cull
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 400.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum = extractFrustum(projection * view);
+	std::vector<uint32_t> results;
+	start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < QUERY_COUNT; i++)
+	{
+		results.clear();
+		bvh.queryFrustum(frustum, results);
+	}
+	double treeTime = millisecondsSince(start) / QUERY_COUNT;
+	std::vector<uint8_t> visible(OBJECT_COUNT);
+	start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < QUERY_COUNT; i++)
+	{
+		cullFrustum(frustum, bounds, 0, OBJECT_COUNT, visible.data());
+	}
+	double linearTime = millisecondsSince(start) / QUERY_COUNT;
+	std::vector<uint32_t> linearResults;
+	gatherVisible(visible.data(), OBJECT_COUNT, linearResults);
+	std::sort(results.begin(), results.end());
+	printf("bvh: frustum %.3fms, linear %.3fms, %zu visible%s\n", treeTime, linearTime, results.size(), results == linearResults ? "" : " MISMATCH");
+
+	//Nearest hit rays
+	std::vector<glm::vec3> origins(QUERY_COUNT);
+	std::vector<glm::vec3> directions(QUERY_COUNT);
+	for (int i = 0; i < QUERY_COUNT; i++)
+	{
+		origins[i] = glm::vec3(positions(random), positions(random), positions(random));
+		directions[i] = glm::normalize(glm::vec3(positions(random), positions(random), positions(random)));
+	}
+	std::vector<float> treeDistances(QUERY_COUNT, -1.0f);
+	start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < QUERY_COUNT; i++)
+	{
+		uint32_t hitIndex;
+		float hitDistance;
+		if (bvh.raycast(origins[i], directions[i], 2000.0f, hitIndex, hitDistance))
+		{
+			treeDistances[i] = hitDistance;
+		}
+	}
+	treeTime = millisecondsSince(start) / QUERY_COUNT;
+	int mismatches = 0;
+	start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < QUERY_COUNT; i++)
+	{
+		glm::vec3 inverseDirection = 1.0f / directions[i];
+		float nearest = -1.0f;
+		for (size_t j = 0; j < OBJECT_COUNT; j++)
+		{
+			glm::vec3 t0 = (mins[j] - origins[i]) * inverseDirection;
+			glm::vec3 t1 = (maxs[j] - origins[i]) * inverseDirection;
+			glm::vec3 tNear = glm::min(t0, t1);
+			glm::vec3 tFar = glm::max(t0, t1);
+			float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+			float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, 2000.0f));
+			if (entry <= exit && (nearest < 0.0f || entry < nearest))
+			{
+				nearest = entry;
+			}
+		}
+		mismatches += std::abs(nearest - treeDistances[i]) > 0.001f ? 1 : 0;
+	}
+	linearTime = millisecondsSince(start) / QUERY_COUNT;
+	printf("bvh: raycast %.4fms, linear %.3fms%s\n", treeTime, linearTime, mismatches == 0 ? "" : " MISMATCH");
+
+	//Sphere overlaps
+	size_t treeCount = 0;
+	start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < QUERY_COUNT; i++)
+	{
+		results.clear();
+		bvh.querySphere(origins[i], 25.0f, results);
+		treeCount += results.size();
+	}
+	treeTime = millisecondsSince(start) / QUERY_COUNT;
+	size_t linearCount = 0;
+	start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < QUERY_COUNT; i++)
+	{
+		for (size_t j = 0; j < OBJECT_COUNT; j++)
+		{
+			glm::vec3 offset = glm::max(mins[j] - origins[i], glm::vec3(0.0f)) + glm::max(origins[i] - maxs[j], glm::vec3(0.0f));
+			linearCount += glm::dot(offset, offset) <= 25.0f * 25.0f ? 1 : 0;
+		}
+	}
+	linearTime = millisecondsSince(start) / QUERY_COUNT;
+	printf("bvh: sphere %.4fms, linear %.3fms%s\n", treeTime, linearTime, treeCount == linearCount ? "" : " MISMATCH");
+
+	//A third of the objects drift each frame
+	std::uniform_real_distribution<float> drift(-2.0f, 2.0f);
+	double refitTime = 0.0;
+	double updateTime = 0.0;
+	for (int frame = 0; frame < 10; frame++)
+	{
+		for (size_t i = 0; i < OBJECT_COUNT; i += 3)
+		{
+			glm::vec3 offset(drift(random), drift(random), drift(random));
+			mins[i] += offset;
+			maxs[i] += offset;
+		}
+		start = SDL_GetPerformanceCounter();
+		bvh.refit(mins.data(), maxs.data());
+		refitTime += millisecondsSince(start);
+		start = SDL_GetPerformanceCounter();
+		bvh.update(mins.data(), maxs.data());
+		updateTime += millisecondsSince(start);
+	}
+	printf("bvh: refit %.2fms, update %.2fms per frame, %u subtrees rebuilt, SAH cost %.1f\n", refitTime / 10, updateTime / 10,
+		bvh.getSubtreeRebuildCount(), bvh.getCost());
+}
+
+//An indoor style scene: a grid of wall occluders with small objects scattered between and behind them, culled
+//by frustum and then occlusion from a camera looking down the rows
+static void benchmarkOcclusionCulling()
+{
+	const int FRAMES = 100;
+	const size_t OBJECT_COUNT = 100000;
+
+	//Unit quad in the YZ plane, scaled into walls
+	glm::vec3 quad[4] = { glm::vec3(0.0f, -1.0f, -1.0f), glm::vec3(0.0f, 1.0f, -1.0f), glm::vec3(0.0f, 1.0f, 1.0f), glm::vec3(0.0f, -1.0f, 1.0f) };
+	unsigned int quadIndices[6] = { 0, 1, 2, 0, 2, 3 };
+
+	OcclusionCuller occlusionCuller;
+	occlusionCuller.init();
+	unsigned int wallID = occlusionCuller.registerOccluder(quad, 4, quadIndices, 6);
+	std::vector<glm::mat4> walls;
+	for (int row = 1; row <= 8; row++)
+	{
+		for (int column = -4; column <= 4; column++)
+		{
+			glm::vec3 position(row * 40.0f, 0.0f, column * 30.0f);
+			walls.push_back(glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(1.0f, 10.0f, 12.0f)));
+		}
+	}
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> along(1.0f, 350.0f);
+	std::uniform_real_distribution<float> across(-150.0f, 150.0f);
+	std::uniform_real_distribution<float> height(-8.0f, 8.0f);
+	CullingBounds bounds;
+	bounds.reserve(OBJECT_COUNT);
+	for (size_t i = 0; i < OBJECT_COUNT; i++)
+	{
+		glm::vec3 centre(along(random), height(random), across(random));
+		bounds.add(centre - glm::vec3(0.5f), centre + glm::vec3(0.5f));
+	}
+
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 400.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 viewProjection = projection * view;
+	Frustum frustum = extractFrustum(viewProjection);
+
+	std::vector<uint8_t> visible(OBJECT_COUNT);
+	size_t frustumVisible = 0;
+	double totalTime = 0.0;
+	for (int frame = 0; frame < FRAMES; frame++)
+	{
+		cullFrustumParallel(frustum, bounds, visible.data());
+		if (frame == 0)
+		{
+			for (uint8_t isVisible : visible)
+			{
+				frustumVisible += isVisible;
+			}
+		}
+
+		uint64_t start = SDL_GetPerformanceCounter();
+		occlusionCuller.beginFrame(viewProjection);
+		for (const glm::mat4& wall : walls)
+		{
+			occlusionCuller.addOccluder(wallID, wall);
+		}
+		occlusionCuller.rasterize();
+		occlusionCuller.cull(bounds, visible.data());
+		totalTime += millisecondsSince(start);
+	}
+
+	const OcclusionStats& stats = occlusionCuller.getStats();
+	printf("occlusion_culling: %zu objects, %zu in frustum, %u occluded, %.3fms per frame\n", OBJECT_COUNT, frustumVisible,
+		stats.objectsOccluded, totalTime / FRAMES);
+	occlusionCuller.printStats();
+}
+
+//A million node hierarchy, as a few thousand models each with a skeleton or sub objects, updated with everything
+//dirty, with one percent of nodes animated, and with nothing changed
+static void benchmarkSceneGraph()
+{
+	const size_t NODE_COUNT = 1000000;
+	const size_t ROOT_COUNT = 4000;
+	const int FRAMES = 20;
+
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> offsets(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> angles(-3.14f, 3.14f);
+	auto randomTransform = [&]()
+	{
+		glm::mat4 translation = glm::translate(glm::mat4(1.0f), glm::vec3(offsets(random), offsets(random), offsets(random)));
+		return glm::rotate(translation, angles(random), glm::vec3(0.0f, 1.0f, 0.0f));
+	};
+
+	SceneGraph sceneGraph;
+	sceneGraph.reserve(NODE_COUNT);
+	std::vector<SceneNode> nodes;
+	nodes.reserve(NODE_COUNT);
+	std::vector<SceneNode> roots;
+	for (size_t i = 0; i < NODE_COUNT; i++)
+	{
+		//Each model's nodes hang off random earlier nodes of the same model, so trees are a handful of levels deep
+		//and arrive out of depth order
+		size_t modelStart = i - i % (NODE_COUNT / ROOT_COUNT);
+		SceneNode parent = i == modelStart ? INVALID_SCENE_NODE : nodes[modelStart + random() % (i - modelStart)];
+		nodes.push_back(sceneGraph.create(parent, randomTransform()));
+		if (parent == INVALID_SCENE_NODE)
+		{
+			roots.push_back(nodes.back());
+		}
+	}
+
+	uint64_t start = SDL_GetPerformanceCounter();
+	sceneGraph.update();
+	printf("scene_graph: %zu nodes, %u levels, first update with sort %.3fms\n", sceneGraph.size(), sceneGraph.getDepthCount(),
+		millisecondsSince(start));
+
+	//Reference world transforms by walking each node's parent chain
+	float maxError = 0.0f;
+	for (int i = 0; i < 1000; i++)
+	{
+		SceneNode node = nodes[random() % NODE_COUNT];
+		glm::mat4 world = sceneGraph.getLocalTransform(node);
+		for (SceneNode parent = sceneGraph.getParent(node); parent != INVALID_SCENE_NODE; parent = sceneGraph.getParent(parent))
+		{
+			world = sceneGraph.getLocalTransform(parent) * world;
+		}
+		for (int column = 0; column < 4; column++)
+		{
+			glm::vec4 difference = glm::abs(world[column] - sceneGraph.getWorldTransform(node)[column]);
+			maxError = std::max(maxError, std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w)));
+		}
+	}
+
+	double allDirtyTime = 0.0;
+	for (int frame = 0; frame < FRAMES; frame++)
+	{
+		for (SceneNode root : roots)
+		{
+			sceneGraph.setLocalTransform(root, randomTransform());
+		}
+		start = SDL_GetPerformanceCounter();
+		sceneGraph.update();
+		allDirtyTime += millisecondsSince(start);
+	}
+	printf("scene_graph: all dirty %.3fms, %zu updated, max error %g\n", allDirtyTime / FRAMES, sceneGraph.getUpdatedNodes().size(), maxError);
+
+	double animatedTime = 0.0;
+	size_t animatedCount = 0;
+	for (int frame = 0; frame < FRAMES; frame++)
+	{
+		for (size_t i = 0; i < NODE_COUNT / 100; i++)
+		{
+			sceneGraph.setLocalTransform(nodes[random() % NODE_COUNT], randomTransform());
+		}
+		start = SDL_GetPerformanceCounter();
+		sceneGraph.update();
+		animatedTime += millisecondsSince(start);
+		animatedCount += sceneGraph.getUpdatedNodes().size();
+	}
+	printf("scene_graph: 1%% animated %.3fms, %zu updated per frame\n", animatedTime / FRAMES, animatedCount / FRAMES);
+
+	start = SDL_GetPerformanceCounter();
+	for (int frame = 0; frame < FRAMES; frame++)
+	{
+		sceneGraph.update();
+	}
+	printf("scene_graph: unchanged %.3fms\n", millisecondsSince(start) / FRAMES);
+}
+
+struct EntityPosition
+{
+	glm::vec3 value;
+};
+
+struct EntityVelocity
+{
+	glm::vec3 value;
+};
+
+struct EntityHealth
+{
+	float value;
+	float regeneration;
+};
+
+struct EntityTransform
+{
+	glm::mat4 value;
+};
+
+//What game objects look like today, a heap allocation each with hot and cold data mixed, reached through a pointer
+struct HeapGameObject
+{
+	std::string name;
+	glm::vec3 position;
+	glm::mat4 transform;
+	glm::vec3 velocity;
+	float health;
+	float regeneration;
+	Mesh* pMesh;
+	char editorData[96];
+};
+
+//The same movement, health and transform updates over 1M objects, first as scattered heap objects through pointers
+//and then as ECS systems over archetype chunks, with the systems scheduled in parallel by their declared access
+static void benchmarkECS()
+{
+	const size_t ENTITY_COUNT = 1000000;
+	const int FRAMES = 20;
+	//Static so the system lambdas can read it without capturing
+	static const float DELTA_TIME = 1.0f / 60.0f;
+
+	//Heap objects allocated in a shuffled order with other allocations in between, as after a level has been
+	//played for a while
+	std::mt19937 random(1234);
+	std::vector<HeapGameObject*> objects(ENTITY_COUNT);
+	std::vector<size_t> order(ENTITY_COUNT);
+	for (size_t i = 0; i < ENTITY_COUNT; i++)
+	{
+		order[i] = i;
+	}
+	std::shuffle(order.begin(), order.end(), random);
+	std::vector<std::vector<char>> otherAllocations;
+	for (size_t i : order)
+	{
+		objects[i] = new HeapGameObject();
+		objects[i]->position = glm::vec3((float)i, 0.0f, 0.0f);
+		objects[i]->velocity = glm::vec3(1.0f, 2.0f, 3.0f);
+		objects[i]->health = 50.0f;
+		objects[i]->regeneration = 1.0f;
+		otherAllocations.push_back(std::vector<char>(random() % 256));
+	}
+
+	uint64_t start = SDL_GetPerformanceCounter();
+	for (int frame = 0; frame < FRAMES; frame++)
+	{
+		for (HeapGameObject* pObject : objects)
+		{
+			pObject->position += pObject->velocity * DELTA_TIME;
+			pObject->health = std::min(100.0f, pObject->health + pObject->regeneration * DELTA_TIME);
+			pObject->transform = glm::translate(glm::mat4(1.0f), pObject->position);
+		}
+	}
+	double pointerTime = millisecondsSince(start) / FRAMES;
+
+	EntityWorld world;
+	start = SDL_GetPerformanceCounter();
+	std::vector<Entity> entities(ENTITY_COUNT);
+	for (size_t i = 0; i < ENTITY_COUNT; i++)
+	{
+		entities[i] = world.create(EntityPosition{ glm::vec3((float)i, 0.0f, 0.0f) }, EntityVelocity{ glm::vec3(1.0f, 2.0f, 3.0f) },
+			EntityHealth{ 50.0f, 1.0f }, EntityTransform{ glm::mat4(1.0f) });
+	}
+	double createTime = millisecondsSince(start);
+
+	SystemScheduler scheduler;
+	scheduler.add("movement", SystemAccess().write<EntityPosition>().read<EntityVelocity>(), [](EntityWorld& entityWorld)
+	{
+		entityWorld.forEachChunk<EntityPosition, const EntityVelocity>([](size_t count, const Entity*, EntityPosition* pPositions, const EntityVelocity* pVelocities)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				pPositions[i].value += pVelocities[i].value * DELTA_TIME;
+			}
+		});
+	});
+	scheduler.add("health", SystemAccess().write<EntityHealth>(), [](EntityWorld& entityWorld)
+	{
+		entityWorld.forEachChunk<EntityHealth>([](size_t count, const Entity*, EntityHealth* pHealth)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				pHealth[i].value = std::min(100.0f, pHealth[i].value + pHealth[i].regeneration * DELTA_TIME);
+			}
+		});
+	});
+	scheduler.add("transform", SystemAccess().read<EntityPosition>().write<EntityTransform>(), [](EntityWorld& entityWorld)
+	{
+		entityWorld.forEachChunkParallel<const EntityPosition, EntityTransform>([](size_t count, const Entity*, const EntityPosition* pPositions, EntityTransform* pTransforms)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				pTransforms[i].value = glm::translate(glm::mat4(1.0f), pPositions[i].value);
+			}
+		});
+	});
+
+	start = SDL_GetPerformanceCounter();
+	for (int frame = 0; frame < FRAMES; frame++)
+	{
+		scheduler.run(world);
+	}
+	double ecsTime = millisecondsSince(start) / FRAMES;
+
+	//Both sides ran the same updates so they must agree
+	size_t mismatches = 0;
+	for (size_t i = 0; i < ENTITY_COUNT; i += 997)
+	{
+		if (world.get<EntityPosition>(entities[i])->value != objects[i]->position || world.get<EntityHealth>(entities[i])->value != objects[i]->health)
+		{
+			mismatches++;
+		}
+	}
+
+	//Churn, destroying and recreating a tenth of the entities, and a stale handle check
+	start = SDL_GetPerformanceCounter();
+	for (size_t i = 0; i < ENTITY_COUNT; i += 10)
+	{
+		world.destroy(entities[i]);
+		entities[i] = world.create(EntityPosition{ glm::vec3(0.0f) }, EntityVelocity{ glm::vec3(0.0f) });
+	}
+	double churnTime = millisecondsSince(start);
+	bool staleRejected = !world.isAlive(Entity{ entities[0].index, entities[0].generation - 1 });
+
+	printf("ecs: %zu entities, create %.1fms, churn of %zu %.1fms, stale handles %s\n", ENTITY_COUNT, createTime, ENTITY_COUNT / 10,
+		churnTime, staleRejected ? "rejected" : "NOT REJECTED");
+	printf("ecs: pointer chasing %.3fms, archetype systems %.3fms (%.1fx) in %zu batches%s\n", pointerTime, ecsTime, pointerTime / ecsTime,
+		scheduler.getBatchCount(), mismatches == 0 ? "" : " MISMATCH");
+	scheduler.printSchedule();
+	world.printStats();
+
+	for (HeapGameObject* pObject : objects)
+	{
+		delete pObject;
+	}
+}
+
+//Cost of the job system itself: many empty jobs, a parallel for over cheap items against the same loop on one
+//thread, and a chain of dependent stages
+static void benchmarkJobs()
+{
+	const int JOB_COUNT = 100000;
+	const size_t ITEM_COUNT = 4000000;
+
+	JobSystem& jobSystem = getJobSystem();
+	std::atomic<int> executed(0);
+	uint64_t start = SDL_GetPerformanceCounter();
+	JobCounter counter;
+	for (int i = 0; i < JOB_COUNT; i++)
+	{
+		jobSystem.schedule([&executed]()
+		{
+			executed++;
+		}, &counter);
+	}
+	jobSystem.wait(counter);
+	double emptyTime = millisecondsSince(start);
+	printf("jobs: %u threads, %d empty jobs %.2fms (%.0fns each)%s\n", jobSystem.getThreadCount(), JOB_COUNT, emptyTime,
+		emptyTime * 1000000.0 / JOB_COUNT, executed == JOB_COUNT ? "" : " MISSING JOBS");
+
+	std::vector<float> values(ITEM_COUNT, 1.0f);
+	start = SDL_GetPerformanceCounter();
+	for (size_t i = 0; i < ITEM_COUNT; i++)
+	{
+		values[i] = std::sqrt(values[i] * 4.0f + 1.0f);
+	}
+	double serialTime = millisecondsSince(start);
+	start = SDL_GetPerformanceCounter();
+	jobSystem.parallelFor(ITEM_COUNT, [&values](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			values[i] = std::sqrt(values[i] * 4.0f + 1.0f);
+		}
+	}, 0, 1024);
+	double parallelTime = millisecondsSince(start);
+	printf("jobs: parallel for over %zu items %.3fms, one thread %.3fms\n", ITEM_COUNT, parallelTime, serialTime);
+
+	//Each stage fans out and the next only starts once it has finished
+	const int STAGES = 100;
+	const int JOBS_PER_STAGE = 16;
+	std::vector<JobCounter> stages(STAGES);
+	std::atomic<int> outOfOrder(0);
+	std::atomic<int> finished(0);
+	start = SDL_GetPerformanceCounter();
+	for (int stage = 0; stage < STAGES; stage++)
+	{
+		for (int i = 0; i < JOBS_PER_STAGE; i++)
+		{
+			jobSystem.schedule([&finished, &outOfOrder, stage]()
+			{
+				if (finished.load() < stage * JOBS_PER_STAGE)
+				{
+					outOfOrder++;
+				}
+				finished++;
+			}, &stages[stage], stage > 0 ? &stages[stage - 1] : nullptr);
+		}
+	}
+	jobSystem.wait(stages.back());
+	printf("jobs: %d dependent stages of %d %.3fms%s\n", STAGES, JOBS_PER_STAGE, millisecondsSince(start),
+		outOfOrder == 0 ? "" : " DEPENDENCY VIOLATED");
+	jobSystem.printStats();
+}
+
+//Stand in for a frame's transient data: a draw list where each draw carries a short list of commands, and
+//per-thread culling results
+struct TransientCommand
+{
+	uint32_t type;
+	uint32_t value;
+};
+
+static void benchmarkFrameAllocator()
+{
+	const int FRAMES = 200;
+	const uint32_t DRAW_COUNT = 20000;
+	const size_t OBJECT_COUNT = 200000;
+
+	//Start small so the first frames overflow and the arenas grow to fit
+	FrameAllocator frameAllocator;
+	frameAllocator.init(2, 256 * 1024, 64 * 1024);
+	JobSystem& jobSystem = getJobSystem();
+
+	uint64_t checksum = 0;
+	uint64_t start = SDL_GetPerformanceCounter();
+	for (int frame = 0; frame < FRAMES; frame++)
+	{
+		std::vector<std::vector<TransientCommand>> drawList(DRAW_COUNT);
+		for (uint32_t i = 0; i < DRAW_COUNT; i++)
+		{
+			for (uint32_t command = 0; command <= (i & 7); command++)
+			{
+				drawList[i].push_back({ command, i });
+			}
+		}
+		std::atomic<size_t> visible(0);
+		jobSystem.parallelFor(OBJECT_COUNT, [&visible](size_t begin, size_t end)
+		{
+			std::vector<uint32_t> results;
+			results.reserve(end - begin);
+			for (size_t i = begin; i < end; i++)
+			{
+				if ((i & 3) != 0)
+				{
+					results.push_back((uint32_t)i);
+				}
+			}
+			visible += results.size();
+		}, 0, 4096);
+		checksum += drawList.back().size() + visible;
+	}
+	double heapTime = millisecondsSince(start);
+
+	start = SDL_GetPerformanceCounter();
+	for (int frame = 0; frame < FRAMES; frame++)
+	{
+		frameAllocator.beginFrame();
+		FrameVector<FrameVector<TransientCommand>> drawList{ FrameAllocatorAdapter<FrameVector<TransientCommand>>(frameAllocator) };
+		drawList.reserve(DRAW_COUNT);
+		for (uint32_t i = 0; i < DRAW_COUNT; i++)
+		{
+			drawList.emplace_back(FrameAllocatorAdapter<TransientCommand>(frameAllocator));
+			for (uint32_t command = 0; command <= (i & 7); command++)
+			{
+				drawList[i].push_back({ command, i });
+			}
+		}
+		std::atomic<size_t> visible(0);
+		jobSystem.parallelFor(OBJECT_COUNT, [&visible, &frameAllocator](size_t begin, size_t end)
+		{
+			FrameVector<uint32_t> results{ FrameAllocatorAdapter<uint32_t>(frameAllocator) };
+			results.reserve(end - begin);
+			for (size_t i = begin; i < end; i++)
+			{
+				if ((i & 3) != 0)
+				{
+					results.push_back((uint32_t)i);
+				}
+			}
+			visible += results.size();
+		}, 0, 4096);
+		checksum -= drawList.back().size() + visible;
+	}
+	double frameTime = millisecondsSince(start);
+	printf("frame_allocator: %d frames of %u draw lists, heap %.3fms per frame, frame arenas %.3fms per frame%s\n", FRAMES,
+		DRAW_COUNT, heapTime / FRAMES, frameTime / FRAMES, checksum == 0 ? "" : " MISMATCH");
+
+	//A list kept past its frames should be reported as soon as it is touched again
+	FrameVector<uint32_t> stale{ FrameAllocatorAdapter<uint32_t>(frameAllocator) };
+	stale.push_back(0);
+	for (unsigned int i = 0; i < frameAllocator.getFrameCount(); i++)
+	{
+		frameAllocator.beginFrame();
+	}
+	stale.push_back(1);
+	printf("frame_allocator: stale list %s\n", FRAME_ALLOCATOR_DEBUG ? (frameAllocator.getUseAfterResetCount() > 0 ? "reported" : "NOT REPORTED") :
+		"not checked in release builds");
+	frameAllocator.printStats();
+}
+
+//Loads the crate texture and a model on this thread, then the same again through the job system where decoding
+//and parsing run on the workers and only the GL uploads come back to this thread
+static void benchmarkAsyncLoading()
+{
+	const int LOAD_COUNT = 8;
+	TextureOptions options;
+
+	std::vector<GLuint> textures(LOAD_COUNT, 0);
+	std::vector<Mesh*> meshes;
+	uint64_t start = SDL_GetPerformanceCounter();
+	for (int i = 0; i < LOAD_COUNT; i++)
+	{
+		textures[i] = loadTextureFromFile("Crate.jpg", options);
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		Mesh* pMesh = new Mesh();
+		pMesh->init();
+		if (loadModelDataFromFile("Cube.obj", vertices, indices))
+		{
+			pMesh->copyBufferData(vertices.data(), (unsigned int)vertices.size(), indices.data(), (unsigned int)indices.size());
+		}
+		meshes.push_back(pMesh);
+	}
+	double syncTime = millisecondsSince(start);
+
+	std::vector<GLuint> asyncTextures(LOAD_COUNT, 0);
+	std::vector<Mesh*> asyncMeshes;
+	start = SDL_GetPerformanceCounter();
+	JobCounter counter;
+	for (int i = 0; i < LOAD_COUNT; i++)
+	{
+		loadTextureFromFileAsync("Crate.jpg", options, &asyncTextures[i], &counter);
+		Mesh* pMesh = new Mesh();
+		pMesh->init();
+		loadModelIntoMeshAsync("Cube.obj", pMesh, &counter);
+		asyncMeshes.push_back(pMesh);
+	}
+	//Runs the uploads as they are queued, this is the thread which owns the context
+	getJobSystem().wait(counter);
+	double asyncTime = millisecondsSince(start);
+
+	int mismatches = 0;
+	for (int i = 0; i < LOAD_COUNT; i++)
+	{
+		if (asyncTextures[i] == 0 || asyncMeshes[i]->getNumberOfIndices() == 0 ||
+			asyncMeshes[i]->getNumberOfIndices() != meshes[i]->getNumberOfIndices())
+		{
+			mismatches++;
+		}
+	}
+	printf("async_loading: %d textures and models, on this thread %.2fms, through jobs %.2fms%s\n", LOAD_COUNT, syncTime,
+		asyncTime, mismatches == 0 ? "" : " LOAD FAILED");
+
+	getGLState().deleteTextures(LOAD_COUNT, textures.data());
+	getGLState().deleteTextures(LOAD_COUNT, asyncTextures.data());
+	for (int i = 0; i < LOAD_COUNT; i++)
+	{
+		delete meshes[i];
+		delete asyncMeshes[i];
+	}
+}
+
+struct Benchmark
+{
+	const char* name;
+	void (*pFunction)();
+};
+
+static const Benchmark s_Benchmarks[] =
+{
+	{ "shader_compile", benchmarkShaderCompile },
+	{ "render_queue", benchmarkRenderQueueSort },
+	{ "multi_draw_indirect", benchmarkMultiDrawIndirect },
+	{ "instancing", benchmarkInstancing },
+	{ "streaming", benchmarkStreaming },
+	{ "arena_compaction", benchmarkArenaCompaction },
+	{ "frustum_culling", benchmarkFrustumCulling },
+	{ "bvh", benchmarkBVH },
+	{ "occlusion_culling", benchmarkOcclusionCulling },
+	{ "scene_graph", benchmarkSceneGraph },
+	{ "ecs", benchmarkECS },
+	{ "jobs", benchmarkJobs },
+	{ "frame_allocator", benchmarkFrameAllocator },
+	{ "async_loading", benchmarkAsyncLoading },
+};
+
+bool runBenchmark(const std::string& name)
+{
+	bool found = false;
+	for (const Benchmark& benchmark : s_Benchmarks)
+	{
+		if (name == "all" || name == benchmark.name)
+		{
+			printf("Running benchmark %s\n", benchmark.name);
+			benchmark.pFunction();
+			found = true;
+		}
+	}
+
+	if (!found)
+	{
+		printf("Unknown benchmark %s\n", name.c_str());
+		listBenchmarks();
+	}
+	return found;
+}
+
+void listBenchmarks()
+{
+	printf("Benchmarks: all");
+	for (const Benchmark& benchmark : s_Benchmarks)
+	{
+		printf(", %s", benchmark.name);
+	}
+	printf("\n");
+}
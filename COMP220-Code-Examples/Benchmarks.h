@@ -0,0 +1,7 @@
+#pragma once
+
+#include <string>
+
+//Benchmarks which need a GL context, run from the command line with --bench <name> (usually with --headless)
+bool runBenchmark(const std::string& name);
+void listBenchmarks();
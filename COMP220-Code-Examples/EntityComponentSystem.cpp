@@ -0,0 +1,436 @@
+#include "EntityComponentSystem.h"
+#include "JobSystem.h"
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+static ComponentInfo s_ComponentInfo[MAX_COMPONENT_TYPES];
+static std::atomic<unsigned int> s_ComponentTypeCount(0);
+static std::mutex s_ComponentTypeMutex;
+
+static double millisecondsSince(uint64_t start)
+{
+	return (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+ComponentType registerComponentType(size_t size, size_t alignment, const char* pName)
+{
+	std::lock_guard<std::mutex> lock(s_ComponentTypeMutex);
+	unsigned int type = s_ComponentTypeCount.load();
+	if (type >= MAX_COMPONENT_TYPES)
+	{
+		//Any type returned here would share another component's storage, so there is nothing safe to carry on with
+		printf("Too many component types, %s cannot be registered (limit %u)\n", pName, MAX_COMPONENT_TYPES);
+		abort();
+	}
+	s_ComponentInfo[type].size = size;
+	s_ComponentInfo[type].alignment = alignment;
+	s_ComponentInfo[type].pName = pName;
+	s_ComponentTypeCount.store(type + 1);
+	return type;
+}
+
+const ComponentInfo& getComponentInfo(ComponentType type)
+{
+	return s_ComponentInfo[type];
+}
+
+Archetype::Archetype(const ComponentMask& mask)
+{
+	m_Mask = mask;
+	m_EntityCount = 0;
+	for (ComponentType type = 0; type < MAX_COMPONENT_TYPES; type++)
+	{
+		m_ColumnOffset[type] = 0;
+		m_AddEdges[type] = nullptr;
+		m_RemoveEdges[type] = nullptr;
+		if (mask.test(type))
+		{
+			m_Types.push_back(type);
+		}
+	}
+
+	//As many rows as fit once every column is padded to its alignment, at least one for very large components
+	size_t rowSize = sizeof(Entity);
+	size_t padding = COLUMN_ALIGNMENT;
+	for (ComponentType type : m_Types)
+	{
+		rowSize += s_ComponentInfo[type].size;
+		padding += std::max((size_t)COLUMN_ALIGNMENT, s_ComponentInfo[type].alignment);
+	}
+	m_Capacity = (uint32_t)std::max<size_t>(1, (CHUNK_SIZE - std::min((size_t)CHUNK_SIZE, padding)) / rowSize);
+
+	size_t offset = alignUp(sizeof(Entity) * m_Capacity, COLUMN_ALIGNMENT);
+	m_ChunkAlignment = COLUMN_ALIGNMENT;
+	for (ComponentType type : m_Types)
+	{
+		size_t alignment = std::max((size_t)COLUMN_ALIGNMENT, s_ComponentInfo[type].alignment);
+		m_ChunkAlignment = std::max(m_ChunkAlignment, alignment);
+		offset = alignUp(offset, alignment);
+		m_ColumnOffset[type] = (uint32_t)offset;
+		offset += s_ComponentInfo[type].size * m_Capacity;
+	}
+	m_ChunkBytes = std::max(offset, (size_t)1);
+}
+
+Archetype::~Archetype()
+{
+	for (ArchetypeChunk& chunk : m_Chunks)
+	{
+		::operator delete(chunk.pData, std::align_val_t(m_ChunkAlignment));
+	}
+}
+
+void Archetype::addRow(Entity entity, uint32_t& chunkIndex, uint32_t& row)
+{
+	if (m_Chunks.empty() || m_Chunks.back().count == m_Capacity)
+	{
+		ArchetypeChunk chunk;
+		chunk.pData = (uint8_t*)::operator new(m_ChunkBytes, std::align_val_t(m_ChunkAlignment));
+		chunk.count = 0;
+		m_Chunks.push_back(chunk);
+	}
+
+	ArchetypeChunk& chunk = m_Chunks.back();
+	chunkIndex = (uint32_t)m_Chunks.size() - 1;
+	row = chunk.count++;
+	getEntities(chunk)[row] = entity;
+	m_EntityCount++;
+}
+
+Entity Archetype::removeRow(uint32_t chunkIndex, uint32_t row)
+{
+	ArchetypeChunk& last = m_Chunks.back();
+	uint32_t lastRow = last.count - 1;
+	Entity moved = INVALID_ENTITY;
+	if (chunkIndex != m_Chunks.size() - 1 || row != lastRow)
+	{
+		ArchetypeChunk& chunk = m_Chunks[chunkIndex];
+		moved = getEntities(last)[lastRow];
+		getEntities(chunk)[row] = moved;
+		for (ComponentType type : m_Types)
+		{
+			size_t size = s_ComponentInfo[type].size;
+			memcpy((uint8_t*)getComponents(chunk, type) + row * size, (uint8_t*)getComponents(last, type) + lastRow * size, size);
+		}
+	}
+
+	last.count--;
+	m_EntityCount--;
+	if (last.count == 0)
+	{
+		::operator delete(last.pData, std::align_val_t(m_ChunkAlignment));
+		m_Chunks.pop_back();
+	}
+	return moved;
+}
+
+EntityWorld::EntityWorld()
+{
+	m_EntityCount = 0;
+}
+
+EntityWorld::~EntityWorld()
+{
+	clear();
+}
+
+void EntityWorld::clear()
+{
+	for (Archetype* pArchetype : m_Archetypes)
+	{
+		delete pArchetype;
+	}
+	m_Archetypes.clear();
+	m_ArchetypesByMask.clear();
+	m_Records.clear();
+	m_FreeIndices.clear();
+	m_EntityCount = 0;
+}
+
+Entity EntityWorld::allocateEntity()
+{
+	Entity entity;
+	if (!m_FreeIndices.empty())
+	{
+		entity.index = m_FreeIndices.back();
+		m_FreeIndices.pop_back();
+	}
+	else
+	{
+		entity.index = (uint32_t)m_Records.size();
+		EntityRecord record;
+		record.pArchetype = nullptr;
+		record.chunk = 0;
+		record.row = 0;
+		record.generation = 0;
+		m_Records.push_back(record);
+	}
+	entity.generation = m_Records[entity.index].generation;
+	m_EntityCount++;
+	return entity;
+}
+
+Entity EntityWorld::create()
+{
+	Entity entity = allocateEntity();
+	placeEntity(entity, getArchetype(ComponentMask()));
+	return entity;
+}
+
+void EntityWorld::destroy(Entity entity)
+{
+	if (!isAlive(entity))
+	{
+		return;
+	}
+	EntityRecord& record = m_Records[entity.index];
+	removeFromArchetype(record);
+	record.pArchetype = nullptr;
+	record.generation++;
+	m_FreeIndices.push_back(entity.index);
+	m_EntityCount--;
+}
+
+bool EntityWorld::isAlive(Entity entity) const
+{
+	return entity.index < m_Records.size() && m_Records[entity.index].generation == entity.generation &&
+		m_Records[entity.index].pArchetype != nullptr;
+}
+
+Archetype* EntityWorld::getArchetype(const ComponentMask& mask)
+{
+	auto it = m_ArchetypesByMask.find(mask);
+	if (it != m_ArchetypesByMask.end())
+	{
+		return it->second;
+	}
+	Archetype* pArchetype = new Archetype(mask);
+	m_Archetypes.push_back(pArchetype);
+	m_ArchetypesByMask[mask] = pArchetype;
+	return pArchetype;
+}
+
+Archetype* EntityWorld::getArchetypeWith(Archetype* pArchetype, ComponentType type)
+{
+	Archetype* pTarget = pArchetype->getAddEdge(type);
+	if (pTarget == nullptr)
+	{
+		ComponentMask mask = pArchetype->getMask();
+		mask.set(type);
+		pTarget = getArchetype(mask);
+		pArchetype->setAddEdge(type, pTarget);
+		pTarget->setRemoveEdge(type, pArchetype);
+	}
+	return pTarget;
+}
+
+Archetype* EntityWorld::getArchetypeWithout(Archetype* pArchetype, ComponentType type)
+{
+	Archetype* pTarget = pArchetype->getRemoveEdge(type);
+	if (pTarget == nullptr)
+	{
+		ComponentMask mask = pArchetype->getMask();
+		mask.reset(type);
+		pTarget = getArchetype(mask);
+		pArchetype->setRemoveEdge(type, pTarget);
+		pTarget->setAddEdge(type, pArchetype);
+	}
+	return pTarget;
+}
+
+void EntityWorld::placeEntity(Entity entity, Archetype* pArchetype)
+{
+	EntityRecord& record = m_Records[entity.index];
+	record.pArchetype = pArchetype;
+	pArchetype->addRow(entity, record.chunk, record.row);
+}
+
+void EntityWorld::removeFromArchetype(const EntityRecord& record)
+{
+	Entity moved = record.pArchetype->removeRow(record.chunk, record.row);
+	if (moved != INVALID_ENTITY)
+	{
+		m_Records[moved.index].chunk = record.chunk;
+		m_Records[moved.index].row = record.row;
+	}
+}
+
+void EntityWorld::moveEntity(Entity entity, Archetype* pTarget)
+{
+	EntityRecord source = m_Records[entity.index];
+	ArchetypeChunk& sourceChunk = source.pArchetype->getChunk(source.chunk);
+	placeEntity(entity, pTarget);
+	const EntityRecord& target = m_Records[entity.index];
+	ArchetypeChunk& targetChunk = pTarget->getChunk(target.chunk);
+	for (ComponentType type : pTarget->getTypes())
+	{
+		if (source.pArchetype->getMask().test(type))
+		{
+			size_t size = s_ComponentInfo[type].size;
+			memcpy((uint8_t*)pTarget->getComponents(targetChunk, type) + target.row * size,
+				(uint8_t*)source.pArchetype->getComponents(sourceChunk, type) + source.row * size, size);
+		}
+	}
+	removeFromArchetype(source);
+}
+
+void* EntityWorld::getComponent(Entity entity, ComponentType type) const
+{
+	if (!isAlive(entity))
+	{
+		return nullptr;
+	}
+	const EntityRecord& record = m_Records[entity.index];
+	if (!record.pArchetype->getMask().test(type))
+	{
+		return nullptr;
+	}
+	ArchetypeChunk& chunk = record.pArchetype->getChunk(record.chunk);
+	return (uint8_t*)record.pArchetype->getComponents(chunk, type) + record.row * s_ComponentInfo[type].size;
+}
+
+void EntityWorld::getMatchingArchetypes(const ComponentMask& mask, std::vector<Archetype*>& archetypes) const
+{
+	for (Archetype* pArchetype : m_Archetypes)
+	{
+		if ((pArchetype->getMask() & mask) == mask)
+		{
+			archetypes.push_back(pArchetype);
+		}
+	}
+}
+
+void EntityWorld::runParallel(size_t count, const std::function<void(size_t, size_t)>& function)
+{
+	getJobSystem().parallelFor(count, function, 0, MIN_CHUNKS_PER_JOB);
+}
+
+void EntityWorld::printStats() const
+{
+	printf("Entities: %zu alive, %zu archetypes\n", m_EntityCount, m_Archetypes.size());
+	for (Archetype* pArchetype : m_Archetypes)
+	{
+		printf("  %zu entities in %zu chunks of %u:", pArchetype->getEntityCount(), pArchetype->getChunkCount(), pArchetype->getChunkCapacity());
+		for (ComponentType type : pArchetype->getTypes())
+		{
+			printf(" %s", s_ComponentInfo[type].pName);
+		}
+		printf("\n");
+	}
+}
+
+bool SystemAccess::conflictsWith(const SystemAccess& other) const
+{
+	return (writes & (other.reads | other.writes)).any() || (other.writes & reads).any();
+}
+
+SystemScheduler::SystemScheduler()
+{
+	m_BatchesDirty = false;
+}
+
+void SystemScheduler::add(const std::string& name, const SystemAccess& access, SystemFunction function)
+{
+	System system;
+	system.name = name;
+	system.access = access;
+	system.function = function;
+	system.lastTime = 0.0;
+	m_Systems.push_back(system);
+	m_BatchesDirty = true;
+}
+
+void SystemScheduler::buildBatches()
+{
+	//Each system goes in the batch after the last one holding a system it conflicts with
+	m_Batches.clear();
+	std::vector<size_t> systemBatch(m_Systems.size());
+	for (size_t i = 0; i < m_Systems.size(); i++)
+	{
+		size_t batch = 0;
+		for (size_t j = 0; j < i; j++)
+		{
+			if (m_Systems[i].access.conflictsWith(m_Systems[j].access))
+			{
+				batch = std::max(batch, systemBatch[j] + 1);
+			}
+		}
+		systemBatch[i] = batch;
+		if (batch >= m_Batches.size())
+		{
+			m_Batches.resize(batch + 1);
+		}
+		m_Batches[batch].push_back(i);
+	}
+	m_BatchesDirty = false;
+}
+
+size_t SystemScheduler::getBatchCount()
+{
+	if (m_BatchesDirty)
+	{
+		buildBatches();
+	}
+	return m_Batches.size();
+}
+
+void SystemScheduler::run(EntityWorld& world)
+{
+	if (m_BatchesDirty)
+	{
+		buildBatches();
+	}
+
+	for (const std::vector<size_t>& batch : m_Batches)
+	{
+		auto runSystem = [this, &world](size_t index)
+		{
+			uint64_t start = SDL_GetPerformanceCounter();
+			m_Systems[index].function(world);
+			m_Systems[index].lastTime = millisecondsSince(start);
+		};
+
+		//The calling thread runs the first system of the batch and then helps with the rest
+		JobCounter counter;
+		for (size_t i = 1; i < batch.size(); i++)
+		{
+			size_t index = batch[i];
+			getJobSystem().schedule([&runSystem, index]()
+			{
+				runSystem(index);
+			}, &counter);
+		}
+		runSystem(batch[0]);
+		getJobSystem().wait(counter);
+	}
+}
+
+void SystemScheduler::printSchedule()
+{
+	if (m_BatchesDirty)
+	{
+		buildBatches();
+	}
+	for (size_t batch = 0; batch < m_Batches.size(); batch++)
+	{
+		printf("Systems batch %zu:", batch);
+		for (size_t index : m_Batches[batch])
+		{
+			printf(" %s (%.3fms)", m_Systems[index].name.c_str(), m_Systems[index].lastTime);
+		}
+		printf("\n");
+	}
+}
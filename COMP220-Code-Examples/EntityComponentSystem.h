@@ -0,0 +1,358 @@
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+//Index into the world's entity table plus the generation it was created in. The generation goes up each time an
+//index is reused, so a handle to a destroyed entity is recognised rather than reaching whatever replaced it
+struct Entity
+{
+	uint32_t index;
+	uint32_t generation;
+
+	bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; };
+	bool operator!=(const Entity& other) const { return !(*this == other); };
+};
+const Entity INVALID_ENTITY = { 0xFFFFFFFF, 0 };
+
+const unsigned int MAX_COMPONENT_TYPES = 64;
+typedef unsigned int ComponentType;
+typedef std::bitset<MAX_COMPONENT_TYPES> ComponentMask;
+
+struct ComponentInfo
+{
+	size_t size;
+	size_t alignment;
+	const char* pName;
+};
+
+//Component types are numbered the first time each is used, from any thread. Registering more than
+//MAX_COMPONENT_TYPES aborts
+ComponentType registerComponentType(size_t size, size_t alignment, const char* pName);
+const ComponentInfo& getComponentInfo(ComponentType type);
+
+template<class T>
+ComponentType getComponentType()
+{
+	//const T is the same component as T, it must not register a type of its own
+	if constexpr (std::is_const<T>::value)
+	{
+		return getComponentType<typename std::remove_const<T>::type>();
+	}
+	else
+	{
+		//Entities move between chunks with memcpy when components are added or removed
+		static_assert(std::is_trivially_copyable<T>::value, "Components must be trivially copyable");
+		static const ComponentType type = registerComponentType(sizeof(T), alignof(T), typeid(T).name());
+		return type;
+	}
+}
+
+template<class... Ts>
+ComponentMask makeComponentMask()
+{
+	ComponentMask mask;
+	(mask.set(getComponentType<Ts>()), ...);
+	return mask;
+}
+
+//A fixed size block holding some of an archetype's entities, their handles first and then one array per component
+struct ArchetypeChunk
+{
+	uint8_t* pData;
+	uint32_t count;
+};
+
+//Every entity with exactly the same set of components. Their components live in chunks, each type in its own
+//contiguous array, and rows are kept packed by moving the last row into any hole, so only the last chunk is partly
+//full and iterating touches nothing but the wanted arrays
+class Archetype
+{
+public:
+	static const size_t CHUNK_SIZE = 16 * 1024;
+	//Component arrays start on this boundary so they can be loaded with aligned SIMD
+	static const size_t COLUMN_ALIGNMENT = 16;
+
+	Archetype(const ComponentMask& mask);
+	~Archetype();
+
+	const ComponentMask& getMask() const { return m_Mask; };
+	const std::vector<ComponentType>& getTypes() const { return m_Types; };
+	uint32_t getChunkCapacity() const { return m_Capacity; };
+	size_t getChunkCount() const { return m_Chunks.size(); };
+	ArchetypeChunk& getChunk(size_t index) { return m_Chunks[index]; };
+	size_t getEntityCount() const { return m_EntityCount; };
+
+	Entity* getEntities(const ArchetypeChunk& chunk) const { return (Entity*)chunk.pData; };
+	void* getComponents(const ArchetypeChunk& chunk, ComponentType type) const { return chunk.pData + m_ColumnOffset[type]; };
+	template<class T>
+	T* getComponents(const ArchetypeChunk& chunk) const
+	{
+		return (T*)getComponents(chunk, getComponentType<T>());
+	};
+
+	//Appends a row for entity, its components are left uninitialised
+	void addRow(Entity entity, uint32_t& chunkIndex, uint32_t& row);
+	//Fills the hole with the last row and returns the entity that moved there, INVALID_ENTITY if none did
+	Entity removeRow(uint32_t chunkIndex, uint32_t row);
+
+	//Archetypes reached by adding or removing one component, filled in by EntityWorld as they are first needed
+	Archetype* getAddEdge(ComponentType type) const { return m_AddEdges[type]; };
+	Archetype* getRemoveEdge(ComponentType type) const { return m_RemoveEdges[type]; };
+	void setAddEdge(ComponentType type, Archetype* pArchetype) { m_AddEdges[type] = pArchetype; };
+	void setRemoveEdge(ComponentType type, Archetype* pArchetype) { m_RemoveEdges[type] = pArchetype; };
+private:
+	ComponentMask m_Mask;
+	std::vector<ComponentType> m_Types;
+	uint32_t m_ColumnOffset[MAX_COMPONENT_TYPES];
+	uint32_t m_Capacity;
+	size_t m_ChunkBytes;
+	//Largest column alignment, chunks are allocated to it so over-aligned components start on their boundary
+	size_t m_ChunkAlignment;
+	std::vector<ArchetypeChunk> m_Chunks;
+	size_t m_EntityCount;
+
+	Archetype* m_AddEdges[MAX_COMPONENT_TYPES];
+	Archetype* m_RemoveEdges[MAX_COMPONENT_TYPES];
+};
+
+//Owns all entities and their components, stored by archetype. Adding or removing a component moves the entity's
+//row to another archetype, so pointers from get() and the arrays handed to forEach are only valid until the next
+//create, destroy, add or remove
+class EntityWorld
+{
+public:
+	//forEachChunkParallel never hands out fewer chunks than this to one job
+	static const size_t MIN_CHUNKS_PER_JOB = 4;
+
+	EntityWorld();
+	~EntityWorld();
+
+	Entity create();
+	template<class... Ts>
+	Entity create(const Ts&... components);
+	void destroy(Entity entity);
+	bool isAlive(Entity entity) const;
+	void clear();
+
+	//Overwrites the component if the entity already has one
+	template<class T>
+	void add(Entity entity, const T& component);
+	template<class T>
+	void remove(Entity entity);
+	template<class T>
+	bool has(Entity entity) const;
+	//nullptr if the entity is dead or does not have the component
+	template<class T>
+	T* get(Entity entity);
+
+	//Calls function(count, pEntities, pTs...) for each chunk of every archetype with all of Ts. Components listed
+	//as const are passed as const arrays, which is how systems say they only read them
+	template<class... Ts, class Function>
+	void forEachChunk(Function function);
+	//Same, with the chunks shared out as jobs. function must only change the components it is given
+	template<class... Ts, class Function>
+	void forEachChunkParallel(Function function);
+	//Calls function(entity, Ts&...) for every entity with all of Ts
+	template<class... Ts, class Function>
+	void forEach(Function function);
+
+	size_t getEntityCount() const { return m_EntityCount; };
+	size_t getArchetypeCount() const { return m_Archetypes.size(); };
+	void printStats() const;
+private:
+	struct EntityRecord
+	{
+		Archetype* pArchetype;
+		uint32_t chunk;
+		uint32_t row;
+		uint32_t generation;
+	};
+
+	Entity allocateEntity();
+	Archetype* getArchetype(const ComponentMask& mask);
+	Archetype* getArchetypeWith(Archetype* pArchetype, ComponentType type);
+	Archetype* getArchetypeWithout(Archetype* pArchetype, ComponentType type);
+	//Adds a row to pArchetype for an entity which has none yet
+	void placeEntity(Entity entity, Archetype* pArchetype);
+	//Moves the entity's row to pTarget, copying the components both archetypes have
+	void moveEntity(Entity entity, Archetype* pTarget);
+	void removeFromArchetype(const EntityRecord& record);
+	void* getComponent(Entity entity, ComponentType type) const;
+	//Every archetype with at least the components in mask
+	void getMatchingArchetypes(const ComponentMask& mask, std::vector<Archetype*>& archetypes) const;
+	//Runs function over [0, count) split into ranges on the job system, kept out of line so this header does not
+	//need JobSystem.h
+	void runParallel(size_t count, const std::function<void(size_t, size_t)>& function);
+
+	std::vector<EntityRecord> m_Records;
+	std::vector<uint32_t> m_FreeIndices;
+	std::vector<Archetype*> m_Archetypes;
+	std::unordered_map<ComponentMask, Archetype*> m_ArchetypesByMask;
+	size_t m_EntityCount;
+};
+
+template<class... Ts>
+Entity EntityWorld::create(const Ts&... components)
+{
+	Entity entity = allocateEntity();
+	Archetype* pArchetype = getArchetype(makeComponentMask<Ts...>());
+	placeEntity(entity, pArchetype);
+	const EntityRecord& record = m_Records[entity.index];
+	ArchetypeChunk& chunk = pArchetype->getChunk(record.chunk);
+	((pArchetype->template getComponents<Ts>(chunk)[record.row] = components), ...);
+	return entity;
+}
+
+template<class T>
+void EntityWorld::add(Entity entity, const T& component)
+{
+	if (!isAlive(entity))
+	{
+		return;
+	}
+	ComponentType type = getComponentType<T>();
+	Archetype* pArchetype = m_Records[entity.index].pArchetype;
+	if (!pArchetype->getMask().test(type))
+	{
+		moveEntity(entity, getArchetypeWith(pArchetype, type));
+	}
+	*(T*)getComponent(entity, type) = component;
+}
+
+template<class T>
+void EntityWorld::remove(Entity entity)
+{
+	if (!isAlive(entity))
+	{
+		return;
+	}
+	ComponentType type = getComponentType<T>();
+	Archetype* pArchetype = m_Records[entity.index].pArchetype;
+	if (pArchetype->getMask().test(type))
+	{
+		moveEntity(entity, getArchetypeWithout(pArchetype, type));
+	}
+}
+
+template<class T>
+bool EntityWorld::has(Entity entity) const
+{
+	return isAlive(entity) && m_Records[entity.index].pArchetype->getMask().test(getComponentType<T>());
+}
+
+template<class T>
+T* EntityWorld::get(Entity entity)
+{
+	return (T*)getComponent(entity, getComponentType<T>());
+}
+
+template<class... Ts, class Function>
+void EntityWorld::forEachChunk(Function function)
+{
+	ComponentMask mask = makeComponentMask<Ts...>();
+	for (Archetype* pArchetype : m_Archetypes)
+	{
+		if ((pArchetype->getMask() & mask) != mask)
+		{
+			continue;
+		}
+		for (size_t i = 0; i < pArchetype->getChunkCount(); i++)
+		{
+			ArchetypeChunk& chunk = pArchetype->getChunk(i);
+			function((size_t)chunk.count, (const Entity*)pArchetype->getEntities(chunk), pArchetype->template getComponents<Ts>(chunk)...);
+		}
+	}
+}
+
+template<class... Ts, class Function>
+void EntityWorld::forEachChunkParallel(Function function)
+{
+	std::vector<Archetype*> archetypes;
+	getMatchingArchetypes(makeComponentMask<Ts...>(), archetypes);
+	std::vector<std::pair<Archetype*, size_t>> chunks;
+	for (Archetype* pArchetype : archetypes)
+	{
+		for (size_t i = 0; i < pArchetype->getChunkCount(); i++)
+		{
+			chunks.push_back(std::make_pair(pArchetype, i));
+		}
+	}
+
+	runParallel(chunks.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			Archetype* pArchetype = chunks[i].first;
+			ArchetypeChunk& chunk = pArchetype->getChunk(chunks[i].second);
+			function((size_t)chunk.count, (const Entity*)pArchetype->getEntities(chunk), pArchetype->template getComponents<Ts>(chunk)...);
+		}
+	});
+}
+
+template<class... Ts, class Function>
+void EntityWorld::forEach(Function function)
+{
+	forEachChunk<Ts...>([&](size_t count, const Entity* pEntities, Ts*... pComponents)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			function(pEntities[i], pComponents[i]...);
+		}
+	});
+}
+
+//The components a system reads and the ones it writes
+struct SystemAccess
+{
+	ComponentMask reads;
+	ComponentMask writes;
+
+	template<class... Ts>
+	SystemAccess& read() { reads |= makeComponentMask<Ts...>(); return *this; };
+	template<class... Ts>
+	SystemAccess& write() { writes |= makeComponentMask<Ts...>(); return *this; };
+	//Two systems conflict if either writes something the other reads or writes
+	bool conflictsWith(const SystemAccess& other) const;
+};
+
+//Runs systems in the order they were added, grouped into batches of systems whose declared access does not conflict.
+//The systems of a batch run at the same time as jobs, a system is never placed before one it conflicts
+//with that was added earlier. Systems may change the components they declare but must not create, destroy, add or
+//remove, since other systems of the batch are iterating the same chunks
+class SystemScheduler
+{
+public:
+	typedef std::function<void(EntityWorld&)> SystemFunction;
+
+	SystemScheduler();
+
+	void add(const std::string& name, const SystemAccess& access, SystemFunction function);
+	void run(EntityWorld& world);
+
+	size_t getSystemCount() const { return m_Systems.size(); };
+	size_t getBatchCount();
+	//Batches with the systems in each and how long each took in the last run
+	void printSchedule();
+private:
+	struct System
+	{
+		std::string name;
+		SystemAccess access;
+		SystemFunction function;
+		double lastTime;
+	};
+
+	void buildBatches();
+
+	std::vector<System> m_Systems;
+	std::vector<std::vector<size_t>> m_Batches;
+	bool m_BatchesDirty;
+};
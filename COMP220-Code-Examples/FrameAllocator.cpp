@@ -0,0 +1,317 @@
+#include "FrameAllocator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+//Main blocks start on a cache line
+static const size_t BLOCK_ALIGNMENT = 64;
+
+static std::atomic<uint64_t> s_NextInstanceID(1);
+
+//The calling thread's arenas for the allocator it used last, saves taking the mutex on every allocation
+struct ThreadArenaCache
+{
+	uint64_t instanceID;
+	void* pArenas;
+};
+static thread_local ThreadArenaCache s_ThreadArenaCache = { 0, nullptr };
+
+static uintptr_t alignUp(uintptr_t value, size_t alignment)
+{
+	return (value + alignment - 1) & ~(uintptr_t)(alignment - 1);
+}
+
+LinearArena::LinearArena()
+{
+	m_pBlock = nullptr;
+	m_Capacity = 0;
+	m_Offset = 0;
+	m_OverflowUsed = 0;
+	m_HighWaterMark = 0;
+	m_TotalOverflow = 0;
+}
+
+LinearArena::LinearArena(LinearArena&& other) noexcept
+{
+	m_pBlock = other.m_pBlock;
+	m_Capacity = other.m_Capacity;
+	m_Offset = other.m_Offset;
+	m_OverflowBlocks.swap(other.m_OverflowBlocks);
+	m_OverflowUsed = other.m_OverflowUsed;
+	m_HighWaterMark = other.m_HighWaterMark;
+	m_TotalOverflow = other.m_TotalOverflow;
+	other.m_pBlock = nullptr;
+	other.m_Capacity = 0;
+	other.m_Offset = 0;
+	other.m_OverflowUsed = 0;
+}
+
+LinearArena::~LinearArena()
+{
+	destroy();
+}
+
+void LinearArena::init(size_t capacity)
+{
+	destroy();
+	m_Capacity = capacity;
+	m_pBlock = (uint8_t*)::operator new(capacity, std::align_val_t(BLOCK_ALIGNMENT));
+	m_Offset = 0;
+	m_HighWaterMark = 0;
+	m_TotalOverflow = 0;
+}
+
+void LinearArena::destroy()
+{
+	for (uint8_t* pBlock : m_OverflowBlocks)
+	{
+		delete[] pBlock;
+	}
+	m_OverflowBlocks.clear();
+	m_OverflowUsed = 0;
+	if (m_pBlock != nullptr)
+	{
+		::operator delete(m_pBlock, std::align_val_t(BLOCK_ALIGNMENT));
+		m_pBlock = nullptr;
+	}
+	m_Capacity = 0;
+	m_Offset = 0;
+}
+
+void* LinearArena::allocate(size_t size, size_t alignment)
+{
+	uintptr_t base = (uintptr_t)m_pBlock;
+	uintptr_t start = alignUp(base + m_Offset, alignment);
+	if (m_pBlock != nullptr && start + size <= base + m_Capacity)
+	{
+		m_Offset = (size_t)(start + size - base);
+		m_HighWaterMark = std::max(m_HighWaterMark, getUsed());
+		return (void*)start;
+	}
+
+	//Spill into a block of its own, freed at the next reset
+	uint8_t* pBlock = new uint8_t[size + alignment];
+	m_OverflowBlocks.push_back(pBlock);
+	m_OverflowUsed += size + alignment;
+	m_TotalOverflow += size;
+	m_HighWaterMark = std::max(m_HighWaterMark, getUsed());
+	return (void*)alignUp((uintptr_t)pBlock, alignment);
+}
+
+void LinearArena::reset()
+{
+	if (!m_OverflowBlocks.empty())
+	{
+		for (uint8_t* pBlock : m_OverflowBlocks)
+		{
+			delete[] pBlock;
+		}
+		m_OverflowBlocks.clear();
+		m_OverflowUsed = 0;
+
+		//Room for the whole of the busiest frame so far, with some headroom
+		size_t highWaterMark = m_HighWaterMark;
+		size_t totalOverflow = m_TotalOverflow;
+		init(std::max(m_Capacity, highWaterMark + highWaterMark / 4));
+		m_HighWaterMark = highWaterMark;
+		m_TotalOverflow = totalOverflow;
+		return;
+	}
+
+#if FRAME_ALLOCATOR_DEBUG
+	if (m_pBlock != nullptr)
+	{
+		memset(m_pBlock, POISON_BYTE, m_Offset);
+	}
+#endif
+	m_Offset = 0;
+}
+
+FrameAllocator::FrameAllocator()
+{
+	m_FrameCount = 0;
+	m_ThreadCapacity = 0;
+	m_FrameNumber = 0;
+	m_InstanceID = 0;
+	m_UseAfterResetCount = 0;
+}
+
+FrameAllocator::~FrameAllocator()
+{
+	destroy();
+}
+
+void FrameAllocator::init(unsigned int frameCount, size_t capacity, size_t threadCapacity)
+{
+	destroy();
+	m_FrameCount = std::max(frameCount, 1u);
+	m_ThreadCapacity = threadCapacity;
+	m_Arenas.resize(m_FrameCount);
+	for (unsigned int i = 0; i < m_FrameCount; i++)
+	{
+		m_Arenas[i].init(capacity);
+	}
+	m_FrameNumber = 0;
+	m_OwnerThread = std::this_thread::get_id();
+	m_InstanceID = s_NextInstanceID++;
+	m_UseAfterResetCount = 0;
+}
+
+void FrameAllocator::destroy()
+{
+	if (m_FrameCount == 0)
+	{
+		return;
+	}
+	m_Arenas.clear();
+	{
+		std::lock_guard<std::mutex> lock(m_ThreadMutex);
+		m_ThreadArenas.clear();
+	}
+	m_FrameCount = 0;
+	m_InstanceID = 0;
+}
+
+void FrameAllocator::beginFrame()
+{
+	if (m_FrameCount == 0)
+	{
+		init();
+	}
+	uint64_t frameNumber = m_FrameNumber.load() + 1;
+	m_Arenas[frameNumber % m_FrameCount].reset();
+	//Other threads reset their own arenas for this slot the first time they allocate in the new frame
+	m_FrameNumber.store(frameNumber, std::memory_order_release);
+}
+
+void* FrameAllocator::allocate(size_t size, size_t alignment)
+{
+	if (m_FrameCount == 0)
+	{
+		init();
+	}
+	return getArena().allocate(size, alignment);
+}
+
+LinearArena& FrameAllocator::getArena()
+{
+	uint64_t frameNumber = getFrameNumber();
+	unsigned int slot = (unsigned int)(frameNumber % m_FrameCount);
+	if (std::this_thread::get_id() == m_OwnerThread)
+	{
+		return m_Arenas[slot];
+	}
+
+	ThreadArenas* pArenas = getThreadArenas();
+	if (pArenas->resetFrame[slot] != frameNumber)
+	{
+		pArenas->arenas[slot].reset();
+		pArenas->resetFrame[slot] = frameNumber;
+	}
+	return pArenas->arenas[slot];
+}
+
+FrameAllocator::ThreadArenas* FrameAllocator::getThreadArenas()
+{
+	if (s_ThreadArenaCache.instanceID == m_InstanceID)
+	{
+		return (ThreadArenas*)s_ThreadArenaCache.pArenas;
+	}
+
+	std::lock_guard<std::mutex> lock(m_ThreadMutex);
+	ThreadArenas* pArenas = nullptr;
+	for (std::unique_ptr<ThreadArenas>& threadArenas : m_ThreadArenas)
+	{
+		if (threadArenas->threadID == std::this_thread::get_id())
+		{
+			pArenas = threadArenas.get();
+		}
+	}
+	if (pArenas == nullptr)
+	{
+		m_ThreadArenas.push_back(std::unique_ptr<ThreadArenas>(new ThreadArenas()));
+		pArenas = m_ThreadArenas.back().get();
+		pArenas->threadID = std::this_thread::get_id();
+		pArenas->arenas.resize(m_FrameCount);
+		pArenas->resetFrame.resize(m_FrameCount);
+		for (unsigned int i = 0; i < m_FrameCount; i++)
+		{
+			pArenas->arenas[i].init(m_ThreadCapacity);
+			pArenas->resetFrame[i] = getFrameNumber();
+		}
+	}
+	s_ThreadArenaCache.instanceID = m_InstanceID;
+	s_ThreadArenaCache.pArenas = pArenas;
+	return pArenas;
+}
+
+bool FrameAllocator::isFrameLive(uint64_t frameNumber) const
+{
+	uint64_t current = getFrameNumber();
+	return frameNumber <= current && frameNumber + m_FrameCount > current;
+}
+
+void FrameAllocator::checkFrameLive(uint64_t frameNumber, const char* pWhat) const
+{
+	if (!isFrameLive(frameNumber))
+	{
+		m_UseAfterResetCount++;
+		printf("Frame allocator: %s used memory from frame %llu in frame %llu, after it was reset\n", pWhat,
+			(unsigned long long)frameNumber, (unsigned long long)getFrameNumber());
+	}
+}
+
+size_t FrameAllocator::getHighWaterMark() const
+{
+	size_t highWaterMark = 0;
+	for (unsigned int i = 0; i < m_FrameCount; i++)
+	{
+		highWaterMark = std::max(highWaterMark, m_Arenas[i].getHighWaterMark());
+	}
+	return highWaterMark;
+}
+
+size_t FrameAllocator::getThreadHighWaterMark() const
+{
+	std::lock_guard<std::mutex> lock(m_ThreadMutex);
+	size_t highWaterMark = 0;
+	for (unsigned int i = 0; i < m_FrameCount; i++)
+	{
+		size_t frameTotal = 0;
+		for (const std::unique_ptr<ThreadArenas>& threadArenas : m_ThreadArenas)
+		{
+			frameTotal += threadArenas->arenas[i].getHighWaterMark();
+		}
+		highWaterMark = std::max(highWaterMark, frameTotal);
+	}
+	return highWaterMark;
+}
+
+void FrameAllocator::printStats() const
+{
+	if (m_FrameCount == 0)
+	{
+		return;
+	}
+	size_t overflow = 0;
+	for (unsigned int i = 0; i < m_FrameCount; i++)
+	{
+		overflow += m_Arenas[i].getOverflowBytes();
+	}
+	size_t threadCount;
+	{
+		std::lock_guard<std::mutex> lock(m_ThreadMutex);
+		threadCount = m_ThreadArenas.size();
+	}
+	printf("Frame allocator: %u frames of %.2fMB, high-water %.2fMB, %.2fMB overflowed, %zu other threads using %.2fMB at most, %u uses after reset\n",
+		m_FrameCount, m_Arenas[0].getCapacity() / (1024.0 * 1024.0), getHighWaterMark() / (1024.0 * 1024.0), overflow / (1024.0 * 1024.0),
+		threadCount, getThreadHighWaterMark() / (1024.0 * 1024.0), m_UseAfterResetCount.load());
+}
+
+FrameAllocator& getFrameAllocator()
+{
+	static FrameAllocator frameAllocator;
+	return frameAllocator;
+}
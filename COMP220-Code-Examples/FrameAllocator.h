@@ -0,0 +1,183 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Use after reset checks and poisoning cost time on every reset, so they are only in debug builds
+#ifndef NDEBUG
+#define FRAME_ALLOCATOR_DEBUG 1
+#else
+#define FRAME_ALLOCATOR_DEBUG 0
+#endif
+
+//Bump allocator over one block, everything in it is freed at once by reset. Allocations which do not fit spill into
+//extra heap blocks rather than failing, and the next reset grows the main block to the high-water mark so the spill
+//only happens once
+class LinearArena
+{
+public:
+	//Written over released memory in debug builds, so stale reads show up as 0xDDDDDDDD or NaN
+	static const uint8_t POISON_BYTE = 0xDD;
+
+	LinearArena();
+	LinearArena(LinearArena&& other) noexcept;
+	LinearArena(const LinearArena&) = delete;
+	LinearArena& operator=(const LinearArena&) = delete;
+	~LinearArena();
+
+	void init(size_t capacity);
+	void destroy();
+
+	//alignment must be a power of two
+	void* allocate(size_t size, size_t alignment);
+	void reset();
+
+	size_t getUsed() const { return m_Offset + m_OverflowUsed; };
+	size_t getCapacity() const { return m_Capacity; };
+	size_t getHighWaterMark() const { return m_HighWaterMark; };
+	//Bytes which did not fit in the main block since init
+	size_t getOverflowBytes() const { return m_TotalOverflow; };
+private:
+	uint8_t* m_pBlock;
+	size_t m_Capacity;
+	size_t m_Offset;
+	std::vector<uint8_t*> m_OverflowBlocks;
+	size_t m_OverflowUsed;
+	size_t m_HighWaterMark;
+	size_t m_TotalOverflow;
+};
+
+//Memory for data which lives only for a frame or two, such as draw lists, culling results and command buffers, so
+//they never touch the global heap. There is one arena per frame in flight: with a frameCount of 2 memory allocated
+//in a frame stays valid through the next, long enough for a render thread one frame behind to read it, and deeper
+//render queues need one more per extra frame.
+//The thread which called init allocates from its own arenas, every other thread gets its own set on first use so
+//workers never contend. beginFrame must not run while other threads are allocating
+class FrameAllocator
+{
+public:
+	static const size_t DEFAULT_CAPACITY = 8 * 1024 * 1024;
+	static const size_t DEFAULT_THREAD_CAPACITY = 1024 * 1024;
+
+	FrameAllocator();
+	~FrameAllocator();
+
+	//frameCount of 2 for double buffering, 3 for triple and so on, capacities are per frame and grow if exceeded
+	void init(unsigned int frameCount = 2, size_t capacity = DEFAULT_CAPACITY, size_t threadCapacity = DEFAULT_THREAD_CAPACITY);
+	void destroy();
+
+	//Moves to the next frame's arena and frees whatever it held, from frameCount frames ago
+	void beginFrame();
+
+	void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+	//Uninitialised storage for count objects
+	template<class T>
+	T* allocateArray(size_t count) { return (T*)allocate(sizeof(T) * count, alignof(T)); };
+
+	uint64_t getFrameNumber() const { return m_FrameNumber.load(std::memory_order_acquire); };
+	unsigned int getFrameCount() const { return m_FrameCount; };
+	//True while memory allocated in that frame is still valid
+	bool isFrameLive(uint64_t frameNumber) const;
+	//Reports memory from frameNumber being used by what, in debug builds, and counts it
+	void checkFrameLive(uint64_t frameNumber, const char* pWhat) const;
+	unsigned int getUseAfterResetCount() const { return m_UseAfterResetCount.load(); };
+
+	//Highest use of any one frame's arenas on the init thread and summed across the other threads
+	size_t getHighWaterMark() const;
+	size_t getThreadHighWaterMark() const;
+	void printStats() const;
+private:
+	struct ThreadArenas
+	{
+		std::thread::id threadID;
+		std::vector<LinearArena> arenas;
+		std::vector<uint64_t> resetFrame;
+	};
+
+	LinearArena& getArena();
+	ThreadArenas* getThreadArenas();
+
+	std::vector<LinearArena> m_Arenas;
+	unsigned int m_FrameCount;
+	size_t m_ThreadCapacity;
+	std::atomic<uint64_t> m_FrameNumber;
+	std::thread::id m_OwnerThread;
+	//Changes on every init, so a thread's cached arenas from before a destroy are not reused
+	uint64_t m_InstanceID;
+
+	mutable std::mutex m_ThreadMutex;
+	std::vector<std::unique_ptr<ThreadArenas>> m_ThreadArenas;
+
+	mutable std::atomic<unsigned int> m_UseAfterResetCount;
+};
+
+FrameAllocator& getFrameAllocator();
+
+//Standard library allocator over a FrameAllocator, for containers built and thrown away within a frame. deallocate
+//does nothing, the memory goes back when the frame's arena is reset. In debug builds allocating or freeing through
+//a container whose frame has been reset is reported
+template<class T>
+class FrameAllocatorAdapter
+{
+public:
+	typedef T value_type;
+
+	FrameAllocatorAdapter()
+	{
+		m_pAllocator = &getFrameAllocator();
+		m_FrameNumber = m_pAllocator->getFrameNumber();
+	};
+	FrameAllocatorAdapter(FrameAllocator& allocator)
+	{
+		m_pAllocator = &allocator;
+		m_FrameNumber = allocator.getFrameNumber();
+	};
+	template<class U>
+	FrameAllocatorAdapter(const FrameAllocatorAdapter<U>& other)
+	{
+		m_pAllocator = other.getAllocator();
+		m_FrameNumber = other.getFrameNumber();
+	};
+
+	T* allocate(size_t count)
+	{
+#if FRAME_ALLOCATOR_DEBUG
+		m_pAllocator->checkFrameLive(m_FrameNumber, "FrameAllocatorAdapter::allocate");
+#endif
+		return m_pAllocator->allocateArray<T>(count);
+	};
+	void deallocate(T* pObjects, size_t count)
+	{
+#if FRAME_ALLOCATOR_DEBUG
+		m_pAllocator->checkFrameLive(m_FrameNumber, "FrameAllocatorAdapter::deallocate");
+#endif
+		(void)pObjects;
+		(void)count;
+	};
+
+	FrameAllocator* getAllocator() const { return m_pAllocator; };
+	uint64_t getFrameNumber() const { return m_FrameNumber; };
+private:
+	FrameAllocator* m_pAllocator;
+	uint64_t m_FrameNumber;
+};
+
+template<class T, class U>
+bool operator==(const FrameAllocatorAdapter<T>& a, const FrameAllocatorAdapter<U>& b)
+{
+	return a.getAllocator() == b.getAllocator();
+}
+
+template<class T, class U>
+bool operator!=(const FrameAllocatorAdapter<T>& a, const FrameAllocatorAdapter<U>& b)
+{
+	return !(a == b);
+}
+
+template<class T>
+using FrameVector = std::vector<T, FrameAllocatorAdapter<T>>;
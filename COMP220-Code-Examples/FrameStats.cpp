@@ -0,0 +1,67 @@
+#include "FrameStats.h"
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <cstdio>
+
+FrameStats::FrameStats()
+{
+	m_FrameStart = 0;
+}
+
+FrameStats::~FrameStats()
+{
+}
+
+void FrameStats::beginFrame()
+{
+	m_FrameStart = SDL_GetPerformanceCounter();
+}
+
+void FrameStats::endFrame()
+{
+	uint64_t frameEnd = SDL_GetPerformanceCounter();
+	m_FrameTimes.push_back((double)(frameEnd - m_FrameStart) * 1000.0 / (double)SDL_GetPerformanceFrequency());
+}
+
+double FrameStats::getAverage() const
+{
+	if (m_FrameTimes.empty())
+	{
+		return 0.0;
+	}
+
+	double total = 0.0;
+	for (double frameTime : m_FrameTimes)
+	{
+		total += frameTime;
+	}
+	return total / (double)m_FrameTimes.size();
+}
+
+double FrameStats::getPercentile(double percentile) const
+{
+	if (m_FrameTimes.empty())
+	{
+		return 0.0;
+	}
+
+	std::vector<double> sorted = m_FrameTimes;
+	size_t index = (size_t)(percentile / 100.0 * (double)(sorted.size() - 1) + 0.5);
+	std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+	return sorted[index];
+}
+
+void FrameStats::print(const char* name) const
+{
+	double average = getAverage();
+	printf("%s: %zu frames, avg %.3fms (%.1f fps), min %.3fms, p50 %.3fms, p95 %.3fms, p99 %.3fms, max %.3fms\n",
+		name, m_FrameTimes.size(), average, average > 0.0 ? 1000.0 / average : 0.0,
+		getPercentile(0.0), getPercentile(50.0), getPercentile(95.0), getPercentile(99.0), getPercentile(100.0));
+}
+
+void FrameStats::clear()
+{
+	m_FrameTimes.clear();
+}
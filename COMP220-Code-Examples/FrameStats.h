@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Records the time of every frame and summarises them, used by headless runs to report performance
+class FrameStats
+{
+public:
+	FrameStats();
+	~FrameStats();
+
+	void beginFrame();
+	void endFrame();
+
+	size_t getFrameCount() const { return m_FrameTimes.size(); };
+	double getAverage() const;
+	//Frame time in milliseconds at the given percentile, between 0 and 100
+	double getPercentile(double percentile) const;
+
+	void print(const char* name) const;
+	void clear();
+private:
+	uint64_t m_FrameStart;
+	std::vector<double> m_FrameTimes;
+};
@@ -0,0 +1,252 @@
+#include "FrustumCulling.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define FRUSTUM_CULLING_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+//Padding objects have a sphere so negative that every plane rejects them
+static const float PADDING_RADIUS = -1.0e30f;
+
+//Below this many objects a job costs more to hand out than the culling itself
+static const size_t MIN_OBJECTS_PER_JOB = 4096;
+
+Frustum extractFrustum(const glm::mat4& viewProjection)
+{
+	//Gribb and Hartmann, each plane is the fourth row of the matrix plus or minus one of the others
+	glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+	glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+	glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+	glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+	Frustum frustum;
+	frustum.planes[0] = row3 + row0;
+	frustum.planes[1] = row3 - row0;
+	frustum.planes[2] = row3 + row1;
+	frustum.planes[3] = row3 - row1;
+	frustum.planes[4] = row3 + row2;
+	frustum.planes[5] = row3 - row2;
+	for (glm::vec4& plane : frustum.planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+CullingBounds::CullingBounds()
+{
+	m_Count = 0;
+}
+
+void CullingBounds::clear()
+{
+	resize(0);
+}
+
+void CullingBounds::reserve(size_t count)
+{
+	size_t padded = (count + 7) & ~(size_t)7;
+	for (std::vector<float>* pArray : { &m_CentreX, &m_CentreY, &m_CentreZ, &m_ExtentX, &m_ExtentY, &m_ExtentZ, &m_Radius })
+	{
+		pArray->reserve(padded);
+	}
+}
+
+void CullingBounds::resize(size_t count)
+{
+	size_t padded = (count + 7) & ~(size_t)7;
+	for (std::vector<float>* pArray : { &m_CentreX, &m_CentreY, &m_CentreZ, &m_ExtentX, &m_ExtentY, &m_ExtentZ })
+	{
+		pArray->resize(padded, 0.0f);
+	}
+	m_Radius.resize(padded, PADDING_RADIUS);
+	//Entries between count and the padded size may be left over from a larger size
+	for (size_t i = count; i < padded; i++)
+	{
+		m_Radius[i] = PADDING_RADIUS;
+	}
+	m_Count = count;
+}
+
+void CullingBounds::add(const glm::vec3& min, const glm::vec3& max)
+{
+	resize(m_Count + 1);
+	set(m_Count - 1, min, max);
+}
+
+void CullingBounds::set(size_t index, const glm::vec3& min, const glm::vec3& max)
+{
+	glm::vec3 centre = (min + max) * 0.5f;
+	glm::vec3 extent = (max - min) * 0.5f;
+	m_CentreX[index] = centre.x;
+	m_CentreY[index] = centre.y;
+	m_CentreZ[index] = centre.z;
+	m_ExtentX[index] = extent.x;
+	m_ExtentY[index] = extent.y;
+	m_ExtentZ[index] = extent.z;
+	m_Radius[index] = glm::length(extent);
+}
+
+void transformBounds(const glm::mat4& transform, const glm::vec3& localMin, const glm::vec3& localMax, glm::vec3& worldMin, glm::vec3& worldMax)
+{
+	glm::vec3 centre = glm::vec3(transform * glm::vec4((localMin + localMax) * 0.5f, 1.0f));
+	glm::vec3 extent = (localMax - localMin) * 0.5f;
+	glm::vec3 worldExtent = glm::abs(glm::vec3(transform[0])) * extent.x + glm::abs(glm::vec3(transform[1])) * extent.y +
+		glm::abs(glm::vec3(transform[2])) * extent.z;
+	worldMin = centre - worldExtent;
+	worldMax = centre + worldExtent;
+}
+
+bool isAVX2Supported()
+{
+#if FRUSTUM_CULLING_X86
+	static const bool supported = []()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		//The OS must save the YMM registers (OSXSAVE and XCR0 bits 1 and 2) as well as the CPU having the instructions
+		bool osSavesYMM = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+		__cpuidex(info, 7, 0);
+		return osSavesYMM && (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}();
+	return supported;
+#else
+	return false;
+#endif
+}
+
+static void cullFrustumScalar(const Frustum& frustum, const CullingBounds& bounds, size_t begin, size_t end, uint8_t* pVisible)
+{
+	const float* pCentreX = bounds.getCentreX();
+	const float* pCentreY = bounds.getCentreY();
+	const float* pCentreZ = bounds.getCentreZ();
+	const float* pExtentX = bounds.getExtentX();
+	const float* pExtentY = bounds.getExtentY();
+	const float* pExtentZ = bounds.getExtentZ();
+	const float* pRadius = bounds.getRadius();
+
+	for (size_t i = begin; i < end; i++)
+	{
+		bool visible = true;
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			float distance = pCentreX[i] * plane.x + pCentreY[i] * plane.y + pCentreZ[i] * plane.z + plane.w;
+			float projectedExtent = pExtentX[i] * std::fabs(plane.x) + pExtentY[i] * std::fabs(plane.y) + pExtentZ[i] * std::fabs(plane.z);
+			if (distance + pRadius[i] < 0.0f || distance + projectedExtent < 0.0f)
+			{
+				visible = false;
+				break;
+			}
+		}
+		pVisible[i] = visible ? 1 : 0;
+	}
+}
+
+#if FRUSTUM_CULLING_X86
+//Compiled for AVX2 whatever the project's target, only called once isAVX2Supported has said it is safe
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("avx2")))
+#endif
+static void cullFrustumAVX2(const Frustum& frustum, const CullingBounds& bounds, size_t begin, size_t end, uint8_t* pVisible)
+{
+	const float* pCentreX = bounds.getCentreX();
+	const float* pCentreY = bounds.getCentreY();
+	const float* pCentreZ = bounds.getCentreZ();
+	const float* pExtentX = bounds.getExtentX();
+	const float* pExtentY = bounds.getExtentY();
+	const float* pExtentZ = bounds.getExtentZ();
+	const float* pRadius = bounds.getRadius();
+
+	__m256 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+	for (int p = 0; p < 6; p++)
+	{
+		const glm::vec4& plane = frustum.planes[p];
+		planeX[p] = _mm256_set1_ps(plane.x);
+		planeY[p] = _mm256_set1_ps(plane.y);
+		planeZ[p] = _mm256_set1_ps(plane.z);
+		planeW[p] = _mm256_set1_ps(plane.w);
+		absX[p] = _mm256_set1_ps(std::fabs(plane.x));
+		absY[p] = _mm256_set1_ps(std::fabs(plane.y));
+		absZ[p] = _mm256_set1_ps(std::fabs(plane.z));
+	}
+	const __m256 zero = _mm256_setzero_ps();
+
+	//Arrays are padded to 8, so the last group can always be loaded whole
+	for (size_t i = begin; i < end; i += 8)
+	{
+		__m256 centreX = _mm256_loadu_ps(pCentreX + i);
+		__m256 centreY = _mm256_loadu_ps(pCentreY + i);
+		__m256 centreZ = _mm256_loadu_ps(pCentreZ + i);
+		__m256 extentX = _mm256_loadu_ps(pExtentX + i);
+		__m256 extentY = _mm256_loadu_ps(pExtentY + i);
+		__m256 extentZ = _mm256_loadu_ps(pExtentZ + i);
+		__m256 radius = _mm256_loadu_ps(pRadius + i);
+
+		__m256 culled = zero;
+		for (int p = 0; p < 6; p++)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(centreX, planeX[p]), _mm256_mul_ps(centreY, planeY[p])),
+				_mm256_add_ps(_mm256_mul_ps(centreZ, planeZ[p]), planeW[p]));
+			__m256 projectedExtent = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(extentX, absX[p]), _mm256_mul_ps(extentY, absY[p])),
+				_mm256_mul_ps(extentZ, absZ[p]));
+			//Outside if behind the plane by more than the smaller of the two bounds
+			__m256 reach = _mm256_min_ps(radius, projectedExtent);
+			culled = _mm256_or_ps(culled, _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero, _CMP_LT_OQ));
+		}
+
+		int culledMask = _mm256_movemask_ps(culled);
+		size_t groupEnd = std::min(end, i + 8);
+		for (size_t j = i; j < groupEnd; j++)
+		{
+			pVisible[j] = (uint8_t)(((culledMask >> (j - i)) & 1) ^ 1);
+		}
+	}
+}
+#endif
+
+void cullFrustum(const Frustum& frustum, const CullingBounds& bounds, size_t begin, size_t end, uint8_t* pVisible, CullingPath path)
+{
+#if FRUSTUM_CULLING_X86
+	if (path == CULLING_AVX2 || (path == CULLING_AUTO && isAVX2Supported()))
+	{
+		cullFrustumAVX2(frustum, bounds, begin, end, pVisible);
+		return;
+	}
+#endif
+	cullFrustumScalar(frustum, bounds, begin, end, pVisible);
+}
+
+void cullFrustumParallel(const Frustum& frustum, const CullingBounds& bounds, uint8_t* pVisible, CullingPath path)
+{
+	//Whole groups of 8 per job
+	size_t count = bounds.size();
+	size_t groups = (count + 7) / 8;
+	getJobSystem().parallelFor(groups, [&frustum, &bounds, pVisible, path, count](size_t begin, size_t end)
+	{
+		cullFrustum(frustum, bounds, begin * 8, std::min(count, end * 8), pVisible, path);
+	}, 0, MIN_OBJECTS_PER_JOB / 8);
+}
+
+void gatherVisible(const uint8_t* pVisible, size_t count, std::vector<uint32_t>& visibleIndices)
+{
+	visibleIndices.clear();
+	for (size_t i = 0; i < count; i++)
+	{
+		if (pVisible[i])
+		{
+			visibleIndices.push_back((uint32_t)i);
+		}
+	}
+}
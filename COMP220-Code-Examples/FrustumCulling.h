@@ -0,0 +1,75 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Six planes as (normal, distance) with normals pointing inwards, so a point is inside when dot(n, p) + d >= 0
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+//Planes of the clip volume of viewProjection, normalised so distances are in world units
+Frustum extractFrustum(const glm::mat4& viewProjection);
+
+//World space bounds of many objects, each both an AABB (centre and half extents) and a bounding sphere (same
+//centre), in structure of arrays form so the culling kernel loads 8 objects' x, y, z... with one instruction each.
+//Arrays are padded to a multiple of 8 with objects which are never visible
+class CullingBounds
+{
+public:
+	CullingBounds();
+
+	void clear();
+	void reserve(size_t count);
+	//Adds an object from its AABB, the sphere is the one enclosing the box
+	void add(const glm::vec3& min, const glm::vec3& max);
+	void set(size_t index, const glm::vec3& min, const glm::vec3& max);
+	void resize(size_t count);
+
+	size_t size() const { return m_Count; };
+
+	const float* getCentreX() const { return m_CentreX.data(); };
+	const float* getCentreY() const { return m_CentreY.data(); };
+	const float* getCentreZ() const { return m_CentreZ.data(); };
+	const float* getExtentX() const { return m_ExtentX.data(); };
+	const float* getExtentY() const { return m_ExtentY.data(); };
+	const float* getExtentZ() const { return m_ExtentZ.data(); };
+	const float* getRadius() const { return m_Radius.data(); };
+private:
+	std::vector<float> m_CentreX;
+	std::vector<float> m_CentreY;
+	std::vector<float> m_CentreZ;
+	std::vector<float> m_ExtentX;
+	std::vector<float> m_ExtentY;
+	std::vector<float> m_ExtentZ;
+	std::vector<float> m_Radius;
+	size_t m_Count;
+};
+
+//Which kernel to run, CULLING_AVX2 must only be forced once isAVX2Supported has returned true
+enum CullingPath
+{
+	CULLING_AUTO,
+	CULLING_SCALAR,
+	CULLING_AVX2
+};
+
+//True if the CPU and OS support AVX2, checked once
+bool isAVX2Supported();
+
+//Writes 1 to pVisible[i] for each object in [begin, end) which intersects the frustum and 0 for those outside.
+//An object is culled if either its sphere or its box is wholly behind one plane. begin must be a multiple of 8
+void cullFrustum(const Frustum& frustum, const CullingBounds& bounds, size_t begin, size_t end, uint8_t* pVisible, CullingPath path = CULLING_AUTO);
+
+//As above over every object, split into jobs once there are enough objects to pay for them
+void cullFrustumParallel(const Frustum& frustum, const CullingBounds& bounds, uint8_t* pVisible, CullingPath path = CULLING_AUTO);
+
+//Indices of the visible objects, in order
+void gatherVisible(const uint8_t* pVisible, size_t count, std::vector<uint32_t>& visibleIndices);
+
+//World AABB of a local AABB under transform, from the transformed centre and the absolute rotation-scale applied to the extents
+void transformBounds(const glm::mat4& transform, const glm::vec3& localMin, const glm::vec3& localMax, glm::vec3& worldMin, glm::vec3& worldMax);
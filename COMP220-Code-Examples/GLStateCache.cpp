@@ -0,0 +1,348 @@
+#include "GLStateCache.h"
+
+#include <cstdio>
+
+//Value no real binding can have, so the first call after invalidate() always reaches GL
+static const GLuint UNKNOWN_STATE = 0xFFFFFFFF;
+
+static const char* s_StateNames[STATE_TYPE_COUNT] =
+{
+	"program", "vertex array", "buffer", "active texture", "texture", "sampler", "blend", "depth", "framebuffer"
+};
+
+GLStateCache::GLStateCache()
+{
+	invalidate();
+	beginFrame();
+}
+
+GLStateCache::~GLStateCache()
+{
+}
+
+void GLStateCache::invalidate()
+{
+	m_Program = UNKNOWN_STATE;
+	m_VertexArray = UNKNOWN_STATE;
+	for (int i = 0; i < BUFFER_SLOTS; i++)
+	{
+		m_Buffers[i] = UNKNOWN_STATE;
+	}
+	m_ActiveTexture = UNKNOWN_STATE;
+	for (int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+	{
+		for (int i = 0; i < TEXTURE_SLOTS; i++)
+		{
+			m_Textures[unit][i] = UNKNOWN_STATE;
+		}
+		m_Samplers[unit] = UNKNOWN_STATE;
+	}
+	m_DrawFramebuffer = UNKNOWN_STATE;
+	m_ReadFramebuffer = UNKNOWN_STATE;
+	m_Blend = UNKNOWN_STATE;
+	m_BlendSource = UNKNOWN_STATE;
+	m_BlendDestination = UNKNOWN_STATE;
+	m_DepthTest = UNKNOWN_STATE;
+	m_DepthFunc = UNKNOWN_STATE;
+	m_DepthMask = UNKNOWN_STATE;
+}
+
+int GLStateCache::bufferSlot(GLenum target) const
+{
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER: return 0;
+	case GL_ELEMENT_ARRAY_BUFFER: return 1;
+	case GL_UNIFORM_BUFFER: return 2;
+	case GL_DRAW_INDIRECT_BUFFER: return 3;
+	case GL_COPY_READ_BUFFER: return 4;
+	case GL_COPY_WRITE_BUFFER: return 5;
+	case GL_PIXEL_PACK_BUFFER: return 6;
+	case GL_PIXEL_UNPACK_BUFFER: return 7;
+	default: return -1;
+	}
+}
+
+int GLStateCache::textureSlot(GLenum target) const
+{
+	switch (target)
+	{
+	case GL_TEXTURE_2D: return 0;
+	case GL_TEXTURE_2D_MULTISAMPLE: return 1;
+	case GL_TEXTURE_CUBE_MAP: return 2;
+	case GL_TEXTURE_2D_ARRAY: return 3;
+	case GL_TEXTURE_3D: return 4;
+	case GL_TEXTURE_BUFFER: return 5;
+	default: return -1;
+	}
+}
+
+void GLStateCache::useProgram(GLuint programID)
+{
+	if (update(m_Program, programID, STATE_PROGRAM))
+	{
+		glUseProgram(programID);
+	}
+}
+
+void GLStateCache::bindVertexArray(GLuint vertexArrayID)
+{
+	if (update(m_VertexArray, vertexArrayID, STATE_VERTEX_ARRAY))
+	{
+		glBindVertexArray(vertexArrayID);
+		//The element buffer binding belongs to the vertex array
+		m_Buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN_STATE;
+	}
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint bufferID)
+{
+	int slot = bufferSlot(target);
+	if (slot < 0)
+	{
+		m_Issued[STATE_BUFFER]++;
+		glBindBuffer(target, bufferID);
+		return;
+	}
+	if (update(m_Buffers[slot], bufferID, STATE_BUFFER))
+	{
+		glBindBuffer(target, bufferID);
+	}
+}
+
+void GLStateCache::setActiveTexture(GLuint unit)
+{
+	if (update(m_ActiveTexture, unit, STATE_ACTIVE_TEXTURE))
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+}
+
+void GLStateCache::bindTexture(GLenum target, GLuint textureID)
+{
+	if (m_ActiveTexture == UNKNOWN_STATE)
+	{
+		setActiveTexture(0);
+	}
+	bindTexture(m_ActiveTexture, target, textureID);
+}
+
+void GLStateCache::bindTexture(GLuint unit, GLenum target, GLuint textureID)
+{
+	int slot = textureSlot(target);
+	if (unit >= MAX_TEXTURE_UNITS || slot < 0)
+	{
+		setActiveTexture(unit);
+		m_Issued[STATE_TEXTURE]++;
+		glBindTexture(target, textureID);
+		return;
+	}
+
+	//Only switch the active unit if the bind is actually going to happen
+	if (m_Textures[unit][slot] == textureID)
+	{
+		m_Elided[STATE_TEXTURE]++;
+		return;
+	}
+	setActiveTexture(unit);
+	update(m_Textures[unit][slot], textureID, STATE_TEXTURE);
+	glBindTexture(target, textureID);
+}
+
+void GLStateCache::bindSampler(GLuint unit, GLuint samplerID)
+{
+	if (unit >= MAX_TEXTURE_UNITS)
+	{
+		m_Issued[STATE_SAMPLER]++;
+		glBindSampler(unit, samplerID);
+		return;
+	}
+	if (update(m_Samplers[unit], samplerID, STATE_SAMPLER))
+	{
+		glBindSampler(unit, samplerID);
+	}
+}
+
+void GLStateCache::bindFramebuffer(GLenum target, GLuint framebufferID)
+{
+	if (target == GL_FRAMEBUFFER)
+	{
+		if (m_DrawFramebuffer == framebufferID && m_ReadFramebuffer == framebufferID)
+		{
+			m_Elided[STATE_FRAMEBUFFER]++;
+			return;
+		}
+		m_DrawFramebuffer = framebufferID;
+		m_ReadFramebuffer = framebufferID;
+		m_Issued[STATE_FRAMEBUFFER]++;
+		glBindFramebuffer(target, framebufferID);
+	}
+	else if (update(target == GL_READ_FRAMEBUFFER ? m_ReadFramebuffer : m_DrawFramebuffer, framebufferID, STATE_FRAMEBUFFER))
+	{
+		glBindFramebuffer(target, framebufferID);
+	}
+}
+
+void GLStateCache::setBlend(bool enabled)
+{
+	if (update(m_Blend, (GLuint)enabled, STATE_BLEND))
+	{
+		enabled ? glEnable(GL_BLEND) : glDisable(GL_BLEND);
+	}
+}
+
+void GLStateCache::setBlendFunc(GLenum source, GLenum destination)
+{
+	if (m_BlendSource == source && m_BlendDestination == destination)
+	{
+		m_Elided[STATE_BLEND]++;
+		return;
+	}
+	m_BlendSource = source;
+	m_BlendDestination = destination;
+	m_Issued[STATE_BLEND]++;
+	glBlendFunc(source, destination);
+}
+
+void GLStateCache::setDepthTest(bool enabled)
+{
+	if (update(m_DepthTest, (GLuint)enabled, STATE_DEPTH))
+	{
+		enabled ? glEnable(GL_DEPTH_TEST) : glDisable(GL_DEPTH_TEST);
+	}
+}
+
+void GLStateCache::setDepthFunc(GLenum func)
+{
+	if (update(m_DepthFunc, (GLuint)func, STATE_DEPTH))
+	{
+		glDepthFunc(func);
+	}
+}
+
+void GLStateCache::setDepthMask(bool enabled)
+{
+	if (update(m_DepthMask, (GLuint)enabled, STATE_DEPTH))
+	{
+		glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+	}
+}
+
+void GLStateCache::deleteProgram(GLuint programID)
+{
+	if (programID == 0)
+	{
+		return;
+	}
+	glDeleteProgram(programID);
+	//Deleting the current program is deferred by GL until it is unbound, so the binding is left as it is
+}
+
+void GLStateCache::deleteVertexArrays(GLsizei count, const GLuint* pVertexArrayIDs)
+{
+	glDeleteVertexArrays(count, pVertexArrayIDs);
+	for (GLsizei i = 0; i < count; i++)
+	{
+		if (m_VertexArray == pVertexArrayIDs[i])
+		{
+			m_VertexArray = 0;
+			m_Buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN_STATE;
+		}
+	}
+}
+
+void GLStateCache::deleteBuffers(GLsizei count, const GLuint* pBufferIDs)
+{
+	glDeleteBuffers(count, pBufferIDs);
+	for (GLsizei i = 0; i < count; i++)
+	{
+		for (int slot = 0; slot < BUFFER_SLOTS; slot++)
+		{
+			if (m_Buffers[slot] == pBufferIDs[i])
+			{
+				m_Buffers[slot] = 0;
+			}
+		}
+	}
+}
+
+void GLStateCache::deleteTextures(GLsizei count, const GLuint* pTextureIDs)
+{
+	glDeleteTextures(count, pTextureIDs);
+	for (GLsizei i = 0; i < count; i++)
+	{
+		for (int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+		{
+			for (int slot = 0; slot < TEXTURE_SLOTS; slot++)
+			{
+				if (m_Textures[unit][slot] == pTextureIDs[i])
+				{
+					m_Textures[unit][slot] = 0;
+				}
+			}
+		}
+	}
+}
+
+void GLStateCache::deleteFramebuffers(GLsizei count, const GLuint* pFramebufferIDs)
+{
+	glDeleteFramebuffers(count, pFramebufferIDs);
+	for (GLsizei i = 0; i < count; i++)
+	{
+		if (m_DrawFramebuffer == pFramebufferIDs[i])
+		{
+			m_DrawFramebuffer = 0;
+		}
+		if (m_ReadFramebuffer == pFramebufferIDs[i])
+		{
+			m_ReadFramebuffer = 0;
+		}
+	}
+}
+
+void GLStateCache::beginFrame()
+{
+	for (int i = 0; i < STATE_TYPE_COUNT; i++)
+	{
+		m_Issued[i] = 0;
+		m_Elided[i] = 0;
+	}
+}
+
+unsigned int GLStateCache::getTotalIssued() const
+{
+	unsigned int total = 0;
+	for (int i = 0; i < STATE_TYPE_COUNT; i++)
+	{
+		total += m_Issued[i];
+	}
+	return total;
+}
+
+unsigned int GLStateCache::getTotalElided() const
+{
+	unsigned int total = 0;
+	for (int i = 0; i < STATE_TYPE_COUNT; i++)
+	{
+		total += m_Elided[i];
+	}
+	return total;
+}
+
+void GLStateCache::printFrameStats() const
+{
+	printf("GL state changes: %u issued, %u elided\n", getTotalIssued(), getTotalElided());
+	for (int i = 0; i < STATE_TYPE_COUNT; i++)
+	{
+		if (m_Issued[i] != 0 || m_Elided[i] != 0)
+		{
+			printf("  %-14s %6u issued %6u elided\n", s_StateNames[i], m_Issued[i], m_Elided[i]);
+		}
+	}
+}
+
+GLStateCache& getGLState()
+{
+	static GLStateCache stateCache;
+	return stateCache;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <GL\glew.h>
+#include <SDL_opengl.h>
+
+//Categories of state tracked by the cache, used to index the statistics
+enum GLStateType
+{
+	STATE_PROGRAM,
+	STATE_VERTEX_ARRAY,
+	STATE_BUFFER,
+	STATE_ACTIVE_TEXTURE,
+	STATE_TEXTURE,
+	STATE_SAMPLER,
+	STATE_BLEND,
+	STATE_DEPTH,
+	STATE_FRAMEBUFFER,
+	STATE_TYPE_COUNT
+};
+
+//Shadows the GL binding state so redundant calls are never issued. Everything which binds or deletes objects
+//should come through here, call invalidate() after code which touches GL state directly
+class GLStateCache
+{
+public:
+	static const int MAX_TEXTURE_UNITS = 32;
+
+	GLStateCache();
+	~GLStateCache();
+
+	//Forgets everything, the next call of each kind will always be issued
+	void invalidate();
+
+	void useProgram(GLuint programID);
+	void bindVertexArray(GLuint vertexArrayID);
+	void bindBuffer(GLenum target, GLuint bufferID);
+	//Binds on the currently active unit, used when creating textures
+	void bindTexture(GLenum target, GLuint textureID);
+	void bindTexture(GLuint unit, GLenum target, GLuint textureID);
+	void bindSampler(GLuint unit, GLuint samplerID);
+	void bindFramebuffer(GLenum target, GLuint framebufferID);
+
+	void setBlend(bool enabled);
+	void setBlendFunc(GLenum source, GLenum destination);
+	void setDepthTest(bool enabled);
+	void setDepthFunc(GLenum func);
+	void setDepthMask(bool enabled);
+
+	//Delete the objects and drop any cached binding of them, as GL implicitly unbinds deleted objects
+	void deleteProgram(GLuint programID);
+	void deleteVertexArrays(GLsizei count, const GLuint* pVertexArrayIDs);
+	void deleteBuffers(GLsizei count, const GLuint* pBufferIDs);
+	void deleteTextures(GLsizei count, const GLuint* pTextureIDs);
+	void deleteFramebuffers(GLsizei count, const GLuint* pFramebufferIDs);
+
+	GLuint getProgram() const { return m_Program; };
+	GLuint getVertexArray() const { return m_VertexArray; };
+
+	//Resets the per frame counters
+	void beginFrame();
+	unsigned int getIssued(GLStateType type) const { return m_Issued[type]; };
+	unsigned int getElided(GLStateType type) const { return m_Elided[type]; };
+	unsigned int getTotalIssued() const;
+	unsigned int getTotalElided() const;
+	void printFrameStats() const;
+private:
+	//Returns true if the value changed and the GL call should be made
+	template<class T>
+	bool update(T& cached, T value, GLStateType type)
+	{
+		if (cached == value)
+		{
+			m_Elided[type]++;
+			return false;
+		}
+		cached = value;
+		m_Issued[type]++;
+		return true;
+	}
+
+	int bufferSlot(GLenum target) const;
+	int textureSlot(GLenum target) const;
+	void setActiveTexture(GLuint unit);
+
+	static const int BUFFER_SLOTS = 8;
+	static const int TEXTURE_SLOTS = 6;
+
+	GLuint m_Program;
+	GLuint m_VertexArray;
+	GLuint m_Buffers[BUFFER_SLOTS];
+	GLuint m_ActiveTexture;
+	GLuint m_Textures[MAX_TEXTURE_UNITS][TEXTURE_SLOTS];
+	GLuint m_Samplers[MAX_TEXTURE_UNITS];
+	GLuint m_DrawFramebuffer;
+	GLuint m_ReadFramebuffer;
+
+	//Capability and function state, stored as GLuint so unknown can be represented
+	GLuint m_Blend;
+	GLuint m_BlendSource;
+	GLuint m_BlendDestination;
+	GLuint m_DepthTest;
+	GLuint m_DepthFunc;
+	GLuint m_DepthMask;
+
+	unsigned int m_Issued[STATE_TYPE_COUNT];
+	unsigned int m_Elided[STATE_TYPE_COUNT];
+};
+
+//The cache for the single GL context the application uses
+GLStateCache& getGLState();
@@ -0,0 +1,578 @@
+#include "GeometryArena.h"
+#include "GLStateCache.h"
+#include "Mesh.h"
+
+#include <cstddef>
+#include <cstdio>
+
+RangeAllocator::RangeAllocator()
+{
+	m_Capacity = 0;
+	m_Used = 0;
+}
+
+void RangeAllocator::init(unsigned int capacity)
+{
+	m_FreeByOffset.clear();
+	m_FreeBySize.clear();
+	m_Capacity = capacity;
+	m_Used = 0;
+	if (capacity > 0)
+	{
+		insertFree(0, capacity);
+	}
+}
+
+void RangeAllocator::insertFree(unsigned int offset, unsigned int size)
+{
+	m_FreeByOffset[offset] = size;
+	m_FreeBySize.insert(std::make_pair(size, offset));
+}
+
+void RangeAllocator::removeFree(std::map<unsigned int, unsigned int>::iterator it)
+{
+	m_FreeBySize.erase(std::make_pair(it->second, it->first));
+	m_FreeByOffset.erase(it);
+}
+
+unsigned int RangeAllocator::allocate(unsigned int size)
+{
+	if (size == 0)
+	{
+		return INVALID_OFFSET;
+	}
+
+	//Smallest free range which fits, ties go to the lowest offset
+	auto best = m_FreeBySize.lower_bound(std::make_pair(size, 0u));
+	if (best == m_FreeBySize.end())
+	{
+		return INVALID_OFFSET;
+	}
+
+	unsigned int offset = best->second;
+	unsigned int freeSize = best->first;
+	removeFree(m_FreeByOffset.find(offset));
+	if (freeSize > size)
+	{
+		insertFree(offset + size, freeSize - size);
+	}
+	m_Used += size;
+	return offset;
+}
+
+unsigned int RangeAllocator::allocateBelow(unsigned int size, unsigned int limit)
+{
+	if (size == 0)
+	{
+		return INVALID_OFFSET;
+	}
+
+	for (auto it = m_FreeByOffset.begin(); it != m_FreeByOffset.end() && it->first < limit; ++it)
+	{
+		if (it->second >= size)
+		{
+			unsigned int offset = it->first;
+			unsigned int freeSize = it->second;
+			removeFree(it);
+			if (freeSize > size)
+			{
+				insertFree(offset + size, freeSize - size);
+			}
+			m_Used += size;
+			return offset;
+		}
+	}
+	return INVALID_OFFSET;
+}
+
+void RangeAllocator::free(unsigned int offset, unsigned int size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+	m_Used -= size;
+
+	//Merge with the free ranges either side
+	auto next = m_FreeByOffset.lower_bound(offset);
+	if (next != m_FreeByOffset.end() && next->first == offset + size)
+	{
+		size += next->second;
+		auto after = std::next(next);
+		removeFree(next);
+		next = after;
+	}
+	if (next != m_FreeByOffset.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset)
+		{
+			offset = previous->first;
+			size += previous->second;
+			removeFree(previous);
+		}
+	}
+	insertFree(offset, size);
+}
+
+void RangeAllocator::grow(unsigned int newCapacity)
+{
+	if (newCapacity <= m_Capacity)
+	{
+		return;
+	}
+	unsigned int oldCapacity = m_Capacity;
+	m_Capacity = newCapacity;
+
+	//Treat the new tail as a freed range so it coalesces, without counting it as used first
+	m_Used += newCapacity - oldCapacity;
+	free(oldCapacity, newCapacity - oldCapacity);
+}
+
+unsigned int RangeAllocator::getLargestFreeRange() const
+{
+	return m_FreeBySize.empty() ? 0 : m_FreeBySize.rbegin()->first;
+}
+
+float RangeAllocator::getFragmentation() const
+{
+	unsigned int freeSpace = m_Capacity - m_Used;
+	if (freeSpace == 0)
+	{
+		return 0.0f;
+	}
+	return 1.0f - (float)getLargestFreeRange() / (float)freeSpace;
+}
+
+GeometryArena::GeometryArena()
+{
+	m_VAO = 0;
+	m_VertexBuffer = 0;
+	m_IndexBuffer = 0;
+	m_DefaultInstanceBuffer = 0;
+	m_InstanceSource = 0;
+	m_InstanceSourceOffset = 0;
+	m_RangesChanged = false;
+	m_PublishedVersion = 0;
+	m_RecordedVersion = 0;
+	m_Frame = 0;
+	m_RetireFrames = DEFAULT_RETIRE_FRAMES;
+	m_LayoutVersion = 0;
+	m_BytesMovedLastFrame = 0;
+	m_TotalBytesMoved = 0;
+	m_TotalMoves = 0;
+}
+
+GeometryArena::~GeometryArena()
+{
+	//The context is usually gone by the time statics are destroyed, destroy() must be called before that
+}
+
+bool GeometryArena::init(unsigned int vertexCapacity, unsigned int indexCapacity)
+{
+	destroy();
+
+	//Drop errors from earlier calls so the check below only sees ours
+	while (glGetError() != GL_NO_ERROR)
+	{
+	}
+
+	GLStateCache& state = getGLState();
+
+	glGenBuffers(1, &m_VertexBuffer);
+	state.bindBuffer(GL_COPY_WRITE_BUFFER, m_VertexBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_IndexBuffer);
+	state.bindBuffer(GL_COPY_WRITE_BUFFER, m_IndexBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+
+	InstanceData identity;
+	identity.transform = glm::mat4(1.0f);
+	identity.colour = glm::vec4(1.0f);
+	identity.custom = glm::vec4(0.0f);
+	glGenBuffers(1, &m_DefaultInstanceBuffer);
+	state.bindBuffer(GL_COPY_WRITE_BUFFER, m_DefaultInstanceBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, sizeof(InstanceData), &identity, GL_STATIC_DRAW);
+
+	if (glGetError() != GL_NO_ERROR)
+	{
+		printf("Unable to create geometry arena of %u vertices and %u indices\n", vertexCapacity, indexCapacity);
+		destroy();
+		return false;
+	}
+
+	glGenVertexArrays(1, &m_VAO);
+	state.bindVertexArray(m_VAO);
+	setVertexAttributes();
+
+	//Instance attributes advance once per instance rather than once per vertex
+	for (GLuint location = Mesh::INSTANCE_ATTRIBUTE_LOCATION; location < Mesh::INSTANCE_ATTRIBUTE_LOCATION + 6; location++)
+	{
+		glEnableVertexAttribArray(location);
+		glVertexAttribDivisor(location, 1);
+	}
+	setInstanceSource(m_DefaultInstanceBuffer, 0);
+
+	m_VertexAllocator.init(vertexCapacity);
+	m_IndexAllocator.init(indexCapacity);
+	return true;
+}
+
+void GeometryArena::setVertexAttributes()
+{
+	//Position, colour and texture coordinates, matching the layout of Vertex. Expects the VAO to be bound
+	getGLState().bindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, x));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, r));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tu));
+	getGLState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer);
+}
+
+void GeometryArena::setInstanceSource(GLuint buffer, GLintptr offset)
+{
+	if (buffer == m_InstanceSource && offset == m_InstanceSourceOffset)
+	{
+		return;
+	}
+	m_InstanceSource = buffer;
+	m_InstanceSourceOffset = offset;
+
+	GLuint location = Mesh::INSTANCE_ATTRIBUTE_LOCATION;
+	getGLState().bindVertexArray(m_VAO);
+	getGLState().bindBuffer(GL_ARRAY_BUFFER, buffer);
+	for (GLuint column = 0; column < 4; column++)
+	{
+		glVertexAttribPointer(location + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, transform) + column * sizeof(glm::vec4)));
+	}
+	glVertexAttribPointer(location + 4, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, colour)));
+	glVertexAttribPointer(location + 5, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, custom)));
+}
+
+void GeometryArena::destroy()
+{
+	if (m_VAO != 0)
+	{
+		GLStateCache& state = getGLState();
+		state.deleteVertexArrays(1, &m_VAO);
+		m_VAO = 0;
+	}
+	GLuint* pBuffers[] = { &m_VertexBuffer, &m_IndexBuffer, &m_DefaultInstanceBuffer };
+	for (GLuint* pBuffer : pBuffers)
+	{
+		if (*pBuffer != 0)
+		{
+			getGLState().deleteBuffers(1, pBuffer);
+			*pBuffer = 0;
+		}
+	}
+	m_InstanceSource = 0;
+	m_InstanceSourceOffset = 0;
+
+	m_VertexAllocator.init(0);
+	m_IndexAllocator.init(0);
+	m_Ranges.clear();
+	m_FreeHandles.clear();
+	m_HandleFree.clear();
+	m_RangesChanged = true;
+	m_VertexOwners.clear();
+	m_IndexOwners.clear();
+	m_RetiredRanges.clear();
+}
+
+void GeometryArena::growBuffer(GLuint& buffer, GLsizeiptr oldSize, GLsizeiptr newSize)
+{
+	GLStateCache& state = getGLState();
+	while (glGetError() != GL_NO_ERROR)
+	{
+	}
+
+	GLuint newBuffer;
+	glGenBuffers(1, &newBuffer);
+	state.bindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+	state.bindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+
+	state.deleteBuffers(1, &buffer);
+	buffer = newBuffer;
+
+	state.bindVertexArray(m_VAO);
+	setVertexAttributes();
+}
+
+bool GeometryArena::reserveVertices(unsigned int count, unsigned int& offset)
+{
+	offset = m_VertexAllocator.allocate(count);
+	while (offset == RangeAllocator::INVALID_OFFSET)
+	{
+		unsigned int oldCapacity = m_VertexAllocator.getCapacity();
+		unsigned int newCapacity = oldCapacity * 2 > oldCapacity + count ? oldCapacity * 2 : oldCapacity + count;
+		growBuffer(m_VertexBuffer, oldCapacity * sizeof(Vertex), newCapacity * sizeof(Vertex));
+		if (glGetError() != GL_NO_ERROR)
+		{
+			printf("Unable to grow geometry arena to %u vertices\n", newCapacity);
+			return false;
+		}
+		m_VertexAllocator.grow(newCapacity);
+		offset = m_VertexAllocator.allocate(count);
+	}
+	return true;
+}
+
+bool GeometryArena::reserveIndices(unsigned int count, unsigned int& offset)
+{
+	offset = m_IndexAllocator.allocate(count);
+	while (offset == RangeAllocator::INVALID_OFFSET)
+	{
+		unsigned int oldCapacity = m_IndexAllocator.getCapacity();
+		unsigned int newCapacity = oldCapacity * 2 > oldCapacity + count ? oldCapacity * 2 : oldCapacity + count;
+		growBuffer(m_IndexBuffer, oldCapacity * sizeof(unsigned int), newCapacity * sizeof(unsigned int));
+		if (glGetError() != GL_NO_ERROR)
+		{
+			printf("Unable to grow geometry arena to %u indices\n", newCapacity);
+			return false;
+		}
+		m_IndexAllocator.grow(newCapacity);
+		offset = m_IndexAllocator.allocate(count);
+	}
+	return true;
+}
+
+GeometryHandle GeometryArena::allocate(const Vertex *pVerts, unsigned int numberOfVerts, const unsigned int *pIndices, unsigned int numberOfIndices)
+{
+	if (m_VAO == 0 && !init())
+	{
+		return INVALID_GEOMETRY;
+	}
+
+	GeometryRange range = { 0, numberOfVerts, 0, numberOfIndices };
+	if (numberOfVerts > 0 && !reserveVertices(numberOfVerts, range.firstVertex))
+	{
+		return INVALID_GEOMETRY;
+	}
+	if (numberOfIndices > 0 && !reserveIndices(numberOfIndices, range.firstIndex))
+	{
+		m_VertexAllocator.free(range.firstVertex, numberOfVerts);
+		return INVALID_GEOMETRY;
+	}
+
+	GLStateCache& state = getGLState();
+	if (numberOfVerts > 0)
+	{
+		state.bindBuffer(GL_COPY_WRITE_BUFFER, m_VertexBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, range.firstVertex * sizeof(Vertex), numberOfVerts * sizeof(Vertex), pVerts);
+	}
+	if (numberOfIndices > 0)
+	{
+		state.bindBuffer(GL_COPY_WRITE_BUFFER, m_IndexBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, range.firstIndex * sizeof(unsigned int), numberOfIndices * sizeof(unsigned int), pIndices);
+	}
+
+	GeometryHandle handle = m_FreeHandles.empty() ? (GeometryHandle)m_Ranges.size() : m_FreeHandles.back();
+	if (numberOfVerts > 0)
+	{
+		m_VertexOwners[range.firstVertex] = handle;
+	}
+	if (numberOfIndices > 0)
+	{
+		m_IndexOwners[range.firstIndex] = handle;
+	}
+	if (!m_FreeHandles.empty())
+	{
+		m_FreeHandles.pop_back();
+		m_Ranges[handle] = range;
+		m_HandleFree[handle] = 0;
+	}
+	else
+	{
+		m_Ranges.push_back(range);
+		m_HandleFree.push_back(0);
+	}
+	m_RangesChanged = true;
+	return handle;
+}
+
+void GeometryArena::free(GeometryHandle handle)
+{
+	if (handle >= m_Ranges.size())
+	{
+		return;
+	}
+	//Pushing it onto the free list twice would hand the same handle to two meshes
+	if (m_HandleFree[handle])
+	{
+		printf("Geometry arena: handle %u freed twice\n", handle);
+		return;
+	}
+
+	GeometryRange& range = m_Ranges[handle];
+	if (range.numberOfVertices > 0)
+	{
+		m_VertexOwners.erase(range.firstVertex);
+	}
+	if (range.numberOfIndices > 0)
+	{
+		m_IndexOwners.erase(range.firstIndex);
+	}
+	//Frames already recorded may still draw from the range, it goes back to the allocators once they are done
+	if (range.numberOfVertices > 0)
+	{
+		m_RetiredRanges.push_back({ false, range.firstVertex, range.numberOfVertices, m_Frame });
+	}
+	if (range.numberOfIndices > 0)
+	{
+		m_RetiredRanges.push_back({ true, range.firstIndex, range.numberOfIndices, m_Frame });
+	}
+	range.numberOfVertices = 0;
+	range.numberOfIndices = 0;
+	m_FreeHandles.push_back(handle);
+	m_HandleFree[handle] = 1;
+	m_RangesChanged = true;
+}
+
+void GeometryArena::compact(GLsizeiptr maxBytes, float threshold)
+{
+	m_Frame++;
+	m_BytesMovedLastFrame = 0;
+	freeRetiredRanges();
+	if (m_VAO == 0)
+	{
+		publishRanges();
+		return;
+	}
+
+	GLsizeiptr budget = maxBytes;
+	if (m_VertexAllocator.getFragmentation() > threshold)
+	{
+		compactBuffer(false, budget);
+	}
+	if (budget > 0 && m_IndexAllocator.getFragmentation() > threshold)
+	{
+		compactBuffer(true, budget);
+	}
+	m_BytesMovedLastFrame = maxBytes - budget;
+	m_TotalBytesMoved += m_BytesMovedLastFrame;
+	publishRanges();
+}
+
+void GeometryArena::publishRanges()
+{
+	if (!m_RangesChanged)
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(m_PublishMutex);
+	m_PublishedRanges = m_Ranges;
+	m_PublishedVersion++;
+	m_RangesChanged = false;
+}
+
+void GeometryArena::beginRecording()
+{
+	std::lock_guard<std::mutex> lock(m_PublishMutex);
+	if (m_RecordedVersion != m_PublishedVersion)
+	{
+		m_RecordedRanges = m_PublishedRanges;
+		m_RecordedVersion = m_PublishedVersion;
+	}
+}
+
+GeometryRange GeometryArena::getRecordedRange(GeometryHandle handle) const
+{
+	if (handle >= m_RecordedRanges.size())
+	{
+		GeometryRange empty = { 0, 0, 0, 0 };
+		return empty;
+	}
+	return m_RecordedRanges[handle];
+}
+
+void GeometryArena::compactBuffer(bool indices, GLsizeiptr& budget)
+{
+	RangeAllocator& allocator = indices ? m_IndexAllocator : m_VertexAllocator;
+	std::map<unsigned int, GeometryHandle>& owners = indices ? m_IndexOwners : m_VertexOwners;
+	GLuint buffer = indices ? m_IndexBuffer : m_VertexBuffer;
+	GLsizeiptr elementSize = indices ? sizeof(unsigned int) : sizeof(Vertex);
+
+	//Copying within one buffer is allowed as long as the source and destination do not overlap, which they
+	//never do as the destination was free
+	GLStateCache& state = getGLState();
+	state.bindBuffer(GL_COPY_READ_BUFFER, buffer);
+	state.bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+	std::vector<std::pair<unsigned int, unsigned int>> moved;
+	for (auto it = owners.rbegin(); it != owners.rend() && budget > 0; ++it)
+	{
+		//Everything from here down is already below the lowest hole
+		unsigned int offset = it->first;
+		if (offset < allocator.getLowestFreeOffset())
+		{
+			break;
+		}
+
+		GeometryRange& range = m_Ranges[it->second];
+		unsigned int count = indices ? range.numberOfIndices : range.numberOfVertices;
+		unsigned int newOffset = allocator.allocateBelow(count, offset);
+		if (newOffset == RangeAllocator::INVALID_OFFSET)
+		{
+			continue;
+		}
+
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset * elementSize, newOffset * elementSize, count * elementSize);
+		(indices ? range.firstIndex : range.firstVertex) = newOffset;
+		m_RetiredRanges.push_back({ indices, offset, count, m_Frame });
+		moved.push_back(std::make_pair(offset, newOffset));
+		m_RangesChanged = true;
+		budget -= count * elementSize;
+	}
+
+	//Owners is only changed once the walk is done, the reverse iterator would not survive it
+	for (const std::pair<unsigned int, unsigned int>& move : moved)
+	{
+		auto it = owners.find(move.first);
+		owners[move.second] = it->second;
+		owners.erase(it);
+	}
+	if (!moved.empty())
+	{
+		m_TotalMoves += (unsigned int)moved.size();
+		m_LayoutVersion++;
+	}
+}
+
+void GeometryArena::freeRetiredRanges()
+{
+	size_t kept = 0;
+	for (size_t i = 0; i < m_RetiredRanges.size(); i++)
+	{
+		const RetiredRange& retired = m_RetiredRanges[i];
+		if (m_Frame - retired.frame >= m_RetireFrames)
+		{
+			(retired.isIndexRange ? m_IndexAllocator : m_VertexAllocator).free(retired.offset, retired.size);
+		}
+		else
+		{
+			m_RetiredRanges[kept++] = retired;
+		}
+	}
+	m_RetiredRanges.resize(kept);
+}
+
+void GeometryArena::printStats() const
+{
+	printf("Geometry arena: %u allocations, vertices %u/%u used in %u free ranges (%.0f%% fragmented), indices %u/%u used in %u free ranges (%.0f%% fragmented)\n",
+		getAllocationCount(),
+		m_VertexAllocator.getUsed(), m_VertexAllocator.getCapacity(), m_VertexAllocator.getFreeRangeCount(), m_VertexAllocator.getFragmentation() * 100.0f,
+		m_IndexAllocator.getUsed(), m_IndexAllocator.getCapacity(), m_IndexAllocator.getFreeRangeCount(), m_IndexAllocator.getFragmentation() * 100.0f);
+	printf("Geometry arena compaction: %u moves, %.2fMB copied\n", m_TotalMoves, (double)m_TotalBytesMoved / (1024.0 * 1024.0));
+}
+
+GeometryArena& getGeometryArena()
+{
+	static GeometryArena geometryArena;
+	return geometryArena;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <GL\glew.h>
+#include <SDL_opengl.h>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "Vertex.h"
+
+//Hands out ranges of a fixed size space, counted in elements rather than bytes. Free ranges are kept both by offset,
+//so neighbours coalesce when freed, and by size, so allocation is best fit in O(log n)
+class RangeAllocator
+{
+public:
+	static const unsigned int INVALID_OFFSET = 0xFFFFFFFF;
+
+	RangeAllocator();
+
+	void init(unsigned int capacity);
+	//Returns INVALID_OFFSET when no free range is large enough
+	unsigned int allocate(unsigned int size);
+	//Lowest free range which fits and starts before limit, used to slide live ranges down when compacting
+	unsigned int allocateBelow(unsigned int size, unsigned int limit);
+	void free(unsigned int offset, unsigned int size);
+	//Extends the space, the new tail joins the last free range if they touch
+	void grow(unsigned int newCapacity);
+
+	unsigned int getCapacity() const { return m_Capacity; };
+	unsigned int getUsed() const { return m_Used; };
+	unsigned int getFreeRangeCount() const { return (unsigned int)m_FreeByOffset.size(); };
+	unsigned int getLargestFreeRange() const;
+	//0 when all free space is one range, approaching 1 as it splinters into many small ones
+	float getFragmentation() const;
+	unsigned int getLowestFreeOffset() const { return m_FreeByOffset.empty() ? m_Capacity : m_FreeByOffset.begin()->first; };
+private:
+	void insertFree(unsigned int offset, unsigned int size);
+	void removeFree(std::map<unsigned int, unsigned int>::iterator it);
+
+	std::map<unsigned int, unsigned int> m_FreeByOffset;
+	std::set<std::pair<unsigned int, unsigned int>> m_FreeBySize;
+	unsigned int m_Capacity;
+	unsigned int m_Used;
+};
+
+typedef unsigned int GeometryHandle;
+const GeometryHandle INVALID_GEOMETRY = 0xFFFFFFFF;
+
+//Where a mesh's data lives in the arena, firstVertex is the base vertex and firstIndex the first index of its draw
+struct GeometryRange
+{
+	unsigned int firstVertex;
+	unsigned int numberOfVertices;
+	unsigned int firstIndex;
+	unsigned int numberOfIndices;
+};
+
+//Every mesh's vertices and indices sub allocated from one vertex buffer and one index buffer, with a single VAO
+//describing them, so consecutive draws of different meshes need no vertex array or buffer changes and there are
+//no per mesh driver allocations. There is one arena per vertex format, which for now means just Vertex.
+//The buffers grow by copying on the GPU when full, offsets stay the same so existing meshes are unaffected.
+//Streaming meshes in and out splinters the free space, compact() undoes that a little at a time
+class GeometryArena
+{
+public:
+	static const unsigned int DEFAULT_VERTEX_CAPACITY = 256 * 1024;
+	static const unsigned int DEFAULT_INDEX_CAPACITY = 1024 * 1024;
+	static const GLsizeiptr DEFAULT_COMPACTION_BUDGET = 4 * 1024 * 1024;
+	//Frames a moved or freed mesh's old range is kept before reuse, so draws recorded ahead with the old offsets
+	//(RenderQueue commands on the render thread) still read the right data. Covers RenderThread's default latency,
+	//deeper queues raise it with setRetireFrames
+	static const unsigned int DEFAULT_RETIRE_FRAMES = 4;
+
+	GeometryArena();
+	~GeometryArena();
+
+	//Called on the first allocation if not called before
+	bool init(unsigned int vertexCapacity = DEFAULT_VERTEX_CAPACITY, unsigned int indexCapacity = DEFAULT_INDEX_CAPACITY);
+	void destroy();
+
+	//Copies the data into the arena, returns INVALID_GEOMETRY if the buffers could not be created
+	GeometryHandle allocate(const Vertex *pVerts, unsigned int numberOfVerts, const unsigned int *pIndices, unsigned int numberOfIndices);
+	//The handle can be reused at once, the space only after getRetireFrames calls to compact
+	void free(GeometryHandle handle);
+
+	//GL thread only, the ranges as they are right now
+	const GeometryRange& getRange(GeometryHandle handle) const { return m_Ranges[handle]; };
+
+	//The range table as of the last publishRanges, for recording draws on another thread while the GL thread
+	//allocates and compacts. The GL thread publishes at the end of compact, or by calling publishRanges after
+	//creating meshes outside the frame, and the recording thread picks the table up in beginRecording at the
+	//start of each frame it records. Handles published since then read as empty ranges and draw nothing
+	void publishRanges();
+	void beginRecording();
+	GeometryRange getRecordedRange(GeometryHandle handle) const;
+
+	//A range moved by compact or freed may still be drawn from by frames recorded before the change was published, which is
+	//up to every frame the render thread can queue plus the one being recorded, so use at least maxFramesAhead + 2
+	void setRetireFrames(unsigned int frames) { m_RetireFrames = frames; };
+	unsigned int getRetireFrames() const { return m_RetireFrames; };
+
+	//Call once per frame on the GL thread before anything is drawn. Moves the highest live ranges into the lowest
+	//holes with glCopyBufferSubData, up to maxBytes, and patches their ranges so every draw from here on uses the
+	//new offsets. Does nothing while fragmentation is below threshold
+	void compact(GLsizeiptr maxBytes = DEFAULT_COMPACTION_BUDGET, float threshold = 0.1f);
+	//Changes whenever compaction moves a range, anything caching offsets (indirect commands) should rebuild
+	unsigned int getLayoutVersion() const { return m_LayoutVersion; };
+	GLsizeiptr getBytesMovedLastFrame() const { return m_BytesMovedLastFrame; };
+	GLsizeiptr getTotalBytesMoved() const { return m_TotalBytesMoved; };
+	unsigned int getTotalMoves() const { return m_TotalMoves; };
+	void printStats() const;
+
+	//Points the instance attributes of the shared VAO at buffer, only touching the VAO when the source changes.
+	//Until an instanced draw sets one they read a single identity instance
+	void setInstanceSource(GLuint buffer, GLintptr offset);
+
+	GLuint getVAO() const { return m_VAO; };
+	GLuint getVertexBuffer() const { return m_VertexBuffer; };
+	GLuint getIndexBuffer() const { return m_IndexBuffer; };
+	const RangeAllocator& getVertexAllocator() const { return m_VertexAllocator; };
+	const RangeAllocator& getIndexAllocator() const { return m_IndexAllocator; };
+	unsigned int getAllocationCount() const { return (unsigned int)(m_Ranges.size() - m_FreeHandles.size()); };
+private:
+	//Replaces buffer with a larger one holding the same contents
+	void growBuffer(GLuint& buffer, GLsizeiptr oldSize, GLsizeiptr newSize);
+	bool reserveVertices(unsigned int count, unsigned int& offset);
+	bool reserveIndices(unsigned int count, unsigned int& offset);
+	void setVertexAttributes();
+
+	struct RetiredRange
+	{
+		bool isIndexRange;
+		unsigned int offset;
+		unsigned int size;
+		unsigned int frame;
+	};
+	//Moves ranges of the vertex or index buffer, taking their size off budget
+	void compactBuffer(bool indices, GLsizeiptr& budget);
+	void freeRetiredRanges();
+
+	GLuint m_VAO;
+	GLuint m_VertexBuffer;
+	GLuint m_IndexBuffer;
+	GLuint m_DefaultInstanceBuffer;
+	GLuint m_InstanceSource;
+	GLintptr m_InstanceSourceOffset;
+
+	RangeAllocator m_VertexAllocator;
+	RangeAllocator m_IndexAllocator;
+
+	std::vector<GeometryRange> m_Ranges;
+	std::vector<GeometryHandle> m_FreeHandles;
+	//Indexed by handle, set while it is on m_FreeHandles
+	std::vector<uint8_t> m_HandleFree;
+	//Set whenever m_Ranges changes, cleared by publishRanges
+	bool m_RangesChanged;
+
+	//Written by the GL thread and read by the recording thread, each under m_PublishMutex
+	std::mutex m_PublishMutex;
+	std::vector<GeometryRange> m_PublishedRanges;
+	unsigned int m_PublishedVersion;
+	//Recording thread only
+	std::vector<GeometryRange> m_RecordedRanges;
+	unsigned int m_RecordedVersion;
+
+	//Live allocations by offset, compaction walks these from the top down
+	std::map<unsigned int, GeometryHandle> m_VertexOwners;
+	std::map<unsigned int, GeometryHandle> m_IndexOwners;
+	std::vector<RetiredRange> m_RetiredRanges;
+
+	unsigned int m_Frame;
+	unsigned int m_RetireFrames;
+	unsigned int m_LayoutVersion;
+	GLsizeiptr m_BytesMovedLastFrame;
+	GLsizeiptr m_TotalBytesMoved;
+	unsigned int m_TotalMoves;
+};
+
+GeometryArena& getGeometryArena();
@@ -0,0 +1,222 @@
+#include "HeadlessContext.h"
+
+#include <cstdio>
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#endif
+
+HeadlessContext::HeadlessContext()
+{
+	m_Display = nullptr;
+	m_Context = nullptr;
+	m_Surface = nullptr;
+	m_pWindow = nullptr;
+	m_SDLContext = nullptr;
+}
+
+HeadlessContext::~HeadlessContext()
+{
+	destroy();
+}
+
+bool HeadlessContext::init(int majorVersion, int minorVersion)
+{
+	if (initEGL(majorVersion, minorVersion))
+	{
+		return true;
+	}
+	return initSDL(majorVersion, minorVersion);
+}
+
+#ifdef __linux__
+bool HeadlessContext::initEGL(int majorVersion, int minorVersion)
+{
+	EGLDisplay display = EGL_NO_DISPLAY;
+
+	//The surfaceless platform needs neither X nor a DRM device, so it works inside containers
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay != nullptr)
+	{
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+	if (display == EGL_NO_DISPLAY)
+	{
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+	{
+		printf("Unable to initialise an EGL display\n");
+		return false;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		printf("EGL does not support desktop OpenGL\n");
+		eglTerminate(display);
+		return false;
+	}
+
+	const EGLint configAttributes[] =
+	{
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint numberOfConfigs = 0;
+	EGLBoolean hasConfig = eglChooseConfig(display, configAttributes, &config, 1, &numberOfConfigs);
+	EGLConfig contextConfig = (hasConfig && numberOfConfigs > 0) ? config : (EGLConfig)nullptr;
+
+	const EGLint contextAttributes[] =
+	{
+		EGL_CONTEXT_MAJOR_VERSION, majorVersion,
+		EGL_CONTEXT_MINOR_VERSION, minorVersion,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, contextConfig, EGL_NO_CONTEXT, contextAttributes);
+	if (context == EGL_NO_CONTEXT)
+	{
+		printf("Unable to create an OpenGL %d.%d EGL context\n", majorVersion, minorVersion);
+		eglTerminate(display);
+		return false;
+	}
+
+	//Prefer no surface at all, otherwise make a tiny pbuffer just to have something current
+	EGLSurface surface = EGL_NO_SURFACE;
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		if (contextConfig != nullptr)
+		{
+			const EGLint pbufferAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+			surface = eglCreatePbufferSurface(display, contextConfig, pbufferAttributes);
+		}
+		if (surface == EGL_NO_SURFACE || !eglMakeCurrent(display, surface, surface, context))
+		{
+			printf("Unable to make the EGL context current\n");
+			eglDestroyContext(display, context);
+			eglTerminate(display);
+			return false;
+		}
+	}
+
+	m_Display = display;
+	m_Context = context;
+	m_Surface = surface;
+	return true;
+}
+#else
+bool HeadlessContext::initEGL(int majorVersion, int minorVersion)
+{
+	return false;
+}
+#endif
+
+bool HeadlessContext::initSDL(int majorVersion, int minorVersion)
+{
+	if (SDL_InitSubSystem(SDL_INIT_VIDEO) < 0)
+	{
+		printf("SDL_InitSubSystem failed: %s\n", SDL_GetError());
+		return false;
+	}
+
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, majorVersion);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, minorVersion);
+	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+
+	m_pWindow = SDL_CreateWindow("Headless", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 1, 1, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+	if (m_pWindow == nullptr)
+	{
+		printf("SDL_CreateWindow failed: %s\n", SDL_GetError());
+		SDL_QuitSubSystem(SDL_INIT_VIDEO);
+		return false;
+	}
+
+	m_SDLContext = SDL_GL_CreateContext(m_pWindow);
+	if (m_SDLContext == nullptr)
+	{
+		printf("SDL_GL_CreateContext failed: %s\n", SDL_GetError());
+		destroy();
+		return false;
+	}
+	return true;
+}
+
+bool HeadlessContext::initGLEW()
+{
+	glewExperimental = GL_TRUE;
+	GLenum glewError = glewInit();
+	//GLEW resolves the GL entry points before looking for GLX, so a missing X display is not fatal here
+	if (glewError != GLEW_OK && glewError != GLEW_ERROR_NO_GLX_DISPLAY)
+	{
+		printf("Unable to initialise GLEW: %s\n", (const char*)glewGetErrorString(glewError));
+		return false;
+	}
+
+	printf("Headless context: %s, %s\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+	return true;
+}
+
+bool HeadlessContext::makeCurrent()
+{
+#ifdef __linux__
+	if (m_Display != nullptr)
+	{
+		EGLSurface surface = (m_Surface != nullptr) ? (EGLSurface)m_Surface : EGL_NO_SURFACE;
+		return eglMakeCurrent((EGLDisplay)m_Display, surface, surface, (EGLContext)m_Context) == EGL_TRUE;
+	}
+#endif
+	return SDL_GL_MakeCurrent(m_pWindow, m_SDLContext) == 0;
+}
+
+void HeadlessContext::releaseCurrent()
+{
+#ifdef __linux__
+	if (m_Display != nullptr)
+	{
+		eglMakeCurrent((EGLDisplay)m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		return;
+	}
+#endif
+	SDL_GL_MakeCurrent(m_pWindow, nullptr);
+}
+
+void HeadlessContext::destroy()
+{
+#ifdef __linux__
+	if (m_Display != nullptr)
+	{
+		eglMakeCurrent((EGLDisplay)m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (m_Surface != nullptr)
+		{
+			eglDestroySurface((EGLDisplay)m_Display, (EGLSurface)m_Surface);
+		}
+		eglDestroyContext((EGLDisplay)m_Display, (EGLContext)m_Context);
+		eglTerminate((EGLDisplay)m_Display);
+		m_Display = nullptr;
+		m_Context = nullptr;
+		m_Surface = nullptr;
+	}
+#endif
+
+	if (m_SDLContext != nullptr)
+	{
+		SDL_GL_DeleteContext(m_SDLContext);
+		m_SDLContext = nullptr;
+	}
+	if (m_pWindow != nullptr)
+	{
+		SDL_DestroyWindow(m_pWindow);
+		m_pWindow = nullptr;
+		SDL_QuitSubSystem(SDL_INIT_VIDEO);
+	}
+}
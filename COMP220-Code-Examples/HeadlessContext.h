@@ -0,0 +1,34 @@
+#pragma once
+
+#include <GL\glew.h>
+#include <SDL.h>
+
+//A GL context with no visible window, for benchmarks and tests on machines without a display.
+//On Linux this uses EGL's surfaceless platform (Mesa's llvmpipe works without a GPU), elsewhere it falls back
+//to a hidden SDL window. Rendering has to go to a framebuffer object as there is no default framebuffer
+class HeadlessContext
+{
+public:
+	HeadlessContext();
+	~HeadlessContext();
+
+	bool init(int majorVersion, int minorVersion);
+	void destroy();
+
+	//Initialises GLEW for the context, tolerating the missing GLX display
+	bool initGLEW();
+
+	//Makes the context current on the calling thread, or releases it so another thread can take it
+	bool makeCurrent();
+	void releaseCurrent();
+private:
+	bool initEGL(int majorVersion, int minorVersion);
+	bool initSDL(int majorVersion, int minorVersion);
+
+	void* m_Display;
+	void* m_Context;
+	void* m_Surface;
+
+	SDL_Window* m_pWindow;
+	SDL_GLContext m_SDLContext;
+};
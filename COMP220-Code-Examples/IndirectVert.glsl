@@ -0,0 +1,15 @@
+#version 430 core
+#extension GL_ARB_shader_draw_parameters : require
+
+layout(location = 0) in vec3 vertexPosition;
+
+//One model matrix per draw, indexed by which command of the multi draw this is
+layout(std430, binding = 0) readonly buffer DrawData
+{
+  mat4 models[];
+};
+
+void main()
+{
+  gl_Position = models[gl_DrawIDARB] * vec4(vertexPosition,1.0f);
+}
\ No newline at end of file
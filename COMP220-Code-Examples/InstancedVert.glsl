@@ -0,0 +1,17 @@
+#version 330 core
+
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 1) in vec4 vertexColour;
+
+//Per instance attributes, see InstanceData in Mesh.h
+layout(location = 3) in mat4 instanceTransform;
+layout(location = 7) in vec4 instanceColour;
+layout(location = 8) in vec4 instanceCustom;
+
+out vec4 colour;
+
+void main()
+{
+  colour = vertexColour * instanceColour;
+  gl_Position = instanceTransform * vec4(vertexPosition,1.0f);
+}
\ No newline at end of file
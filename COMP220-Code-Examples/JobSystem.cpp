@@ -0,0 +1,348 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cstdio>
+
+//Queue index of the calling thread, -1 for threads the job system did not start and which did not call init
+static thread_local int s_ThreadIndex = -1;
+
+JobCounter::JobCounter()
+{
+	m_Count = 0;
+}
+
+JobCounter::~JobCounter()
+{
+	//A job which has just taken the count to zero may still hold the mutex, wait for it to let go
+	std::lock_guard<std::mutex> lock(m_Mutex);
+}
+
+JobSystem::JobSystem()
+{
+	m_QueuedJobs = 0;
+	m_NextExternalQueue = 0;
+	m_Running = false;
+	m_MainThreadID = std::this_thread::get_id();
+	m_JobsExecuted = 0;
+	m_Steals = 0;
+}
+
+JobSystem::~JobSystem()
+{
+	destroy();
+}
+
+void JobSystem::init(unsigned int workerCount)
+{
+	if (!m_Queues.empty())
+	{
+		return;
+	}
+	if (workerCount == 0)
+	{
+		workerCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	}
+
+	m_MainThreadID = std::this_thread::get_id();
+	s_ThreadIndex = 0;
+	for (unsigned int i = 0; i <= workerCount; i++)
+	{
+		m_Queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+	}
+	m_Running = true;
+	for (unsigned int i = 1; i <= workerCount; i++)
+	{
+		m_Workers.emplace_back(&JobSystem::workerMain, this, (int)i);
+	}
+}
+
+void JobSystem::destroy()
+{
+	if (m_Queues.empty())
+	{
+		return;
+	}
+
+	//Workers keep going until the queues are empty
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_Running = false;
+	}
+	m_WakeCondition.notify_all();
+	for (std::thread& worker : m_Workers)
+	{
+		worker.join();
+	}
+	m_Workers.clear();
+
+	//Anything still queued was scheduled from a worker after the others had gone
+	for (Job* pJob = popOrSteal(0); pJob != nullptr; pJob = popOrSteal(0))
+	{
+		execute(pJob);
+	}
+	runMainThreadJobs();
+	m_Queues.clear();
+}
+
+void JobSystem::schedule(JobFunction function, JobCounter* pCounter, JobCounter* pDependency)
+{
+	Job* pJob = new Job();
+	pJob->function = std::move(function);
+	pJob->pCounter = pCounter;
+	pJob->mainThread = false;
+	submit(pJob, pDependency);
+}
+
+void JobSystem::scheduleOnMainThread(JobFunction function, JobCounter* pCounter, JobCounter* pDependency)
+{
+	Job* pJob = new Job();
+	pJob->function = std::move(function);
+	pJob->pCounter = pCounter;
+	pJob->mainThread = true;
+	submit(pJob, pDependency);
+}
+
+void JobSystem::submit(Job* pJob, JobCounter* pDependency)
+{
+	if (m_Queues.empty())
+	{
+		init();
+	}
+	if (pJob->pCounter != nullptr)
+	{
+		pJob->pCounter->m_Count++;
+	}
+
+	if (pDependency != nullptr)
+	{
+		std::lock_guard<std::mutex> lock(pDependency->m_Mutex);
+		if (pDependency->m_Count > 0)
+		{
+			pDependency->m_Waiting.push_back(pJob);
+			return;
+		}
+	}
+	enqueue(pJob);
+}
+
+void JobSystem::enqueue(Job* pJob)
+{
+	if (pJob->mainThread)
+	{
+		std::lock_guard<std::mutex> lock(m_MainThreadQueue.mutex);
+		m_MainThreadQueue.jobs.push_back(pJob);
+		return;
+	}
+
+	//Threads outside the pool have no queue of their own, so they spread their jobs over the workers'
+	int queueIndex = s_ThreadIndex;
+	if (queueIndex < 0 || queueIndex >= (int)m_Queues.size())
+	{
+		queueIndex = 1 + (int)(m_NextExternalQueue++ % (m_Queues.size() - 1));
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_Queues[queueIndex]->mutex);
+		m_Queues[queueIndex]->jobs.push_back(pJob);
+	}
+
+	//Taking the sleep mutex means a worker is either still checking m_QueuedJobs or already waiting, never in between
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_QueuedJobs++;
+	}
+	m_WakeCondition.notify_one();
+}
+
+Job* JobSystem::popOrSteal(int threadIndex)
+{
+	size_t queueCount = m_Queues.size();
+	if (threadIndex >= 0 && threadIndex < (int)queueCount)
+	{
+		WorkQueue& queue = *m_Queues[threadIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty())
+		{
+			Job* pJob = queue.jobs.back();
+			queue.jobs.pop_back();
+			m_QueuedJobs--;
+			return pJob;
+		}
+	}
+
+	//Start with the next thread along so that thieves spread out rather than all hitting queue 0
+	size_t start = threadIndex >= 0 ? (size_t)threadIndex + 1 : 0;
+	for (size_t i = 0; i < queueCount; i++)
+	{
+		size_t victim = (start + i) % queueCount;
+		if ((int)victim == threadIndex)
+		{
+			continue;
+		}
+		WorkQueue& queue = *m_Queues[victim];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty())
+		{
+			Job* pJob = queue.jobs.front();
+			queue.jobs.pop_front();
+			m_QueuedJobs--;
+			m_Steals++;
+			return pJob;
+		}
+	}
+	return nullptr;
+}
+
+Job* JobSystem::popMainThreadJob()
+{
+	std::lock_guard<std::mutex> lock(m_MainThreadQueue.mutex);
+	if (m_MainThreadQueue.jobs.empty())
+	{
+		return nullptr;
+	}
+	Job* pJob = m_MainThreadQueue.jobs.front();
+	m_MainThreadQueue.jobs.pop_front();
+	return pJob;
+}
+
+void JobSystem::execute(Job* pJob)
+{
+	pJob->function();
+	if (pJob->pCounter != nullptr)
+	{
+		release(*pJob->pCounter);
+	}
+	delete pJob;
+	m_JobsExecuted++;
+}
+
+void JobSystem::release(JobCounter& counter)
+{
+	std::vector<Job*> ready;
+	{
+		std::lock_guard<std::mutex> lock(counter.m_Mutex);
+		if (--counter.m_Count == 0)
+		{
+			ready.swap(counter.m_Waiting);
+		}
+	}
+	for (Job* pJob : ready)
+	{
+		enqueue(pJob);
+	}
+}
+
+void JobSystem::parallelFor(size_t count, const RangeFunction& function, size_t grainSize, size_t minGrainSize)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	if (m_Queues.empty())
+	{
+		init();
+	}
+	if (grainSize == 0)
+	{
+		size_t rangeCount = getThreadCount() * RANGES_PER_THREAD;
+		grainSize = std::max(std::max<size_t>(minGrainSize, 1), (count + rangeCount - 1) / rangeCount);
+	}
+	if (grainSize >= count)
+	{
+		function(0, count);
+		return;
+	}
+
+	JobCounter counter;
+	for (size_t begin = grainSize; begin < count; begin += grainSize)
+	{
+		size_t end = std::min(count, begin + grainSize);
+		schedule([&function, begin, end]()
+		{
+			function(begin, end);
+		}, &counter);
+	}
+	function(0, grainSize);
+	wait(counter);
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+	while (!counter.isDone())
+	{
+		Job* pJob = isMainThread() ? popMainThreadJob() : nullptr;
+		if (pJob == nullptr)
+		{
+			pJob = popOrSteal(s_ThreadIndex);
+		}
+		if (pJob != nullptr)
+		{
+			execute(pJob);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+	//The job which finished last may still be inside release
+	std::lock_guard<std::mutex> lock(counter.m_Mutex);
+}
+
+void JobSystem::runMainThreadJobs()
+{
+	//Only those queued before starting, a job which queues another for the main thread leaves it for next frame
+	size_t count;
+	{
+		std::lock_guard<std::mutex> lock(m_MainThreadQueue.mutex);
+		count = m_MainThreadQueue.jobs.size();
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		Job* pJob = popMainThreadJob();
+		if (pJob == nullptr)
+		{
+			break;
+		}
+		execute(pJob);
+	}
+}
+
+void JobSystem::setMainThread()
+{
+	m_MainThreadID = std::this_thread::get_id();
+}
+
+void JobSystem::workerMain(int threadIndex)
+{
+	s_ThreadIndex = threadIndex;
+	while (true)
+	{
+		Job* pJob = popOrSteal(threadIndex);
+		if (pJob != nullptr)
+		{
+			execute(pJob);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_SleepMutex);
+		m_WakeCondition.wait(lock, [this]()
+		{
+			return m_QueuedJobs > 0 || !m_Running;
+		});
+		if (!m_Running && m_QueuedJobs <= 0)
+		{
+			break;
+		}
+	}
+}
+
+void JobSystem::printStats() const
+{
+	printf("Jobs: %u threads, %llu jobs run, %llu stolen\n", getThreadCount(), (unsigned long long)m_JobsExecuted.load(),
+		(unsigned long long)m_Steals.load());
+}
+
+JobSystem& getJobSystem()
+{
+	static JobSystem jobSystem;
+	return jobSystem;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobCounter;
+
+//A unit of work, and the counter it takes one from once it has run
+struct Job
+{
+	std::function<void()> function;
+	JobCounter* pCounter;
+	//Only ever run by the thread which owns the GL context
+	bool mainThread;
+};
+
+//Counts jobs still to finish. Scheduling a job with a counter adds one to it and the job takes one away when it
+//has run, jobs scheduled with the counter as their dependency are held back until it reaches zero.
+//A counter must not be destroyed while jobs using it are outstanding, JobSystem::wait is the usual way to be sure
+class JobCounter
+{
+public:
+	JobCounter();
+	~JobCounter();
+
+	bool isDone() const { return m_Count.load(std::memory_order_acquire) == 0; };
+	int getCount() const { return m_Count.load(std::memory_order_acquire); };
+private:
+	friend class JobSystem;
+
+	std::atomic<int> m_Count;
+	//Guards the drop to zero against jobs being added to m_Waiting at the same moment
+	std::mutex m_Mutex;
+	std::vector<Job*> m_Waiting;
+};
+
+//Pool of worker threads, one per core less the main thread, shared by everything which wants to run in parallel.
+//Each thread has its own deque of jobs: it pushes and pops at the back, so the work it just created is still in
+//cache, and when empty steals from the front of another thread's deque, taking the oldest and usually largest job.
+//Waiting on a counter runs other jobs instead of blocking, so jobs may themselves schedule and wait on more jobs.
+//GL only jobs go to a separate queue run by the thread which owns the context
+class JobSystem
+{
+public:
+	typedef std::function<void()> JobFunction;
+	typedef std::function<void(size_t, size_t)> RangeFunction;
+
+	//parallelFor aims for this many ranges per thread so that threads which finish early have something to steal
+	static const size_t RANGES_PER_THREAD = 4;
+
+	JobSystem();
+	~JobSystem();
+
+	//workerCount 0 uses one worker per core after the first, always at least one. The calling thread becomes the
+	//main thread. Called on first use if not called before
+	void init(unsigned int workerCount = 0);
+	//Finishes every queued job and stops the workers
+	void destroy();
+
+	//Runs function on any thread, after pDependency has reached zero if one is given
+	void schedule(JobFunction function, JobCounter* pCounter = nullptr, JobCounter* pDependency = nullptr);
+	//Runs function on the main thread the next time it calls runMainThreadJobs or wait, for work which needs GL
+	void scheduleOnMainThread(JobFunction function, JobCounter* pCounter = nullptr, JobCounter* pDependency = nullptr);
+	//Calls function(begin, end) for ranges covering [0, count) across every thread and returns once all are done.
+	//A grainSize of 0 picks one from the thread count, never below minGrainSize, which callers set from how cheap
+	//each item is. The calling thread runs the first range itself
+	void parallelFor(size_t count, const RangeFunction& function, size_t grainSize = 0, size_t minGrainSize = 1);
+	//Runs queued jobs until counter reaches zero, including main thread jobs when called from the main thread
+	void wait(JobCounter& counter);
+	//Runs every main thread job queued so far, call once a frame from the thread owning the GL context
+	void runMainThreadJobs();
+
+	//Moves main thread affinity to the calling thread, for when the GL context moves to a render thread
+	void setMainThread();
+	bool isMainThread() const { return std::this_thread::get_id() == m_MainThreadID.load(); };
+	//Workers plus the thread which called init
+	unsigned int getThreadCount() const { return (unsigned int)m_Workers.size() + 1; };
+	uint64_t getJobsExecuted() const { return m_JobsExecuted.load(); };
+	uint64_t getSteals() const { return m_Steals.load(); };
+	void printStats() const;
+private:
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<Job*> jobs;
+	};
+
+	void submit(Job* pJob, JobCounter* pDependency);
+	//Puts a job whose dependency is met on the right queue and wakes a worker
+	void enqueue(Job* pJob);
+	//The back of the thread's own queue, otherwise the front of someone else's
+	Job* popOrSteal(int threadIndex);
+	Job* popMainThreadJob();
+	void execute(Job* pJob);
+	void release(JobCounter& counter);
+	void workerMain(int threadIndex);
+
+	//Queue 0 belongs to the thread which called init, the rest to the workers in order
+	std::vector<std::unique_ptr<WorkQueue>> m_Queues;
+	WorkQueue m_MainThreadQueue;
+	std::vector<std::thread> m_Workers;
+
+	std::mutex m_SleepMutex;
+	std::condition_variable m_WakeCondition;
+	std::atomic<int> m_QueuedJobs;
+	std::atomic<unsigned int> m_NextExternalQueue;
+	std::atomic<bool> m_Running;
+	std::atomic<std::thread::id> m_MainThreadID;
+
+	std::atomic<uint64_t> m_JobsExecuted;
+	std::atomic<uint64_t> m_Steals;
+};
+
+JobSystem& getJobSystem();
@@ -0,0 +1,367 @@
+#include "Mesh.h"
+#include "GLStateCache.h"
+#include "OcclusionCulling.h"
+#include "StreamingBuffer.h"
+
+#include <cstring>
+
+Mesh::Mesh()
+{
+	m_Geometry = INVALID_GEOMETRY;
+	m_InstanceVBO = 0;
+	m_NumberOfVertices = 0;
+	m_NumberOfIndices = 0;
+	m_InstanceCapacity = 0;
+	m_BoundsMin = glm::vec3(0.0f);
+	m_BoundsMax = glm::vec3(0.0f);
+}
+
+Mesh::~Mesh()
+{
+	destroy();
+}
+
+void Mesh::init()
+{
+	//Vertex data goes in the arena, only instanced draws need a buffer of their own
+	glGenBuffers(1, &m_InstanceVBO);
+}
+
+void Mesh::copyBufferData(Vertex *pVerts, unsigned int numberOfVerts, unsigned int *pIndices, unsigned int numberOfIndices)
+{
+	GeometryArena& arena = getGeometryArena();
+	if (m_Geometry != INVALID_GEOMETRY)
+	{
+		arena.free(m_Geometry);
+	}
+
+	m_Geometry = arena.allocate(pVerts, numberOfVerts, pIndices, numberOfIndices);
+	if (m_Geometry == INVALID_GEOMETRY)
+	{
+		numberOfVerts = 0;
+		numberOfIndices = 0;
+	}
+	m_NumberOfVertices = numberOfVerts;
+	m_NumberOfIndices = numberOfIndices;
+
+	m_BoundsMin = glm::vec3(0.0f);
+	m_BoundsMax = glm::vec3(0.0f);
+	for (unsigned int i = 0; i < numberOfVerts; i++)
+	{
+		glm::vec3 position(pVerts[i].x, pVerts[i].y, pVerts[i].z);
+		m_BoundsMin = i == 0 ? position : glm::min(m_BoundsMin, position);
+		m_BoundsMax = i == 0 ? position : glm::max(m_BoundsMax, position);
+	}
+}
+
+unsigned int Mesh::getFirstVertex() const
+{
+	return m_Geometry != INVALID_GEOMETRY ? getGeometryArena().getRange(m_Geometry).firstVertex : 0;
+}
+
+unsigned int Mesh::getFirstIndex() const
+{
+	return m_Geometry != INVALID_GEOMETRY ? getGeometryArena().getRange(m_Geometry).firstIndex : 0;
+}
+
+void Mesh::render()
+{
+	if (m_Geometry == INVALID_GEOMETRY)
+	{
+		return;
+	}
+
+	const GeometryRange& range = getGeometryArena().getRange(m_Geometry);
+	getGLState().bindVertexArray(getGeometryArena().getVAO());
+	glDrawElementsBaseVertex(GL_TRIANGLES, range.numberOfIndices, GL_UNSIGNED_INT,
+		(void*)(range.firstIndex * sizeof(unsigned int)), range.firstVertex);
+}
+
+void Mesh::renderInstanced(const InstanceData *pInstances, unsigned int numberOfInstances)
+{
+	if (numberOfInstances == 0 || m_Geometry == INVALID_GEOMETRY)
+	{
+		return;
+	}
+
+	getGLState().bindBuffer(GL_ARRAY_BUFFER, m_InstanceVBO);
+	GLsizeiptr size = numberOfInstances * sizeof(InstanceData);
+	if (numberOfInstances > m_InstanceCapacity)
+	{
+		m_InstanceCapacity = numberOfInstances;
+		glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	}
+
+	//Invalidating lets the driver hand back fresh storage instead of waiting for draws still reading the old data
+	void* pMapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (pMapped == nullptr)
+	{
+		return;
+	}
+	memcpy(pMapped, pInstances, size);
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+
+	GeometryArena& arena = getGeometryArena();
+	const GeometryRange& range = arena.getRange(m_Geometry);
+	arena.setInstanceSource(m_InstanceVBO, 0);
+	getGLState().bindVertexArray(arena.getVAO());
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.numberOfIndices, GL_UNSIGNED_INT,
+		(void*)(range.firstIndex * sizeof(unsigned int)), numberOfInstances, range.firstVertex);
+}
+
+void Mesh::renderInstanced(StreamingBuffer& streamingBuffer, const InstanceData *pInstances, unsigned int numberOfInstances)
+{
+	if (numberOfInstances == 0 || m_Geometry == INVALID_GEOMETRY)
+	{
+		return;
+	}
+
+	//Aligning to the struct size makes the offset a whole number of instances
+	StreamAllocation allocation = streamingBuffer.allocate(numberOfInstances * sizeof(InstanceData), sizeof(InstanceData));
+	if (allocation.pData == nullptr)
+	{
+		//Region full, the orphaning path still works
+		renderInstanced(pInstances, numberOfInstances);
+		return;
+	}
+	memcpy(allocation.pData, pInstances, allocation.size);
+	//Unmaps on drivers without persistent mapping, drawing from a mapped buffer is an error
+	streamingBuffer.flush();
+
+	GeometryArena& arena = getGeometryArena();
+	const GeometryRange& range = arena.getRange(m_Geometry);
+	void* pFirstIndex = (void*)(range.firstIndex * sizeof(unsigned int));
+
+	//With base instance the VAO always points at the start of the ring and the draw selects the instances,
+	//otherwise the attribute pointers have to be moved to this allocation
+	if (GLEW_VERSION_4_2 || GLEW_ARB_base_instance)
+	{
+		arena.setInstanceSource(streamingBuffer.getBuffer(), 0);
+		getGLState().bindVertexArray(arena.getVAO());
+		glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, range.numberOfIndices, GL_UNSIGNED_INT, pFirstIndex,
+			numberOfInstances, range.firstVertex, (GLuint)(allocation.offset / sizeof(InstanceData)));
+	}
+	else
+	{
+		arena.setInstanceSource(streamingBuffer.getBuffer(), allocation.offset);
+		getGLState().bindVertexArray(arena.getVAO());
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.numberOfIndices, GL_UNSIGNED_INT, pFirstIndex,
+			numberOfInstances, range.firstVertex);
+	}
+}
+
+void Mesh::destroy()
+{
+	if (m_Geometry != INVALID_GEOMETRY)
+	{
+		getGeometryArena().free(m_Geometry);
+		m_Geometry = INVALID_GEOMETRY;
+		m_NumberOfVertices = 0;
+		m_NumberOfIndices = 0;
+	}
+	if (m_InstanceVBO != 0)
+	{
+		getGLState().deleteBuffers(1, &m_InstanceVBO);
+		m_InstanceVBO = 0;
+		m_InstanceCapacity = 0;
+	}
+}
+
+MeshCollection::MeshCollection()
+{
+	m_UseIndirect = true;
+	m_LayoutVersion = 0;
+	m_BoundsDirty = true;
+	m_VisibilityChanged = false;
+	m_CommandBuffer = 0;
+	m_IndirectStale = false;
+	m_DrawDataBuffer = 0;
+	m_DrawDataDirty = false;
+}
+
+MeshCollection::~MeshCollection()
+{
+	destroy();
+}
+
+void MeshCollection::addMesh(Mesh *pMesh)
+{
+	m_Meshes.push_back(pMesh);
+	m_ModelMatrices.push_back(glm::mat4(1.0f));
+	m_DrawDataDirty = true;
+	m_BoundsDirty = true;
+	if (!m_Visible.empty())
+	{
+		m_Visible.push_back(1);
+	}
+	if (m_CommandBuffer != 0)
+	{
+		m_IndirectStale = true;
+	}
+}
+
+void MeshCollection::setModelMatrix(size_t meshIndex, const glm::mat4& model)
+{
+	if (meshIndex < m_ModelMatrices.size())
+	{
+		m_ModelMatrices[meshIndex] = model;
+		m_DrawDataDirty = true;
+		m_BoundsDirty = true;
+	}
+}
+
+bool MeshCollection::buildIndirect()
+{
+	destroyIndirect();
+
+	bool hasMultiDrawIndirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+	bool hasStorageBuffers = GLEW_VERSION_4_3 || GLEW_ARB_shader_storage_buffer_object;
+	bool hasDrawID = GLEW_VERSION_4_6 || GLEW_ARB_shader_draw_parameters;
+	if (!hasMultiDrawIndirect || !hasStorageBuffers || !hasDrawID || m_Meshes.empty())
+	{
+		return false;
+	}
+
+	glGenBuffers(1, &m_CommandBuffer);
+	writeCommands();
+
+	glGenBuffers(1, &m_DrawDataBuffer);
+	getGLState().bindBuffer(GL_SHADER_STORAGE_BUFFER, m_DrawDataBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, m_ModelMatrices.size() * sizeof(glm::mat4), m_ModelMatrices.data(), GL_DYNAMIC_DRAW);
+	m_DrawDataDirty = false;
+	m_IndirectStale = false;
+
+	return true;
+}
+
+void MeshCollection::writeCommands()
+{
+	//Every mesh is already in the arena's buffers, a command is just its range
+	std::vector<DrawElementsIndirectCommand> commands;
+	commands.reserve(m_Meshes.size());
+	for (Mesh* pMesh : m_Meshes)
+	{
+		DrawElementsIndirectCommand command;
+		command.count = pMesh->getNumberOfIndices();
+		//Culled meshes stay in the buffer as empty draws, so gl_DrawID still indexes the right model matrix
+		command.instanceCount = isVisible(commands.size()) ? 1 : 0;
+		command.firstIndex = pMesh->getFirstIndex();
+		command.baseVertex = (GLint)pMesh->getFirstVertex();
+		command.baseInstance = 0;
+		commands.push_back(command);
+	}
+
+	getGLState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_CommandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STATIC_DRAW);
+	m_LayoutVersion = getGeometryArena().getLayoutVersion();
+	m_VisibilityChanged = false;
+}
+
+void MeshCollection::cull(const glm::mat4& viewProjection, OcclusionCuller* pOcclusionCuller)
+{
+	if (m_BoundsDirty)
+	{
+		m_WorldBounds.resize(m_Meshes.size());
+		for (size_t i = 0; i < m_Meshes.size(); i++)
+		{
+			glm::vec3 worldMin;
+			glm::vec3 worldMax;
+			transformBounds(m_ModelMatrices[i], m_Meshes[i]->getBoundsMin(), m_Meshes[i]->getBoundsMax(), worldMin, worldMax);
+			m_WorldBounds.set(i, worldMin, worldMax);
+		}
+		m_BoundsDirty = false;
+	}
+
+	m_Visible.resize(m_Meshes.size());
+	cullFrustumParallel(extractFrustum(viewProjection), m_WorldBounds, m_Visible.data());
+	if (pOcclusionCuller != nullptr)
+	{
+		pOcclusionCuller->cull(m_WorldBounds, m_Visible.data());
+	}
+	m_VisibilityChanged = true;
+}
+
+size_t MeshCollection::getVisibleCount() const
+{
+	if (m_Visible.empty())
+	{
+		return m_Meshes.size();
+	}
+	size_t visibleCount = 0;
+	for (uint8_t visible : m_Visible)
+	{
+		visibleCount += visible;
+	}
+	return visibleCount;
+}
+
+void MeshCollection::render()
+{
+	if (m_UseIndirect && m_IndirectStale)
+	{
+		buildIndirect();
+	}
+	if (m_UseIndirect && m_CommandBuffer != 0)
+	{
+		renderIndirect();
+		return;
+	}
+
+	for (size_t i = 0; i < m_Meshes.size(); i++)
+	{
+		if (isVisible(i))
+		{
+			m_Meshes[i]->render();
+		}
+	}
+}
+
+void MeshCollection::renderIndirect()
+{
+	if (m_VisibilityChanged || m_LayoutVersion != getGeometryArena().getLayoutVersion())
+	{
+		writeCommands();
+	}
+	if (m_DrawDataDirty)
+	{
+		getGLState().bindBuffer(GL_SHADER_STORAGE_BUFFER, m_DrawDataBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_ModelMatrices.size() * sizeof(glm::mat4), m_ModelMatrices.data());
+		m_DrawDataDirty = false;
+	}
+
+	GLStateCache& state = getGLState();
+	state.bindVertexArray(getGeometryArena().getVAO());
+	state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_CommandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, m_DrawDataBuffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, (GLsizei)m_Meshes.size(), 0);
+}
+
+void MeshCollection::destroyIndirect()
+{
+	if (m_CommandBuffer != 0)
+	{
+		GLStateCache& state = getGLState();
+		state.deleteBuffers(1, &m_CommandBuffer);
+		state.deleteBuffers(1, &m_DrawDataBuffer);
+		m_CommandBuffer = 0;
+		m_DrawDataBuffer = 0;
+	}
+	m_IndirectStale = false;
+}
+
+void MeshCollection::destroy()
+{
+	destroyIndirect();
+
+	//The collection owns its meshes
+	for (Mesh* pMesh : m_Meshes)
+	{
+		pMesh->destroy();
+		delete pMesh;
+	}
+	m_Meshes.clear();
+	m_ModelMatrices.clear();
+	m_WorldBounds.clear();
+	m_Visible.clear();
+	m_BoundsDirty = true;
+}
@@ -4,36 +4,129 @@
 #include <SDL_opengl.h>
 #include <vector>
 
-#include "vertex.h"
+#include <glm/glm.hpp>
 
+#include "FrustumCulling.h"
+#include "GeometryArena.h"
+#include "Vertex.h"
+
+class OcclusionCuller;
+class StreamingBuffer;
+
+//Per instance attributes for instanced draws, read by the vertex shader at INSTANCE_ATTRIBUTE_LOCATION onwards:
+//the transform takes four locations, then colour, then custom
+struct InstanceData
+{
+	glm::mat4 transform;
+	glm::vec4 colour;
+	glm::vec4 custom;
+};
+
+//Vertices and indices live in the shared GeometryArena, so a mesh is just a range of it and every mesh draws
+//with the same vertex array
 class Mesh
 {
 public:
+	static const GLuint INSTANCE_ATTRIBUTE_LOCATION = 3;
+
 	Mesh();
 	~Mesh();
 
 	void init();
 	void copyBufferData(Vertex *pVerts, unsigned int numberOfVerts, unsigned int *pIndices, unsigned int numberOfIndices);
 	void render();
+	//Draws the mesh once per instance, the instance data is streamed into the mesh's instance buffer first
+	void renderInstanced(const InstanceData *pInstances, unsigned int numberOfInstances);
+	//As above but writes the instances into this frame's region of a persistently mapped ring, no map or driver copy
+	void renderInstanced(StreamingBuffer& streamingBuffer, const InstanceData *pInstances, unsigned int numberOfInstances);
 	void destroy();
+
+	GLuint getVAO() const { return getGeometryArena().getVAO(); };
+	GeometryHandle getGeometry() const { return m_Geometry; };
+	//Base vertex and first index of this mesh in the arena's buffers, GL thread only
+	unsigned int getFirstVertex() const;
+	unsigned int getFirstIndex() const;
+	unsigned int getNumberOfVertices() const { return m_NumberOfVertices; };
+	unsigned int getNumberOfIndices() const { return m_NumberOfIndices; };
+	//Local space AABB of the vertices, found in copyBufferData
+	const glm::vec3& getBoundsMin() const { return m_BoundsMin; };
+	const glm::vec3& getBoundsMax() const { return m_BoundsMax; };
 private:
-	GLuint m_VBO;
-	GLuint m_EBO;
-	GLuint m_VAO;
+	GeometryHandle m_Geometry;
+	GLuint m_InstanceVBO;
 	unsigned int m_NumberOfVertices;
 	unsigned int m_NumberOfIndices;
+	//Size of the instance buffer in instances
+	unsigned int m_InstanceCapacity;
+	glm::vec3 m_BoundsMin;
+	glm::vec3 m_BoundsMax;
+};
+
+//One command in an indirect draw buffer, laid out as glMultiDrawElementsIndirect expects
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
 };
 
 class MeshCollection
 {
 public:
+	//Storage buffer binding the per draw model matrices are bound to for the indirect path
+	static const GLuint DRAW_DATA_BINDING = 0;
+
 	MeshCollection();
 	~MeshCollection();
 
 	void addMesh(Mesh *pMesh);
 
+	//Builds an indirect command buffer of the meshes' ranges in the geometry arena, after which render draws the
+	//whole collection with one glMultiDrawElementsIndirect. Call again after changing the meshes' data, adding
+	//meshes rebuilds on the next render. Returns false if the driver lacks multi draw indirect, storage buffers or
+	//gl_DrawID
+	bool buildIndirect();
+	void setUseIndirect(bool useIndirect) { m_UseIndirect = useIndirect; };
+	bool isIndirectReady() const { return m_CommandBuffer != 0; };
+
+	//Read in the vertex shader as models[gl_DrawID], see IndirectVert.glsl. Only the indirect path provides these
+	void setModelMatrix(size_t meshIndex, const glm::mat4& model);
+
+	size_t getMeshCount() const { return m_Meshes.size(); };
+
+	//Tests every mesh's world bounds against the frustum of viewProjection, render then only draws those inside.
+	//Call each frame after the camera or model matrices change, until the first call everything is drawn.
+	//With an occlusion culler whose occluders have been rasterised for the same view, meshes inside the frustum
+	//but hidden behind them are dropped too
+	void cull(const glm::mat4& viewProjection, OcclusionCuller* pOcclusionCuller = nullptr);
+	size_t getVisibleCount() const;
+
 	void render();
 	void destroy();
 private:
+	void renderIndirect();
+	//Fills the command buffer from the meshes' current arena ranges
+	void writeCommands();
+	void destroyIndirect();
+	bool isVisible(size_t meshIndex) const { return m_Visible.empty() || m_Visible[meshIndex] != 0; };
+
 	std::vector<Mesh*> m_Meshes;
+
+	bool m_UseIndirect;
+	GLuint m_CommandBuffer;
+	//Set by addMesh once the buffers are built, as they are sized for the meshes there were at the time
+	bool m_IndirectStale;
+	//Arena layout the commands were written for, compaction moving a mesh means rewriting them
+	unsigned int m_LayoutVersion;
+	GLuint m_DrawDataBuffer;
+	std::vector<glm::mat4> m_ModelMatrices;
+	bool m_DrawDataDirty;
+
+	//World bounds are rebuilt when a model matrix changes, m_Visible is empty until the first cull
+	CullingBounds m_WorldBounds;
+	bool m_BoundsDirty;
+	std::vector<uint8_t> m_Visible;
+	bool m_VisibilityChanged;
 }; 
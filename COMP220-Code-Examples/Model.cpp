@@ -1,10 +1,13 @@
 #include "Model.h"
+#include "GLStateCache.h"
+#include "JobSystem.h"
+#include "Mesh.h"
 
-bool loadModelFromFile(const std::string& filename, GLuint VBO, GLuint EBO, unsigned int& numVerts, unsigned int& numIndices)
-{
-	std::vector<Vertex> vertices;
-	std::vector<unsigned int> indices;
+#include <memory>
 
+bool loadModelDataFromFile(const std::string& filename, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	//An importer per call, Assimp keeps no shared state between them so several files can load at once
 	Assimp::Importer importer;
 
 	const aiScene* scene = importer.ReadFile(filename, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_GenUVCoords | aiProcess_CalcTangentSpace);
@@ -23,9 +26,6 @@ bool loadModelFromFile(const std::string& filename, GLuint VBO, GLuint EBO, unsi
 			aiVector3D currentModelVertex = currentMesh->mVertices[v];
 			aiColor4D currentModelColour = aiColor4D(1.0, 1.0, 1.0, 1.0);
 			aiVector3D currentTextureCoordinates = aiVector3D(0.0f, 0.0f, 0.0f);
-			aiVector3D currentModelNormals = aiVector3D(0.0f, 0.0f, 0.0f);
-			aiVector3D currentModelTangents = aiVector3D(0.0f, 0.0f, 0.0f);
-			aiVector3D currentModelBitangents = aiVector3D(0.0f, 0.0f, 0.0f);
 
 			if (currentMesh->HasVertexColors(0))
 			{
@@ -35,22 +35,11 @@ bool loadModelFromFile(const std::string& filename, GLuint VBO, GLuint EBO, unsi
 			{
 				currentTextureCoordinates = currentMesh->mTextureCoords[0][v];
 			}
-			if (currentMesh->HasNormals())
-			{
-				currentModelNormals = currentMesh->mNormals[v];
-			}
-			if (currentMesh->HasTangentsAndBitangents())
-			{
-				currentModelTangents = currentMesh->mTangents[v];
-				currentModelBitangents = currentMesh->mBitangents[v];
-			}
-			
+
+			//Vertex only has position, colour and texture coordinates, normals and tangents are dropped until it grows them
 			Vertex currentVertex = { currentModelVertex.x,currentModelVertex.y,currentModelVertex.z,
 				currentModelColour.r,currentModelColour.g,currentModelColour.b,currentModelColour.a,
-				currentTextureCoordinates.x,currentTextureCoordinates.y,
-				currentModelNormals.x,currentModelNormals.y,currentModelNormals.z,
-				currentModelTangents.x,currentModelTangents.y,currentModelTangents.z,
-				currentModelBitangents.x,currentModelBitangents.y,currentModelBitangents.z};
+				currentTextureCoordinates.x,currentTextureCoordinates.y };
 
 			vertices.push_back(currentVertex);
 		}
@@ -64,15 +53,51 @@ bool loadModelFromFile(const std::string& filename, GLuint VBO, GLuint EBO, unsi
 		}
 	}
 
+	return true;
+}
+
+bool loadModelFromFile(const std::string& filename, GLuint VBO, GLuint EBO, unsigned int& numVerts, unsigned int& numIndices)
+{
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	if (!loadModelDataFromFile(filename, vertices, indices))
+	{
+		return false;
+	}
+
 	numVerts = vertices.size();
 	numIndices = indices.size();
 
 	// Give our vertices to OpenGL.
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	getGLState().bindBuffer(GL_ARRAY_BUFFER, VBO);
 	glBufferData(GL_ARRAY_BUFFER, numVerts * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	getGLState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
 
 	return true;
-}
\ No newline at end of file
+}
+
+void loadModelIntoMeshAsync(const std::string& filename, Mesh* pMesh, JobCounter* pCounter)
+{
+	struct ModelData
+	{
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+	};
+	std::shared_ptr<ModelData> pData = std::make_shared<ModelData>();
+
+	//The upload is scheduled from inside the parse job, so pCounter cannot reach zero between the two
+	getJobSystem().schedule([filename, pMesh, pCounter, pData]()
+	{
+		if (!loadModelDataFromFile(filename, pData->vertices, pData->indices))
+		{
+			return;
+		}
+		getJobSystem().scheduleOnMainThread([pMesh, pData]()
+		{
+			pMesh->copyBufferData(pData->vertices.data(), (unsigned int)pData->vertices.size(), pData->indices.data(),
+				(unsigned int)pData->indices.size());
+		}, pCounter);
+	}, pCounter);
+}
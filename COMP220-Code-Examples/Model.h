@@ -12,4 +12,14 @@
 
 #include "Vertex.h"
 
-bool loadModelFromFile(const std::string& filename, GLuint VBO, GLuint EBO, unsigned int& numVerts, unsigned int& numIndices);
\ No newline at end of file
+class JobCounter;
+class Mesh;
+
+bool loadModelFromFile(const std::string& filename, GLuint VBO, GLuint EBO, unsigned int& numVerts, unsigned int& numIndices);
+
+//Reads every mesh in the file into one list of vertices and indices, touches no GL so it can run on any thread
+bool loadModelDataFromFile(const std::string& filename, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+//Parses the file as a job and then copies it into pMesh on the main thread, pCounter reaches zero once the mesh is
+//ready. pMesh must already be initialised and must outlive the load, it is left empty if the file fails to load
+void loadModelIntoMeshAsync(const std::string& filename, Mesh* pMesh, JobCounter* pCounter);
\ No newline at end of file
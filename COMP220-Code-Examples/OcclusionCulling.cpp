@@ -0,0 +1,388 @@
+#include "OcclusionCulling.h"
+#include "JobSystem.h"
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE 1
+#include <emmintrin.h>
+#endif
+
+//Vertices closer than this in clip space w are treated as crossing the near plane
+static const float NEAR_W = 1.0e-4f;
+
+static double millisecondsSince(uint64_t start)
+{
+	return (double)(SDL_GetPerformanceCounter() - start) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+OcclusionCuller::OcclusionCuller()
+{
+	m_Width = 0;
+	m_Height = 0;
+	m_ViewProjection = glm::mat4(1.0f);
+	m_Stats = {};
+}
+
+void OcclusionCuller::init(int width, int height)
+{
+	//The rasteriser writes four pixels at a time. Halving stops at 1x1, so anything smaller would never get there
+	m_Width = (std::max(width, 1) + 3) & ~3;
+	m_Height = std::max(height, 1);
+
+	m_HiZ.clear();
+	m_LevelWidth.clear();
+	m_LevelHeight.clear();
+	int levelWidth = m_Width;
+	int levelHeight = m_Height;
+	while (true)
+	{
+		m_HiZ.push_back(std::vector<float>(levelWidth * levelHeight, 1.0f));
+		m_LevelWidth.push_back(levelWidth);
+		m_LevelHeight.push_back(levelHeight);
+		if (levelWidth == 1 && levelHeight == 1)
+		{
+			break;
+		}
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+	}
+}
+
+unsigned int OcclusionCuller::registerOccluder(const glm::vec3* pPositions, unsigned int numberOfPositions, const unsigned int* pIndices, unsigned int numberOfIndices)
+{
+	Occluder occluder;
+	occluder.positions.assign(pPositions, pPositions + numberOfPositions);
+	occluder.indices.assign(pIndices, pIndices + numberOfIndices);
+	m_Occluders.push_back(occluder);
+	return (unsigned int)(m_Occluders.size() - 1);
+}
+
+void OcclusionCuller::beginFrame(const glm::mat4& viewProjection)
+{
+	if (m_HiZ.empty())
+	{
+		init();
+	}
+	m_ViewProjection = viewProjection;
+	m_Triangles.clear();
+	m_Stats = {};
+	std::fill(m_HiZ[0].begin(), m_HiZ[0].end(), 1.0f);
+}
+
+void OcclusionCuller::addOccluder(unsigned int occluderID, const glm::mat4& model)
+{
+	uint64_t start = SDL_GetPerformanceCounter();
+	const Occluder& occluder = m_Occluders[occluderID];
+	glm::mat4 transform = m_ViewProjection * model;
+
+	m_ClipScratch.resize(occluder.positions.size());
+	for (size_t i = 0; i < occluder.positions.size(); i++)
+	{
+		m_ClipScratch[i] = transform * glm::vec4(occluder.positions[i], 1.0f);
+	}
+
+	float width = (float)m_Width;
+	float height = (float)m_Height;
+	for (size_t i = 0; i + 2 < occluder.indices.size(); i += 3)
+	{
+		m_Stats.occluderTriangles++;
+
+		const glm::vec4* pClip[3] = { &m_ClipScratch[occluder.indices[i]], &m_ClipScratch[occluder.indices[i + 1]], &m_ClipScratch[occluder.indices[i + 2]] };
+		//Clipping would add coverage the occluder might not have, dropping the triangle can only cull less
+		if (pClip[0]->w < NEAR_W || pClip[1]->w < NEAR_W || pClip[2]->w < NEAR_W)
+		{
+			continue;
+		}
+
+		glm::vec3 screen[3];
+		for (int v = 0; v < 3; v++)
+		{
+			float inverseW = 1.0f / pClip[v]->w;
+			screen[v].x = (pClip[v]->x * inverseW * 0.5f + 0.5f) * width;
+			screen[v].y = (pClip[v]->y * inverseW * 0.5f + 0.5f) * height;
+			screen[v].z = pClip[v]->z * inverseW * 0.5f + 0.5f;
+		}
+
+		//Both windings are drawn, flipping to counter clockwise so inside is where every edge is positive
+		float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+		if (area == 0.0f)
+		{
+			continue;
+		}
+		if (area < 0.0f)
+		{
+			std::swap(screen[1], screen[2]);
+			area = -area;
+		}
+
+		ScreenTriangle triangle;
+		triangle.minX = std::max(0, (int)std::floor(std::min(std::min(screen[0].x, screen[1].x), screen[2].x)));
+		triangle.minY = std::max(0, (int)std::floor(std::min(std::min(screen[0].y, screen[1].y), screen[2].y)));
+		triangle.maxX = std::min(m_Width - 1, (int)std::ceil(std::max(std::max(screen[0].x, screen[1].x), screen[2].x)));
+		triangle.maxY = std::min(m_Height - 1, (int)std::ceil(std::max(std::max(screen[0].y, screen[1].y), screen[2].y)));
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+		{
+			continue;
+		}
+
+		//Edge i is opposite vertex i, so its value over the area is that vertex's barycentric weight.
+		//The half pixel offset is folded in so the rasteriser evaluates at integer coordinates
+		triangle.depthA = 0.0f;
+		triangle.depthB = 0.0f;
+		triangle.depthC = 0.0f;
+		for (int edge = 0; edge < 3; edge++)
+		{
+			const glm::vec3& a = screen[(edge + 1) % 3];
+			const glm::vec3& b = screen[(edge + 2) % 3];
+			float edgeA = a.y - b.y;
+			float edgeB = b.x - a.x;
+			float edgeC = a.x * b.y - a.y * b.x + 0.5f * edgeA + 0.5f * edgeB;
+			triangle.edgeA[edge] = edgeA;
+			triangle.edgeB[edge] = edgeB;
+			triangle.edgeC[edge] = edgeC;
+			triangle.depthA += edgeA * screen[edge].z / area;
+			triangle.depthB += edgeB * screen[edge].z / area;
+			triangle.depthC += edgeC * screen[edge].z / area;
+		}
+		m_Triangles.push_back(triangle);
+	}
+	m_Stats.setupTime += millisecondsSince(start);
+}
+
+void OcclusionCuller::rasterize()
+{
+	uint64_t start = SDL_GetPerformanceCounter();
+	m_Stats.rasterizedTriangles = (unsigned int)m_Triangles.size();
+
+	//Bands never share rows, so jobs write the depth buffer without locking. One band per job as a band holds few
+	//pixels but may have many triangles crossing it
+	if (!m_Triangles.empty())
+	{
+		int bandCount = (m_Height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+		getJobSystem().parallelFor(bandCount, [this](size_t begin, size_t end)
+		{
+			for (size_t band = begin; band < end; band++)
+			{
+				rasterizeBand((int)band);
+			}
+		}, 1);
+	}
+	m_Stats.rasterizeTime = millisecondsSince(start);
+
+	start = SDL_GetPerformanceCounter();
+	buildHiZ();
+	m_Stats.hiZTime = millisecondsSince(start);
+}
+
+void OcclusionCuller::rasterizeBand(int band)
+{
+	int bandMinY = band * BAND_HEIGHT;
+	int bandMaxY = std::min(m_Height - 1, bandMinY + BAND_HEIGHT - 1);
+	for (const ScreenTriangle& triangle : m_Triangles)
+	{
+		if (triangle.maxY >= bandMinY && triangle.minY <= bandMaxY)
+		{
+			rasterizeTriangle(triangle, bandMinY, bandMaxY);
+		}
+	}
+}
+
+void OcclusionCuller::rasterizeTriangle(const ScreenTriangle& triangle, int bandMinY, int bandMaxY)
+{
+	int minY = std::max(triangle.minY, bandMinY);
+	int maxY = std::min(triangle.maxY, bandMaxY);
+	//Four pixel groups are aligned so they never run past the end of a row
+	int minX = triangle.minX & ~3;
+	int maxX = triangle.maxX;
+	float* pDepth = m_HiZ[0].data();
+
+#if OCCLUSION_SSE
+	__m128 edgeA[3];
+	__m128 edgeStep[3];
+	for (int edge = 0; edge < 3; edge++)
+	{
+		edgeA[edge] = _mm_set1_ps(triangle.edgeA[edge]);
+		edgeStep[edge] = _mm_mul_ps(edgeA[edge], _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+	}
+	__m128 depthStep = _mm_mul_ps(_mm_set1_ps(triangle.depthA), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+	const __m128 zero = _mm_setzero_ps();
+
+	for (int y = minY; y <= maxY; y++)
+	{
+		float* pRow = pDepth + y * m_Width;
+		for (int x = minX; x <= maxX; x += 4)
+		{
+			float fx = (float)x;
+			float fy = (float)y;
+			__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_set1_ps(triangle.edgeA[0] * fx + triangle.edgeB[0] * fy + triangle.edgeC[0]), edgeStep[0]), zero);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_set1_ps(triangle.edgeA[1] * fx + triangle.edgeB[1] * fy + triangle.edgeC[1]), edgeStep[1]), zero));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_set1_ps(triangle.edgeA[2] * fx + triangle.edgeB[2] * fy + triangle.edgeC[2]), edgeStep[2]), zero));
+			if (_mm_movemask_ps(inside) == 0)
+			{
+				continue;
+			}
+
+			__m128 depth = _mm_add_ps(_mm_set1_ps(triangle.depthA * fx + triangle.depthB * fy + triangle.depthC), depthStep);
+			__m128 stored = _mm_loadu_ps(pRow + x);
+			__m128 nearer = _mm_min_ps(stored, depth);
+			_mm_storeu_ps(pRow + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, stored)));
+		}
+	}
+#else
+	for (int y = minY; y <= maxY; y++)
+	{
+		float* pRow = pDepth + y * m_Width;
+		for (int x = triangle.minX; x <= maxX; x++)
+		{
+			float fx = (float)x;
+			float fy = (float)y;
+			bool inside = true;
+			for (int edge = 0; edge < 3; edge++)
+			{
+				inside = inside && triangle.edgeA[edge] * fx + triangle.edgeB[edge] * fy + triangle.edgeC[edge] >= 0.0f;
+			}
+			if (inside)
+			{
+				pRow[x] = std::min(pRow[x], triangle.depthA * fx + triangle.depthB * fy + triangle.depthC);
+			}
+		}
+	}
+#endif
+}
+
+void OcclusionCuller::buildHiZ()
+{
+	for (size_t level = 1; level < m_HiZ.size(); level++)
+	{
+		const std::vector<float>& source = m_HiZ[level - 1];
+		std::vector<float>& destination = m_HiZ[level];
+		int sourceWidth = m_LevelWidth[level - 1];
+		int sourceHeight = m_LevelHeight[level - 1];
+		int width = m_LevelWidth[level];
+		int height = m_LevelHeight[level];
+		for (int y = 0; y < height; y++)
+		{
+			//Odd sizes repeat the last row or column
+			int y0 = y * 2;
+			int y1 = std::min(y0 + 1, sourceHeight - 1);
+			for (int x = 0; x < width; x++)
+			{
+				int x0 = x * 2;
+				int x1 = std::min(x0 + 1, sourceWidth - 1);
+				destination[y * width + x] = std::max(std::max(source[y0 * sourceWidth + x0], source[y0 * sourceWidth + x1]),
+					std::max(source[y1 * sourceWidth + x0], source[y1 * sourceWidth + x1]));
+			}
+		}
+	}
+}
+
+bool OcclusionCuller::isOccluded(const glm::vec3& min, const glm::vec3& max) const
+{
+	//Nothing rasterised yet
+	if (m_HiZ.empty())
+	{
+		return false;
+	}
+	float screenMinX = FLT_MAX;
+	float screenMinY = FLT_MAX;
+	float screenMaxX = -FLT_MAX;
+	float screenMaxY = -FLT_MAX;
+	float nearestDepth = FLT_MAX;
+	//Corners are the clip space centre plus or minus each scaled axis, four transforms rather than eight
+	glm::vec3 centre = (min + max) * 0.5f;
+	glm::vec3 extent = (max - min) * 0.5f;
+	glm::vec4 clipCentre = m_ViewProjection * glm::vec4(centre, 1.0f);
+	glm::vec4 axisX = m_ViewProjection[0] * extent.x;
+	glm::vec4 axisY = m_ViewProjection[1] * extent.y;
+	glm::vec4 axisZ = m_ViewProjection[2] * extent.z;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec4 clip = clipCentre + ((corner & 1) ? axisX : -axisX) + ((corner & 2) ? axisY : -axisY) + ((corner & 4) ? axisZ : -axisZ);
+		//Crosses the near plane, so it covers the camera and cannot be behind anything
+		if (clip.w < NEAR_W)
+		{
+			return false;
+		}
+		float inverseW = 1.0f / clip.w;
+		float x = (clip.x * inverseW * 0.5f + 0.5f) * m_Width;
+		float y = (clip.y * inverseW * 0.5f + 0.5f) * m_Height;
+		screenMinX = std::min(screenMinX, x);
+		screenMinY = std::min(screenMinY, y);
+		screenMaxX = std::max(screenMaxX, x);
+		screenMaxY = std::max(screenMaxY, y);
+		nearestDepth = std::min(nearestDepth, clip.z * inverseW * 0.5f + 0.5f);
+	}
+
+	int x0 = std::max(0, (int)std::floor(screenMinX));
+	int y0 = std::max(0, (int)std::floor(screenMinY));
+	int x1 = std::min(m_Width - 1, (int)std::floor(screenMaxX));
+	int y1 = std::min(m_Height - 1, (int)std::floor(screenMaxY));
+	if (x0 > x1 || y0 > y1)
+	{
+		//Off screen, that is for the frustum test to decide
+		return false;
+	}
+
+	//Coarsest level at which the box covers at most a few texels across, each texel must be nearer than the box
+	size_t level = 0;
+	while (level + 1 < m_HiZ.size() && ((x1 >> level) - (x0 >> level) > 3 || (y1 >> level) - (y0 >> level) > 3))
+	{
+		level++;
+	}
+	const std::vector<float>& depth = m_HiZ[level];
+	int width = m_LevelWidth[level];
+	for (int y = y0 >> level; y <= (y1 >> level); y++)
+	{
+		for (int x = x0 >> level; x <= (x1 >> level); x++)
+		{
+			if (depth[y * width + x] >= nearestDepth)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void OcclusionCuller::cull(const CullingBounds& bounds, uint8_t* pVisible)
+{
+	uint64_t start = SDL_GetPerformanceCounter();
+	const float* pCentreX = bounds.getCentreX();
+	const float* pCentreY = bounds.getCentreY();
+	const float* pCentreZ = bounds.getCentreZ();
+	const float* pExtentX = bounds.getExtentX();
+	const float* pExtentY = bounds.getExtentY();
+	const float* pExtentZ = bounds.getExtentZ();
+	for (size_t i = 0; i < bounds.size(); i++)
+	{
+		if (!pVisible[i])
+		{
+			continue;
+		}
+		m_Stats.objectsTested++;
+
+		glm::vec3 centre(pCentreX[i], pCentreY[i], pCentreZ[i]);
+		glm::vec3 extent(pExtentX[i], pExtentY[i], pExtentZ[i]);
+		if (isOccluded(centre - extent, centre + extent))
+		{
+			pVisible[i] = 0;
+			m_Stats.objectsOccluded++;
+		}
+	}
+	m_Stats.testTime += millisecondsSince(start);
+}
+
+void OcclusionCuller::printStats() const
+{
+	double culled = m_Stats.objectsTested > 0 ? 100.0 * m_Stats.objectsOccluded / m_Stats.objectsTested : 0.0;
+	printf("Occlusion: %u/%u occluder triangles drawn, %u/%u objects occluded (%.1f%%)\n", m_Stats.rasterizedTriangles,
+		m_Stats.occluderTriangles, m_Stats.objectsOccluded, m_Stats.objectsTested, culled);
+	printf("Occlusion: setup %.3fms, rasterize %.3fms, hi-z %.3fms, test %.3fms\n", m_Stats.setupTime, m_Stats.rasterizeTime,
+		m_Stats.hiZTime, m_Stats.testTime);
+}
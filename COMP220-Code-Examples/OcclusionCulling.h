@@ -0,0 +1,104 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "FrustumCulling.h"
+
+//What the occlusion culler did this frame, times in milliseconds
+struct OcclusionStats
+{
+	unsigned int occluderTriangles;
+	unsigned int rasterizedTriangles;
+	unsigned int objectsTested;
+	unsigned int objectsOccluded;
+	double setupTime;
+	double rasterizeTime;
+	double hiZTime;
+	double testTime;
+};
+
+//Software occlusion culling on the CPU. Designated occluders, usually a few simplified meshes such as walls and
+//floors, are drawn into a small depth buffer by jobs, each owning a band of rows and rasterising four pixels
+//at a time with SSE. A hierarchical Z pyramid of the farthest depth in each 2x2 is built from that, and
+//object AABBs are tested against the level where they cover only a few texels, before anything is sent to GL.
+//Occluders are only ever under-drawn (triangles crossing the near plane are dropped) so nothing visible is culled
+class OcclusionCuller
+{
+public:
+	static const int DEFAULT_WIDTH = 320;
+	static const int DEFAULT_HEIGHT = 192;
+	//Rows per band handed to a worker
+	static const int BAND_HEIGHT = 16;
+
+	OcclusionCuller();
+
+	//Called by the first beginFrame if not called before, sizes below 1 are treated as 1
+	void init(int width = DEFAULT_WIDTH, int height = DEFAULT_HEIGHT);
+
+	//Keeps a CPU copy of an occluder's triangles, returns an id for addOccluder
+	unsigned int registerOccluder(const glm::vec3* pPositions, unsigned int numberOfPositions, const unsigned int* pIndices, unsigned int numberOfIndices);
+
+	//Clears the depth buffer and the occluder list for a new view
+	void beginFrame(const glm::mat4& viewProjection);
+	//Queues an instance of a registered occluder, transformed and set up immediately
+	void addOccluder(unsigned int occluderID, const glm::mat4& model);
+	//Rasterises every queued occluder and builds the pyramid, call once after the last addOccluder
+	void rasterize();
+
+	//True if the box is certainly hidden behind the occluders drawn this frame
+	bool isOccluded(const glm::vec3& min, const glm::vec3& max) const;
+	//Clears pVisible for every object which is visible there but occluded, objects already culled are not tested
+	void cull(const CullingBounds& bounds, uint8_t* pVisible);
+
+	const OcclusionStats& getStats() const { return m_Stats; };
+	void printStats() const;
+
+	int getWidth() const { return m_Width; };
+	int getHeight() const { return m_Height; };
+	//Level 0 is the full resolution depth buffer, depth is 0 at the near plane and 1 at the far plane
+	const std::vector<float>& getDepth(int level = 0) const { return m_HiZ[level]; };
+private:
+	struct Occluder
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<unsigned int> indices;
+	};
+
+	//A triangle in screen space ready for the rasteriser, with edge and depth plane equations at pixel centres
+	struct ScreenTriangle
+	{
+		int minX;
+		int minY;
+		int maxX;
+		int maxY;
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA;
+		float depthB;
+		float depthC;
+	};
+
+	void rasterizeBand(int band);
+	void rasterizeTriangle(const ScreenTriangle& triangle, int bandMinY, int bandMaxY);
+	void buildHiZ();
+
+	int m_Width;
+	int m_Height;
+	glm::mat4 m_ViewProjection;
+
+	std::vector<Occluder> m_Occluders;
+	std::vector<ScreenTriangle> m_Triangles;
+	std::vector<glm::vec4> m_ClipScratch;
+
+	//m_HiZ[0] is the depth buffer, each level after is half the size holding the farthest depth of its 2x2
+	std::vector<std::vector<float>> m_HiZ;
+	std::vector<int> m_LevelWidth;
+	std::vector<int> m_LevelHeight;
+
+	OcclusionStats m_Stats;
+};
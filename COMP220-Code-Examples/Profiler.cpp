@@ -0,0 +1,256 @@
+#include "Profiler.h"
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <fstream>
+
+Profiler::Profiler()
+{
+	m_Enabled = true;
+	m_HasTimerQuery = false;
+	m_StartCounter = 0;
+	m_GpuStartTime = 0;
+	m_FrameNumber = 0;
+}
+
+Profiler::~Profiler()
+{
+}
+
+void Profiler::init()
+{
+	//GL_TIMESTAMP queries are core in 3.3
+	m_HasTimerQuery = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+	m_StartCounter = SDL_GetPerformanceCounter();
+	if (m_HasTimerQuery)
+	{
+		glGetInteger64v(GL_TIMESTAMP, &m_GpuStartTime);
+	}
+	else
+	{
+		printf("Timer queries are not supported, only CPU scopes will be profiled\n");
+	}
+}
+
+void Profiler::destroy()
+{
+	for (FrameQueries& frame : m_Frames)
+	{
+		for (GpuQuery& query : frame.queries)
+		{
+			glDeleteQueries(1, &query.startQuery);
+			glDeleteQueries(1, &query.endQuery);
+		}
+		frame.queries.clear();
+		frame.used = 0;
+	}
+}
+
+double Profiler::toMicroseconds(uint64_t counter) const
+{
+	return (double)(counter - m_StartCounter) * 1000000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+void Profiler::beginFrame()
+{
+	m_FrameNumber++;
+
+	//The slot we are about to reuse was filled FRAME_LATENCY frames ago, its results should be ready by now
+	FrameQueries& frame = m_Frames[m_FrameNumber % (FRAME_LATENCY + 1)];
+	if (frame.used > 0)
+	{
+		readBackFrame(frame);
+	}
+	frame.used = 0;
+	frame.frameNumber = m_FrameNumber;
+
+	beginScope("Frame", true);
+}
+
+void Profiler::endFrame()
+{
+	endScope();
+	if (!m_OpenScopes.empty())
+	{
+		printf("Profiler scope %s was not closed before the end of the frame\n", m_OpenScopes.back().name);
+		m_OpenScopes.clear();
+	}
+}
+
+void Profiler::beginScope(const char* name, bool gpu)
+{
+	if (!m_Enabled)
+	{
+		return;
+	}
+
+	OpenScope scope;
+	scope.name = name;
+	scope.gpu = gpu && m_HasTimerQuery;
+	scope.gpuQueryIndex = -1;
+
+	if (scope.gpu)
+	{
+		FrameQueries& frame = m_Frames[m_FrameNumber % (FRAME_LATENCY + 1)];
+		if (frame.used == frame.queries.size())
+		{
+			GpuQuery query;
+			glGenQueries(1, &query.startQuery);
+			glGenQueries(1, &query.endQuery);
+			frame.queries.push_back(query);
+		}
+		//Timestamps rather than GL_TIME_ELAPSED, elapsed queries cannot nest
+		GpuQuery& query = frame.queries[frame.used];
+		query.name = name;
+		glQueryCounter(query.startQuery, GL_TIMESTAMP);
+		scope.gpuQueryIndex = (int)frame.used;
+		frame.used++;
+	}
+
+	scope.cpuStart = SDL_GetPerformanceCounter();
+	m_OpenScopes.push_back(scope);
+}
+
+void Profiler::endScope()
+{
+	if (!m_Enabled || m_OpenScopes.empty())
+	{
+		return;
+	}
+
+	uint64_t cpuEnd = SDL_GetPerformanceCounter();
+	OpenScope scope = m_OpenScopes.back();
+	m_OpenScopes.pop_back();
+
+	if (scope.gpuQueryIndex >= 0)
+	{
+		FrameQueries& frame = m_Frames[m_FrameNumber % (FRAME_LATENCY + 1)];
+		glQueryCounter(frame.queries[scope.gpuQueryIndex].endQuery, GL_TIMESTAMP);
+	}
+
+	TraceEvent event;
+	event.name = scope.name;
+	event.start = toMicroseconds(scope.cpuStart);
+	event.duration = toMicroseconds(cpuEnd) - event.start;
+	event.thread = 0;
+	addEvent(event);
+	addSample(scope.name, false, event.duration / 1000.0);
+}
+
+void Profiler::readBackFrame(FrameQueries& frame)
+{
+	for (size_t i = 0; i < frame.used; i++)
+	{
+		GpuQuery& query = frame.queries[i];
+
+		//Should always be available after FRAME_LATENCY frames, if not drop the sample rather than stall
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(query.endQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available != GL_TRUE)
+		{
+			continue;
+		}
+
+		GLuint64 startTime = 0;
+		GLuint64 endTime = 0;
+		glGetQueryObjectui64v(query.startQuery, GL_QUERY_RESULT, &startTime);
+		glGetQueryObjectui64v(query.endQuery, GL_QUERY_RESULT, &endTime);
+
+		TraceEvent event;
+		event.name = query.name;
+		event.start = (double)((GLint64)startTime - m_GpuStartTime) / 1000.0;
+		event.duration = (double)(endTime - startTime) / 1000.0;
+		event.thread = 1;
+		addEvent(event);
+		addSample(query.name, true, event.duration / 1000.0);
+	}
+}
+
+void Profiler::addEvent(const TraceEvent& event)
+{
+	if (m_Events.size() < MAX_TRACE_EVENTS)
+	{
+		m_Events.push_back(event);
+	}
+}
+
+void Profiler::addSample(const char* name, bool gpu, double milliseconds)
+{
+	ScopeHistory& history = (gpu ? m_GpuHistory : m_CpuHistory)[name];
+	if (history.samples.size() < HISTORY_SIZE)
+	{
+		history.samples.push_back(milliseconds);
+	}
+	else
+	{
+		history.samples[history.next] = milliseconds;
+		history.next = (history.next + 1) % HISTORY_SIZE;
+	}
+}
+
+double Profiler::getPercentile(const std::string& name, bool gpu, double percentile) const
+{
+	const std::unordered_map<std::string, ScopeHistory>& histories = gpu ? m_GpuHistory : m_CpuHistory;
+	auto it = histories.find(name);
+	if (it == histories.end() || it->second.samples.empty())
+	{
+		return 0.0;
+	}
+
+	std::vector<double> sorted = it->second.samples;
+	size_t index = (size_t)(percentile / 100.0 * (double)(sorted.size() - 1) + 0.5);
+	std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+	return sorted[index];
+}
+
+void Profiler::printSummary() const
+{
+	printf("%-24s %-4s %9s %9s %9s\n", "scope", "", "p50 ms", "p95 ms", "p99 ms");
+	for (int gpu = 0; gpu < 2; gpu++)
+	{
+		const std::unordered_map<std::string, ScopeHistory>& histories = gpu ? m_GpuHistory : m_CpuHistory;
+		std::vector<std::string> names;
+		for (const auto& history : histories)
+		{
+			names.push_back(history.first);
+		}
+		std::sort(names.begin(), names.end());
+
+		for (const std::string& name : names)
+		{
+			printf("%-24s %-4s %9.3f %9.3f %9.3f\n", name.c_str(), gpu ? "gpu" : "cpu",
+				getPercentile(name, gpu != 0, 50.0), getPercentile(name, gpu != 0, 95.0), getPercentile(name, gpu != 0, 99.0));
+		}
+	}
+}
+
+bool Profiler::writeChromeTrace(const std::string& filename) const
+{
+	std::ofstream traceStream(filename, std::ios::out | std::ios::trunc);
+	if (!traceStream.is_open())
+	{
+		printf("Impossible to write %s\n", filename.c_str());
+		return false;
+	}
+
+	traceStream << "{\"traceEvents\":[\n";
+	traceStream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+	traceStream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+	char line[256];
+	for (const TraceEvent& event : m_Events)
+	{
+		//Scope names are string literals from the code, so there is nothing to escape
+		snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			event.name, event.thread, event.start, event.duration);
+		traceStream << line;
+	}
+	traceStream << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	return true;
+}
+
+Profiler& getProfiler()
+{
+	static Profiler profiler;
+	return profiler;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <GL\glew.h>
+#include <SDL_opengl.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//Frame profiler with CPU scopes and GPU timer queries. GPU queries are kept in a ring of frames and only read
+//back once they are a few frames old, so the profiler never waits on the GPU. Results can be written out as a
+//Chrome trace (open in chrome://tracing or Perfetto) and each scope keeps a rolling window for percentiles
+class Profiler
+{
+public:
+	//How many frames a GPU query has to wait before it is read back
+	static const int FRAME_LATENCY = 3;
+	//Number of samples each scope keeps for its percentiles
+	static const int HISTORY_SIZE = 256;
+	//Trace recording stops after this many events so long sessions do not grow without bound
+	static const size_t MAX_TRACE_EVENTS = 1000000;
+
+	Profiler();
+	~Profiler();
+
+	void init();
+	void destroy();
+
+	void beginFrame();
+	void endFrame();
+
+	//Scopes must nest properly, use ProfileScope rather than calling these directly
+	void beginScope(const char* name, bool gpu);
+	void endScope();
+
+	//Scope time in milliseconds at a percentile over the rolling window, cpu or gpu
+	double getPercentile(const std::string& name, bool gpu, double percentile) const;
+	void printSummary() const;
+
+	//Writes every recorded event as Chrome trace-event JSON
+	bool writeChromeTrace(const std::string& filename) const;
+
+	void setEnabled(bool enabled) { m_Enabled = enabled; };
+	bool isEnabled() const { return m_Enabled; };
+private:
+	struct TraceEvent
+	{
+		const char* name;
+		//Microseconds since init, thread 0 is the CPU and 1 the GPU
+		double start;
+		double duration;
+		int thread;
+	};
+
+	struct OpenScope
+	{
+		const char* name;
+		uint64_t cpuStart;
+		bool gpu;
+		int gpuQueryIndex;
+	};
+
+	struct GpuQuery
+	{
+		const char* name;
+		GLuint startQuery;
+		GLuint endQuery;
+	};
+
+	struct FrameQueries
+	{
+		std::vector<GpuQuery> queries;
+		size_t used = 0;
+		unsigned int frameNumber = 0;
+	};
+
+	struct ScopeHistory
+	{
+		std::vector<double> samples;
+		size_t next = 0;
+	};
+
+	double toMicroseconds(uint64_t counter) const;
+	void addEvent(const TraceEvent& event);
+	void addSample(const char* name, bool gpu, double milliseconds);
+	void readBackFrame(FrameQueries& frame);
+
+	bool m_Enabled;
+	bool m_HasTimerQuery;
+	uint64_t m_StartCounter;
+	//GPU timestamp matching m_StartCounter, lets GPU events sit on the same timeline as CPU ones
+	GLint64 m_GpuStartTime;
+	unsigned int m_FrameNumber;
+
+	std::vector<OpenScope> m_OpenScopes;
+	FrameQueries m_Frames[FRAME_LATENCY + 1];
+
+	std::vector<TraceEvent> m_Events;
+	std::unordered_map<std::string, ScopeHistory> m_CpuHistory;
+	std::unordered_map<std::string, ScopeHistory> m_GpuHistory;
+};
+
+Profiler& getProfiler();
+
+//Times the enclosing block on the CPU, and on the GPU as well when gpu is true
+class ProfileScope
+{
+public:
+	ProfileScope(const char* name, bool gpu = false)
+	{
+		getProfiler().beginScope(name, gpu);
+	}
+	~ProfileScope()
+	{
+		getProfiler().endScope();
+	}
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name, true)
@@ -0,0 +1,141 @@
+#include "ProgramBinaryCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+static std::string s_CacheDirectory = "ShaderCache";
+
+//FNV-1a, good enough to key a cache on disk
+static uint64_t hashBytes(uint64_t hash, const void* pData, size_t size)
+{
+	const unsigned char* pBytes = (const unsigned char*)pData;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= pBytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static uint64_t hashString(uint64_t hash, const char* pString)
+{
+	if (pString == nullptr)
+	{
+		return hash;
+	}
+	//Include the terminator so that "ab"+"c" and "a"+"bc" hash differently
+	return hashBytes(hash, pString, strlen(pString) + 1);
+}
+
+static std::string binaryPath(uint64_t hash)
+{
+	char filename[32];
+	snprintf(filename, sizeof(filename), "%016llx.bin", (unsigned long long)hash);
+	return (std::filesystem::path(s_CacheDirectory) / filename).string();
+}
+
+void setProgramBinaryCacheDirectory(const std::string& directory)
+{
+	s_CacheDirectory = directory;
+}
+
+const std::string& getProgramBinaryCacheDirectory()
+{
+	return s_CacheDirectory;
+}
+
+bool isProgramBinaryCacheSupported()
+{
+	if (s_CacheDirectory.empty() || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+	{
+		return false;
+	}
+
+	GLint numberOfFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numberOfFormats);
+	return numberOfFormats > 0;
+}
+
+uint64_t hashProgramSources(const std::vector<std::string>& sources)
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = hashString(hash, (const char*)glGetString(GL_VENDOR));
+	hash = hashString(hash, (const char*)glGetString(GL_RENDERER));
+	hash = hashString(hash, (const char*)glGetString(GL_VERSION));
+	for (const std::string& source : sources)
+	{
+		hash = hashString(hash, source.c_str());
+	}
+	return hash;
+}
+
+bool loadProgramBinary(uint64_t hash, GLuint programID)
+{
+	std::ifstream binaryStream(binaryPath(hash), std::ios::in | std::ios::binary);
+	if (!binaryStream.is_open())
+	{
+		return false;
+	}
+
+	//File layout is the binary format followed by the driver's blob
+	GLenum binaryFormat = 0;
+	binaryStream.read((char*)&binaryFormat, sizeof(binaryFormat));
+	if (binaryStream.gcount() != sizeof(binaryFormat))
+	{
+		return false;
+	}
+	//Reading through istreambuf_iterator never sets eofbit, so an empty blob is the only sign of a truncated file
+	std::vector<char> binary((std::istreambuf_iterator<char>(binaryStream)), std::istreambuf_iterator<char>());
+	if (binary.empty())
+	{
+		return false;
+	}
+
+	glProgramBinary(programID, binaryFormat, binary.data(), (GLsizei)binary.size());
+
+	//Drivers reject binaries after an update or hardware change, the caller then falls back to source
+	GLint Result = GL_FALSE;
+	glGetProgramiv(programID, GL_LINK_STATUS, &Result);
+	if (Result != GL_TRUE)
+	{
+		printf("Cached program binary %016llx was rejected, recompiling\n", (unsigned long long)hash);
+		std::error_code error;
+		std::filesystem::remove(binaryPath(hash), error);
+		return false;
+	}
+	return true;
+}
+
+bool saveProgramBinary(uint64_t hash, GLuint programID)
+{
+	GLint binaryLength = 0;
+	glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+	if (binaryLength <= 0)
+	{
+		return false;
+	}
+
+	std::vector<char> binary(binaryLength);
+	GLenum binaryFormat = 0;
+	glGetProgramBinary(programID, binaryLength, nullptr, &binaryFormat, binary.data());
+
+	std::error_code error;
+	std::filesystem::create_directories(s_CacheDirectory, error);
+
+	//Write to a temporary file and rename so a crash never leaves a truncated binary behind
+	std::string path = binaryPath(hash);
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream binaryStream(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!binaryStream.is_open())
+		{
+			printf("Impossible to write program binary %s\n", tempPath.c_str());
+			return false;
+		}
+		binaryStream.write((const char*)&binaryFormat, sizeof(binaryFormat));
+		binaryStream.write(binary.data(), binary.size());
+	}
+	std::filesystem::rename(tempPath, path, error);
+	return !error;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <GL\glew.h>
+#include <SDL_opengl.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Sets the directory linked program binaries are stored in, an empty string disables the cache
+void setProgramBinaryCacheDirectory(const std::string& directory);
+const std::string& getProgramBinaryCacheDirectory();
+
+//True if the driver exposes at least one program binary format
+bool isProgramBinaryCacheSupported();
+
+//Hashes the final shader sources together with the driver vendor, renderer and version strings,
+//binaries from a different driver will therefore never be looked up
+uint64_t hashProgramSources(const std::vector<std::string>& sources);
+
+//Tries to load a cached binary into the program, returns false if there is none or the driver rejected it
+bool loadProgramBinary(uint64_t hash, GLuint programID);
+
+//Writes the linked program's binary to the cache, the program should have been linked with
+//GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+bool saveProgramBinary(uint64_t hash, GLuint programID);
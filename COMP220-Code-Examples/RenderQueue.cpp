@@ -0,0 +1,179 @@
+#include "RenderQueue.h"
+#include "GLStateCache.h"
+#include "Mesh.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cstring>
+
+static const uint64_t FIELD_MASK_12 = 0xFFF;
+static const uint64_t FIELD_MASK_24 = 0xFFFFFF;
+
+//Maps a view depth onto 24 bits, the float's bit pattern sorts correctly for positive values
+static uint64_t quantiseDepth(float depth)
+{
+	if (!(depth > 0.0f))
+	{
+		return 0;
+	}
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return (bits >> 8) & FIELD_MASK_24;
+}
+
+uint64_t makeSortKey(unsigned int pass, GLuint program, GLuint material, GLuint mesh, float depth)
+{
+	return ((uint64_t)(pass & 0xF) << 60) |
+		((program & FIELD_MASK_12) << 48) |
+		((material & FIELD_MASK_12) << 36) |
+		((mesh & FIELD_MASK_12) << 24) |
+		quantiseDepth(depth);
+}
+
+uint64_t makeTranslucentSortKey(unsigned int pass, GLuint program, GLuint material, GLuint mesh, float depth)
+{
+	//Inverting the depth draws the furthest objects first
+	return ((uint64_t)(pass & 0xF) << 60) |
+		((FIELD_MASK_24 - quantiseDepth(depth)) << 36) |
+		((program & FIELD_MASK_12) << 24) |
+		((material & FIELD_MASK_12) << 12) |
+		(mesh & FIELD_MASK_12);
+}
+
+RenderQueue::RenderQueue()
+{
+	m_Sorted = true;
+	m_DrawCount = 0;
+}
+
+RenderQueue::~RenderQueue()
+{
+}
+
+void RenderQueue::reserve(size_t numberOfCommands)
+{
+	m_Commands.reserve(numberOfCommands);
+	m_SortEntries.reserve(numberOfCommands);
+	m_SortScratch.reserve(numberOfCommands);
+}
+
+void RenderQueue::submit(const DrawCommand& command)
+{
+	m_SortEntries.push_back({ command.sortKey, (uint32_t)m_Commands.size() });
+	m_Commands.push_back(command);
+	m_Sorted = false;
+}
+
+void RenderQueue::submit(uint64_t sortKey, GLuint programID, GLuint textureID, const Mesh& mesh, GLint modelLocation, const glm::mat4& model)
+{
+	DrawCommand command;
+	command.sortKey = sortKey;
+	command.programID = programID;
+	command.vertexArrayID = mesh.getVAO();
+	command.textureID = textureID;
+	//Recorded ranges rather than the live ones, compaction may be moving them on the render thread
+	GeometryRange range = getGeometryArena().getRecordedRange(mesh.getGeometry());
+	command.numberOfIndices = range.numberOfIndices;
+	command.indexOffset = range.firstIndex * sizeof(unsigned int);
+	command.baseVertex = (GLint)range.firstVertex;
+	command.modelLocation = modelLocation;
+	command.model = model;
+	submit(command);
+}
+
+void RenderQueue::sort()
+{
+	if (m_Sorted)
+	{
+		return;
+	}
+
+	//LSD radix sort, 8 bits per pass. Only the 16 byte entries move, never the commands themselves
+	size_t count = m_SortEntries.size();
+	m_SortScratch.resize(count);
+	SortEntry* pSource = m_SortEntries.data();
+	SortEntry* pDestination = m_SortScratch.data();
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		size_t histogram[256] = {};
+		for (size_t i = 0; i < count; i++)
+		{
+			histogram[(pSource[i].key >> shift) & 0xFF]++;
+		}
+
+		//Every key has the same byte here, this pass would not change the order
+		if (histogram[(pSource[0].key >> shift) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		size_t offset = 0;
+		for (int bucket = 0; bucket < 256; bucket++)
+		{
+			size_t bucketSize = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketSize;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			pDestination[histogram[(pSource[i].key >> shift) & 0xFF]++] = pSource[i];
+		}
+		std::swap(pSource, pDestination);
+	}
+
+	if (pSource != m_SortEntries.data())
+	{
+		m_SortEntries.swap(m_SortScratch);
+	}
+	m_Sorted = true;
+}
+
+void RenderQueue::execute()
+{
+	if (m_Commands.empty())
+	{
+		return;
+	}
+	sort();
+
+	GLStateCache& state = getGLState();
+	m_DrawCount = 0;
+	for (const SortEntry& entry : m_SortEntries)
+	{
+		const DrawCommand& command = m_Commands[entry.index];
+		if (command.programID != 0)
+		{
+			state.useProgram(command.programID);
+		}
+		if (command.textureID != 0)
+		{
+			state.bindTexture(0, GL_TEXTURE_2D, command.textureID);
+		}
+		state.bindVertexArray(command.vertexArrayID);
+		if (command.modelLocation >= 0)
+		{
+			glUniformMatrix4fv(command.modelLocation, 1, GL_FALSE, glm::value_ptr(command.model));
+		}
+
+		if (command.baseVertex != 0)
+		{
+			glDrawElementsBaseVertex(GL_TRIANGLES, command.numberOfIndices, GL_UNSIGNED_INT, (void*)command.indexOffset, command.baseVertex);
+		}
+		else
+		{
+			glDrawElements(GL_TRIANGLES, command.numberOfIndices, GL_UNSIGNED_INT, (void*)command.indexOffset);
+		}
+		m_DrawCount++;
+	}
+
+	clear();
+}
+
+void RenderQueue::clear()
+{
+	//Keep the capacity, the next frame will record a similar number of draws
+	m_Commands.clear();
+	m_SortEntries.clear();
+	m_Sorted = true;
+}
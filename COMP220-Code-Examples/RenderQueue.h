@@ -0,0 +1,69 @@
+#pragma once
+
+#include <GL\glew.h>
+#include <SDL_opengl.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+class Mesh;
+
+//Sort key layout, most significant first, so sorting groups draws by pass, then program, then material:
+//  opaque      | pass:4 | program:12 | material:12 | mesh:12 | depth:24 front to back |
+//  translucent | pass:4 | depth:24 back to front | program:12 | material:12 | mesh:12 |
+//GL names are masked to their field width, which only merges groups once an app has thousands of objects
+uint64_t makeSortKey(unsigned int pass, GLuint program, GLuint material, GLuint mesh, float depth);
+uint64_t makeTranslucentSortKey(unsigned int pass, GLuint program, GLuint material, GLuint mesh, float depth);
+
+struct DrawCommand
+{
+	uint64_t sortKey;
+	//0 keeps whichever program was bound before execute, for recording threads which do not own the program
+	GLuint programID;
+	GLuint vertexArrayID;
+	GLuint textureID;
+	GLsizei numberOfIndices;
+	//Byte offset into the element buffer and value added to each index
+	size_t indexOffset;
+	GLint baseVertex;
+	//Location of the model matrix uniform, -1 to skip it
+	GLint modelLocation;
+	glm::mat4 model;
+};
+
+//Records draws for a frame, sorts them by key and then issues them through the GL state cache so
+//consecutive draws sharing a program, texture or vertex array do not rebind it
+class RenderQueue
+{
+public:
+	RenderQueue();
+	~RenderQueue();
+
+	void reserve(size_t numberOfCommands);
+	void submit(const DrawCommand& command);
+	//Takes the mesh's range from the geometry arena's recorded table, see GeometryArena::beginRecording
+	void submit(uint64_t sortKey, GLuint programID, GLuint textureID, const Mesh& mesh, GLint modelLocation, const glm::mat4& model);
+
+	//Radix sorts the recorded commands by key
+	void sort();
+	//Sorts if needed and then issues every command, the queue is left empty
+	void execute();
+	void clear();
+
+	size_t getCommandCount() const { return m_Commands.size(); };
+	unsigned int getDrawCount() const { return m_DrawCount; };
+private:
+	struct SortEntry
+	{
+		uint64_t key;
+		uint32_t index;
+	};
+
+	std::vector<DrawCommand> m_Commands;
+	std::vector<SortEntry> m_SortEntries;
+	std::vector<SortEntry> m_SortScratch;
+	bool m_Sorted;
+	unsigned int m_DrawCount;
+};
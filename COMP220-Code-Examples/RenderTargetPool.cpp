@@ -0,0 +1,185 @@
+#include "RenderTargetPool.h"
+
+#include "Texture.h"
+#include "GLStateCache.h"
+
+static size_t bytesPerPixel(GLenum format)
+{
+	switch (format)
+	{
+	case GL_R8:
+		return 1;
+	case GL_RG8:
+	case GL_R16F:
+	case GL_DEPTH_COMPONENT16:
+		return 2;
+	case GL_RGB8:
+	case GL_DEPTH_COMPONENT24:
+		return 3;
+	case GL_RGBA16F:
+	case GL_RG32F:
+		return 8;
+	case GL_RGBA32F:
+		return 16;
+	default:
+		return 4;
+	}
+}
+
+RenderTargetPool::RenderTargetPool()
+{
+	m_FrameNumber = 0;
+	m_Allocations = 0;
+	m_Reuses = 0;
+	m_MemoryUsed = 0;
+}
+
+RenderTargetPool::~RenderTargetPool()
+{
+	destroy();
+}
+
+void RenderTargetPool::beginFrame()
+{
+	m_FrameNumber++;
+}
+
+void RenderTargetPool::endFrame(unsigned int maxIdleFrames)
+{
+	for (auto it = m_Targets.begin(); it != m_Targets.end();)
+	{
+		RenderTarget* pTarget = (*it);
+		if (pTarget->inUse)
+		{
+			printf("Render target %dx%d was not released before the end of the frame\n", pTarget->desc.width, pTarget->desc.height);
+			pTarget->inUse = false;
+		}
+
+		if (m_FrameNumber - pTarget->lastUsedFrame > maxIdleFrames)
+		{
+			destroyTarget(pTarget);
+			it = m_Targets.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+RenderTarget* RenderTargetPool::acquire(const RenderTargetDesc& desc)
+{
+	//Any free target with the same description can be aliased, its previous contents are not preserved
+	for (RenderTarget* pTarget : m_Targets)
+	{
+		if (!pTarget->inUse && pTarget->desc == desc)
+		{
+			pTarget->inUse = true;
+			pTarget->lastUsedFrame = m_FrameNumber;
+			m_Reuses++;
+			return pTarget;
+		}
+	}
+
+	RenderTarget* pTarget = create(desc);
+	if (pTarget == nullptr)
+	{
+		return nullptr;
+	}
+	pTarget->inUse = true;
+	pTarget->lastUsedFrame = m_FrameNumber;
+	m_Targets.push_back(pTarget);
+	return pTarget;
+}
+
+void RenderTargetPool::release(RenderTarget* pTarget)
+{
+	if (pTarget != nullptr)
+	{
+		pTarget->inUse = false;
+	}
+}
+
+RenderTarget* RenderTargetPool::create(const RenderTargetDesc& desc)
+{
+	RenderTarget* pTarget = new RenderTarget();
+	pTarget->desc = desc;
+
+	if (desc.samples > 1)
+	{
+		glGenTextures(1, &pTarget->textureID);
+		getGLState().bindTexture(GL_TEXTURE_2D_MULTISAMPLE, pTarget->textureID);
+		glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, desc.colourFormat, desc.width, desc.height, GL_TRUE);
+	}
+	else if (desc.colourFormat == GL_RGBA8)
+	{
+		pTarget->textureID = CreateTexture(desc.width, desc.height);
+	}
+	else
+	{
+		glGenTextures(1, &pTarget->textureID);
+		getGLState().bindTexture(GL_TEXTURE_2D, pTarget->textureID);
+		//The format and type are only used to interpret pixel data, we pass none here
+		glTexImage2D(GL_TEXTURE_2D, 0, desc.colourFormat, desc.width, desc.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	}
+	GLenum textureTarget = desc.samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+
+	glGenFramebuffers(1, &pTarget->framebufferID);
+	getGLState().bindFramebuffer(GL_FRAMEBUFFER, pTarget->framebufferID);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textureTarget, pTarget->textureID, 0);
+
+	if (desc.depthFormat != 0)
+	{
+		glGenRenderbuffers(1, &pTarget->depthRenderbufferID);
+		glBindRenderbuffer(GL_RENDERBUFFER, pTarget->depthRenderbufferID);
+		if (desc.samples > 1)
+		{
+			glRenderbufferStorageMultisample(GL_RENDERBUFFER, desc.samples, desc.depthFormat, desc.width, desc.height);
+		}
+		else
+		{
+			glRenderbufferStorage(GL_RENDERBUFFER, desc.depthFormat, desc.width, desc.height);
+		}
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, pTarget->depthRenderbufferID);
+	}
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	getGLState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Render target %dx%d is incomplete, status 0x%x\n", desc.width, desc.height, status);
+		destroyTarget(pTarget);
+		return nullptr;
+	}
+
+	size_t pixels = (size_t)desc.width * desc.height * desc.samples;
+	pTarget->sizeInBytes = pixels * bytesPerPixel(desc.colourFormat);
+	if (desc.depthFormat != 0)
+	{
+		pTarget->sizeInBytes += pixels * bytesPerPixel(desc.depthFormat);
+	}
+	m_MemoryUsed += pTarget->sizeInBytes;
+	m_Allocations++;
+
+	return pTarget;
+}
+
+void RenderTargetPool::destroyTarget(RenderTarget* pTarget)
+{
+	m_MemoryUsed -= pTarget->sizeInBytes;
+	getGLState().deleteFramebuffers(1, &pTarget->framebufferID);
+	glDeleteRenderbuffers(1, &pTarget->depthRenderbufferID);
+	getGLState().deleteTextures(1, &pTarget->textureID);
+	delete pTarget;
+}
+
+void RenderTargetPool::destroy()
+{
+	for (RenderTarget* pTarget : m_Targets)
+	{
+		destroyTarget(pTarget);
+	}
+	m_Targets.clear();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <GL\glew.h>
+#include <SDL_opengl.h>
+
+#include <vector>
+
+//Describes the storage behind a render target, targets with matching descriptions can share storage
+struct RenderTargetDesc
+{
+	int width = 0;
+	int height = 0;
+	GLenum colourFormat = GL_RGBA8;
+	//Zero for no depth attachment
+	GLenum depthFormat = 0;
+	int samples = 1;
+
+	bool operator==(const RenderTargetDesc& other) const
+	{
+		return width == other.width && height == other.height && colourFormat == other.colourFormat &&
+			depthFormat == other.depthFormat && samples == other.samples;
+	}
+};
+
+struct RenderTarget
+{
+	RenderTargetDesc desc;
+	GLuint textureID = 0;
+	GLuint depthRenderbufferID = 0;
+	GLuint framebufferID = 0;
+	size_t sizeInBytes = 0;
+	//Set while a pass holds the target, once released it may be aliased by a later pass in the same frame
+	bool inUse = false;
+	unsigned int lastUsedFrame = 0;
+};
+
+class RenderTargetPool
+{
+public:
+	RenderTargetPool();
+	~RenderTargetPool();
+
+	void beginFrame();
+	//Frees any target which has not been used for the given number of frames
+	void endFrame(unsigned int maxIdleFrames = 3);
+
+	//Hands out a free target matching the description, creating one only if none is available
+	RenderTarget* acquire(const RenderTargetDesc& desc);
+	//Returns the target to the pool, passes which start after this can reuse its storage
+	void release(RenderTarget* pTarget);
+
+	unsigned int getAllocationCount() const { return m_Allocations; };
+	unsigned int getReuseCount() const { return m_Reuses; };
+	size_t getMemoryUsed() const { return m_MemoryUsed; };
+	size_t getTargetCount() const { return m_Targets.size(); };
+
+	void destroy();
+private:
+	RenderTarget* create(const RenderTargetDesc& desc);
+	void destroyTarget(RenderTarget* pTarget);
+
+	std::vector<RenderTarget*> m_Targets;
+	unsigned int m_FrameNumber;
+	unsigned int m_Allocations;
+	unsigned int m_Reuses;
+	size_t m_MemoryUsed;
+};
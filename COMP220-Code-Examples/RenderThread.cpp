@@ -0,0 +1,128 @@
+#include "RenderThread.h"
+
+#include <SDL.h>
+
+RenderThread::RenderThread()
+{
+	m_FramesSubmitted = 0;
+	m_FramesDrawn = 0;
+	m_Recording = false;
+	m_Running = false;
+	m_Stopping = false;
+	m_WaitTime = 0.0;
+}
+
+RenderThread::~RenderThread()
+{
+	stop();
+}
+
+bool RenderThread::start(int maxFramesAhead, std::function<void()> acquireContext, std::function<void(RenderQueue&)> renderFrame,
+	std::function<void()> releaseContext)
+{
+	if (m_Running)
+	{
+		return false;
+	}
+	if (maxFramesAhead < 1)
+	{
+		maxFramesAhead = 1;
+	}
+
+	//One queue recording plus up to maxFramesAhead waiting or being drawn
+	m_Queues.clear();
+	m_Queues.resize(maxFramesAhead + 1);
+	m_FramesSubmitted = 0;
+	m_FramesDrawn = 0;
+	m_Stopping = false;
+	m_WaitTime = 0.0;
+
+	m_AcquireContext = acquireContext;
+	m_RenderFrame = renderFrame;
+	m_ReleaseContext = releaseContext;
+
+	m_Running = true;
+	m_Thread = std::thread(&RenderThread::threadMain, this);
+	return true;
+}
+
+void RenderThread::stop()
+{
+	if (!m_Running)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stopping = true;
+	}
+	m_FrameSubmitted.notify_one();
+	m_Thread.join();
+	m_Running = false;
+}
+
+RenderQueue& RenderThread::beginFrame()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	//Up to maxFramesAhead frames may be waiting or drawing while this one records, which also guarantees
+	//that the queue for this frame is not one of theirs
+	unsigned int frameCount = (unsigned int)m_Queues.size();
+	if (m_FramesSubmitted - m_FramesDrawn >= frameCount)
+	{
+		uint64_t waitStart = SDL_GetPerformanceCounter();
+		m_FrameDrawn.wait(lock, [&]() { return m_FramesSubmitted - m_FramesDrawn < frameCount; });
+		m_WaitTime += (double)(SDL_GetPerformanceCounter() - waitStart) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+	}
+
+	m_Recording = true;
+	RenderQueue& queue = m_Queues[m_FramesSubmitted % frameCount];
+	queue.clear();
+	return queue;
+}
+
+void RenderThread::endFrame()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!m_Recording)
+		{
+			return;
+		}
+		m_Recording = false;
+		m_FramesSubmitted++;
+	}
+	m_FrameSubmitted.notify_one();
+}
+
+void RenderThread::threadMain()
+{
+	m_AcquireContext();
+
+	while (true)
+	{
+		RenderQueue* pQueue = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_FrameSubmitted.wait(lock, [&]() { return m_FramesDrawn < m_FramesSubmitted || m_Stopping; });
+			//Draw everything already submitted before honouring a stop
+			if (m_FramesDrawn == m_FramesSubmitted)
+			{
+				break;
+			}
+			pQueue = &m_Queues[m_FramesDrawn % m_Queues.size()];
+		}
+
+		//The main thread never touches a submitted queue, so it is drawn without holding the lock
+		m_RenderFrame(*pQueue);
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_FramesDrawn++;
+		}
+		m_FrameDrawn.notify_one();
+	}
+
+	m_ReleaseContext();
+}
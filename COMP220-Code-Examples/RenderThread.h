@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "RenderQueue.h"
+
+//Runs GL submission on its own thread so the main thread can build frame N+1 while frame N is drawn.
+//Frames are handed over as RenderQueues from a small ring, the ring size caps how far ahead the main thread can get.
+//The GL context must be released on the main thread before start() and is owned by the render thread until stop()
+class RenderThread
+{
+public:
+	RenderThread();
+	~RenderThread();
+
+	//acquireContext and releaseContext are called on the render thread to make the GL context current and to let go
+	//of it, renderFrame is called once per submitted frame and should execute the queue and present.
+	//maxFramesAhead is the latency cap, with 1 the main thread records one frame while the previous one draws
+	bool start(int maxFramesAhead, std::function<void()> acquireContext, std::function<void(RenderQueue&)> renderFrame,
+		std::function<void()> releaseContext);
+	//Waits for every submitted frame to be drawn and joins the thread, the context is released when this returns
+	void stop();
+
+	//Main thread, returns an empty queue to record the next frame into, blocking if the render thread is too far behind
+	RenderQueue& beginFrame();
+	//Main thread, hands the queue from beginFrame over to the render thread
+	void endFrame();
+
+	bool isRunning() const { return m_Running; };
+	//Total time the main thread spent blocked by the latency cap, in milliseconds
+	double getWaitTime() const { return m_WaitTime; };
+private:
+	void threadMain();
+
+	std::thread m_Thread;
+	std::mutex m_Mutex;
+	std::condition_variable m_FrameSubmitted;
+	std::condition_variable m_FrameDrawn;
+
+	std::function<void()> m_AcquireContext;
+	std::function<void(RenderQueue&)> m_RenderFrame;
+	std::function<void()> m_ReleaseContext;
+
+	std::vector<RenderQueue> m_Queues;
+	//Frames recorded and drawn so far, the queue for frame n is m_Queues[n % size]
+	unsigned int m_FramesSubmitted;
+	unsigned int m_FramesDrawn;
+	bool m_Recording;
+	bool m_Running;
+	bool m_Stopping;
+	double m_WaitTime;
+};
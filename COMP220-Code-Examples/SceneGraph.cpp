@@ -0,0 +1,397 @@
+#include "SceneGraph.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCENE_GRAPH_SSE 1
+#include <emmintrin.h>
+#endif
+
+//Column major, so each column of the result is the columns of a weighted by one column of b
+static inline void multiplyTransform(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+{
+#if SCENE_GRAPH_SSE
+	const float* pA = &a[0][0];
+	const float* pB = &b[0][0];
+	__m128 a0 = _mm_loadu_ps(pA);
+	__m128 a1 = _mm_loadu_ps(pA + 4);
+	__m128 a2 = _mm_loadu_ps(pA + 8);
+	__m128 a3 = _mm_loadu_ps(pA + 12);
+	__m128 columns[4];
+	for (int column = 0; column < 4; column++)
+	{
+		__m128 bColumn = _mm_loadu_ps(pB + column * 4);
+		__m128 result = _mm_mul_ps(a0, _mm_shuffle_ps(bColumn, bColumn, _MM_SHUFFLE(0, 0, 0, 0)));
+		result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_shuffle_ps(bColumn, bColumn, _MM_SHUFFLE(1, 1, 1, 1))));
+		result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_shuffle_ps(bColumn, bColumn, _MM_SHUFFLE(2, 2, 2, 2))));
+		result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_shuffle_ps(bColumn, bColumn, _MM_SHUFFLE(3, 3, 3, 3))));
+		columns[column] = result;
+	}
+	//Stored only once every column is done, so out may alias a or b
+	float* pOut = &out[0][0];
+	_mm_storeu_ps(pOut, columns[0]);
+	_mm_storeu_ps(pOut + 4, columns[1]);
+	_mm_storeu_ps(pOut + 8, columns[2]);
+	_mm_storeu_ps(pOut + 12, columns[3]);
+#else
+	out = a * b;
+#endif
+}
+
+static const glm::mat4 IDENTITY(1.0f);
+
+void multiplyTransforms(const glm::mat4* pA, const glm::mat4* pB, glm::mat4* pOut, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		multiplyTransform(pA[i], pB[i], pOut[i]);
+	}
+}
+
+SceneGraph::SceneGraph()
+{
+	m_OrderDirty = false;
+	m_AnyDirty = false;
+	m_SortCount = 0;
+}
+
+void SceneGraph::reserve(size_t count)
+{
+	m_Local.reserve(count);
+	m_World.reserve(count);
+	m_Parent.reserve(count);
+	m_Depth.reserve(count);
+	m_Dirty.reserve(count);
+	m_IndexToNode.reserve(count);
+	m_NodeToIndex.reserve(count);
+	m_ParentNode.reserve(count);
+	m_Destroyed.reserve(count);
+	m_Generation.reserve(count);
+}
+
+void SceneGraph::clear()
+{
+	m_Local.clear();
+	m_World.clear();
+	m_Parent.clear();
+	m_Depth.clear();
+	m_Dirty.clear();
+	m_IndexToNode.clear();
+	m_LevelStart.clear();
+	m_NodeToIndex.clear();
+	m_ParentNode.clear();
+	m_Destroyed.clear();
+	m_FreeNodes.clear();
+	m_UpdatedNodes.clear();
+	for (uint32_t& generation : m_Generation)
+	{
+		generation++;
+	}
+	m_OrderDirty = false;
+	m_AnyDirty = false;
+}
+
+SceneNode SceneGraph::create(SceneNode parent, const glm::mat4& localTransform)
+{
+	if (parent != INVALID_SCENE_NODE && !isValid(parent))
+	{
+		return INVALID_SCENE_NODE;
+	}
+
+	SceneNode node;
+	if (!m_FreeNodes.empty())
+	{
+		node.index = m_FreeNodes.back();
+		m_FreeNodes.pop_back();
+		m_ParentNode[node.index] = parent;
+		m_Destroyed[node.index] = 0;
+	}
+	else
+	{
+		node.index = (uint32_t)m_NodeToIndex.size();
+		m_NodeToIndex.push_back(0);
+		m_ParentNode.push_back(parent);
+		m_Destroyed.push_back(0);
+		if (node.index == m_Generation.size())
+		{
+			m_Generation.push_back(0);
+		}
+	}
+	node.generation = m_Generation[node.index];
+
+	uint32_t parentIndex = NO_PARENT;
+	uint32_t depth = 0;
+	if (parent != INVALID_SCENE_NODE)
+	{
+		parentIndex = m_NodeToIndex[parent.index];
+		depth = m_Depth[parentIndex] + 1;
+	}
+
+	//Appending keeps the arrays sorted as long as nodes arrive no shallower than the last one, as they do when a
+	//level or model is loaded top down
+	if (!m_Depth.empty() && depth < m_Depth.back())
+	{
+		m_OrderDirty = true;
+	}
+
+	m_NodeToIndex[node.index] = (uint32_t)m_Local.size();
+	m_Local.push_back(localTransform);
+	m_World.push_back(localTransform);
+	m_Parent.push_back(parentIndex);
+	m_Depth.push_back(depth);
+	m_Dirty.push_back(1);
+	m_IndexToNode.push_back(node);
+	m_AnyDirty = true;
+	if (!m_OrderDirty)
+	{
+		if (m_LevelStart.size() < depth + 2)
+		{
+			m_LevelStart.resize(depth + 2, m_LevelStart.empty() ? 0 : m_LevelStart.back());
+		}
+		m_LevelStart.back() = (uint32_t)m_Local.size();
+	}
+	return node;
+}
+
+void SceneGraph::destroy(SceneNode node)
+{
+	if (!isValid(node))
+	{
+		return;
+	}
+	m_Destroyed[node.index] = 1;
+	m_OrderDirty = true;
+}
+
+bool SceneGraph::setParent(SceneNode node, SceneNode parent)
+{
+	if (!isValid(node) || (parent != INVALID_SCENE_NODE && !isValid(parent)))
+	{
+		return false;
+	}
+	for (SceneNode ancestor = parent; ancestor != INVALID_SCENE_NODE; ancestor = m_ParentNode[ancestor.index])
+	{
+		if (ancestor == node)
+		{
+			return false;
+		}
+	}
+
+	m_ParentNode[node.index] = parent;
+	m_Dirty[m_NodeToIndex[node.index]] = 1;
+	m_OrderDirty = true;
+	m_AnyDirty = true;
+	return true;
+}
+
+void SceneGraph::setLocalTransform(SceneNode node, const glm::mat4& localTransform)
+{
+	if (!isValid(node))
+	{
+		return;
+	}
+	uint32_t index = m_NodeToIndex[node.index];
+	m_Local[index] = localTransform;
+	m_Dirty[index] = 1;
+	m_AnyDirty = true;
+}
+
+const glm::mat4& SceneGraph::getLocalTransform(SceneNode node) const
+{
+	return isValid(node) ? m_Local[m_NodeToIndex[node.index]] : IDENTITY;
+}
+
+const glm::mat4& SceneGraph::getWorldTransform(SceneNode node) const
+{
+	return isValid(node) ? m_World[m_NodeToIndex[node.index]] : IDENTITY;
+}
+
+SceneNode SceneGraph::getParent(SceneNode node) const
+{
+	return isValid(node) ? m_ParentNode[node.index] : INVALID_SCENE_NODE;
+}
+
+bool SceneGraph::isValid(SceneNode node) const
+{
+	return node.index < m_NodeToIndex.size() && m_Generation[node.index] == node.generation &&
+		m_NodeToIndex[node.index] != INVALID_INDEX && !m_Destroyed[node.index];
+}
+
+void SceneGraph::sortByDepth()
+{
+	//Depths from the handle parents, walking up until a node whose depth is known. Destroyed nodes and everything
+	//under them get DESTROYED_DEPTH and are dropped
+	const uint32_t UNKNOWN_DEPTH = 0xFFFFFFFF;
+	const uint32_t DESTROYED_DEPTH = 0xFFFFFFFE;
+	std::vector<uint32_t> nodeDepth(m_NodeToIndex.size(), UNKNOWN_DEPTH);
+	std::vector<uint32_t> chain;
+	uint32_t maxDepth = 0;
+	for (SceneNode node : m_IndexToNode)
+	{
+		uint32_t current = node.index;
+		uint32_t depth = 0;
+		while (true)
+		{
+			if (nodeDepth[current] != UNKNOWN_DEPTH)
+			{
+				depth = nodeDepth[current];
+				break;
+			}
+			chain.push_back(current);
+			if (m_Destroyed[current])
+			{
+				depth = DESTROYED_DEPTH;
+				break;
+			}
+			if (m_ParentNode[current] == INVALID_SCENE_NODE)
+			{
+				depth = UNKNOWN_DEPTH;
+				break;
+			}
+			current = m_ParentNode[current].index;
+		}
+		//Unwind from the top of the chain, depth is now that of the node above it
+		while (!chain.empty())
+		{
+			uint32_t below = chain.back();
+			chain.pop_back();
+			if (depth != DESTROYED_DEPTH)
+			{
+				depth = depth == UNKNOWN_DEPTH ? 0 : depth + 1;
+				maxDepth = std::max(maxDepth, depth);
+			}
+			nodeDepth[below] = depth;
+		}
+	}
+
+	//Counting sort by depth, stable so siblings keep their order and memory stays close to how it was created
+	std::vector<uint32_t> levelStart(maxDepth + 2, 0);
+	for (SceneNode node : m_IndexToNode)
+	{
+		if (nodeDepth[node.index] != DESTROYED_DEPTH)
+		{
+			levelStart[nodeDepth[node.index] + 1]++;
+		}
+	}
+	for (uint32_t depth = 0; depth <= maxDepth; depth++)
+	{
+		levelStart[depth + 1] += levelStart[depth];
+	}
+	size_t count = levelStart.back();
+
+	std::vector<glm::mat4> local(count);
+	std::vector<glm::mat4> world(count);
+	std::vector<uint8_t> dirty(count);
+	std::vector<SceneNode> indexToNode(count);
+	std::vector<uint32_t> depths(count);
+	std::vector<uint32_t> next(levelStart.begin(), levelStart.end() - 1);
+	for (size_t index = 0; index < m_IndexToNode.size(); index++)
+	{
+		SceneNode node = m_IndexToNode[index];
+		uint32_t depth = nodeDepth[node.index];
+		if (depth == DESTROYED_DEPTH)
+		{
+			m_NodeToIndex[node.index] = INVALID_INDEX;
+			m_Destroyed[node.index] = 1;
+			m_Generation[node.index]++;
+			m_FreeNodes.push_back(node.index);
+			continue;
+		}
+		uint32_t newIndex = next[depth]++;
+		local[newIndex] = m_Local[index];
+		world[newIndex] = m_World[index];
+		dirty[newIndex] = m_Dirty[index];
+		indexToNode[newIndex] = node;
+		depths[newIndex] = depth;
+		m_NodeToIndex[node.index] = newIndex;
+	}
+
+	m_Local.swap(local);
+	m_World.swap(world);
+	m_Dirty.swap(dirty);
+	m_IndexToNode.swap(indexToNode);
+	m_Depth.swap(depths);
+	m_Parent.resize(count);
+	for (size_t index = 0; index < count; index++)
+	{
+		SceneNode parent = m_ParentNode[m_IndexToNode[index].index];
+		m_Parent[index] = parent == INVALID_SCENE_NODE ? NO_PARENT : m_NodeToIndex[parent.index];
+	}
+	m_LevelStart.swap(levelStart);
+	if (count == 0)
+	{
+		m_LevelStart.clear();
+	}
+	m_OrderDirty = false;
+	m_SortCount++;
+}
+
+void SceneGraph::update()
+{
+	if (m_OrderDirty)
+	{
+		sortByDepth();
+	}
+
+	m_UpdatedNodes.clear();
+	m_DirtyIndices.clear();
+	m_DirtyLevelStart.clear();
+	if (!m_AnyDirty || m_Local.empty())
+	{
+		return;
+	}
+	m_AnyDirty = false;
+
+	//Parents come first, so one pass carries each flag all the way down its subtree. Indices are written
+	//unconditionally and the count only advanced for dirty nodes, which avoids a hard to predict branch
+	m_DirtyIndices.resize(m_Local.size());
+	uint32_t* pWriteIndices = m_DirtyIndices.data();
+	uint32_t dirtyCount = 0;
+	uint8_t* pDirty = m_Dirty.data();
+	const uint32_t* pParent = m_Parent.data();
+	for (size_t level = 0; level + 1 < m_LevelStart.size(); level++)
+	{
+		m_DirtyLevelStart.push_back(dirtyCount);
+		uint32_t end = m_LevelStart[level + 1];
+		for (uint32_t index = m_LevelStart[level]; index < end; index++)
+		{
+			if (level > 0)
+			{
+				pDirty[index] |= pDirty[pParent[index]];
+			}
+			pWriteIndices[dirtyCount] = index;
+			dirtyCount += pDirty[index];
+		}
+	}
+	m_DirtyLevelStart.push_back(dirtyCount);
+	m_DirtyIndices.resize(dirtyCount);
+
+	//Roots just copy their local transform, deeper levels only read world transforms finished a level before
+	glm::mat4* pWorld = m_World.data();
+	const glm::mat4* pLocal = m_Local.data();
+	for (uint32_t i = m_DirtyLevelStart[0]; i < m_DirtyLevelStart[1]; i++)
+	{
+		pWorld[m_DirtyIndices[i]] = pLocal[m_DirtyIndices[i]];
+	}
+	const uint32_t* pDirtyIndices = m_DirtyIndices.data();
+	for (size_t level = 1; level + 1 < m_DirtyLevelStart.size(); level++)
+	{
+		uint32_t levelStart = m_DirtyLevelStart[level];
+		getJobSystem().parallelFor(m_DirtyLevelStart[level + 1] - levelStart, [=](size_t begin, size_t end)
+		{
+			for (size_t i = levelStart + begin; i < levelStart + end; i++)
+			{
+				uint32_t index = pDirtyIndices[i];
+				multiplyTransform(pWorld[pParent[index]], pLocal[index], pWorld[index]);
+			}
+		}, 0, MIN_NODES_PER_JOB);
+	}
+
+	m_UpdatedNodes.reserve(m_DirtyIndices.size());
+	for (uint32_t index : m_DirtyIndices)
+	{
+		pDirty[index] = 0;
+		m_UpdatedNodes.push_back(m_IndexToNode[index]);
+	}
+}
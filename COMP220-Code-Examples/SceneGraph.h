@@ -0,0 +1,102 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//Slot in the graph's handle table plus the generation it was created in. The generation goes up each time a slot is
+//freed, so a handle to a destroyed node is recognised rather than reaching whatever replaced it
+struct SceneNode
+{
+	uint32_t index;
+	uint32_t generation;
+
+	bool operator==(const SceneNode& other) const { return index == other.index && generation == other.generation; };
+	bool operator!=(const SceneNode& other) const { return !(*this == other); };
+};
+const SceneNode INVALID_SCENE_NODE = { 0xFFFFFFFF, 0 };
+
+//pOut[i] = pA[i] * pB[i] for count matrices, with SSE where available. pOut may be either input
+void multiplyTransforms(const glm::mat4* pA, const glm::mat4* pB, glm::mat4* pOut, size_t count);
+
+//Transform hierarchy with the local and world matrices of every node in contiguous arrays sorted by depth, so
+//parents always come before their children and one pass from front to back brings every world matrix up to date.
+//Nodes are referred to by handles which stay the same when the arrays are re-sorted.
+//Changing a local transform marks just that node dirty, update() spreads the flag down to its descendants and
+//recomputes only those, in one batch of SIMD multiplies per depth shared out over the job system
+class SceneGraph
+{
+public:
+	//Each depth's dirty nodes are split into jobs of at least this many
+	static const size_t MIN_NODES_PER_JOB = 4096;
+
+	SceneGraph();
+
+	void reserve(size_t count);
+	void clear();
+
+	//Returns INVALID_SCENE_NODE if parent is not a valid node
+	SceneNode create(SceneNode parent = INVALID_SCENE_NODE, const glm::mat4& localTransform = glm::mat4(1.0f));
+	//Destroys the node and everything below it. The node's handle is invalid at once, its descendants' after the
+	//next update
+	void destroy(SceneNode node);
+	//Moves the node and its subtree under a new parent, or to the root with INVALID_SCENE_NODE.
+	//Fails if either handle is invalid, or if parent is the node itself or one of its descendants
+	bool setParent(SceneNode node, SceneNode parent);
+
+	//Invalid handles are ignored, and read back as identity with no parent
+	void setLocalTransform(SceneNode node, const glm::mat4& localTransform);
+	const glm::mat4& getLocalTransform(SceneNode node) const;
+	//As of the last update
+	const glm::mat4& getWorldTransform(SceneNode node) const;
+	SceneNode getParent(SceneNode node) const;
+	bool isValid(SceneNode node) const;
+
+	//Re-sorts if nodes were added out of order, moved or destroyed, then recomputes the world transforms of every
+	//dirty node and its descendants
+	void update();
+
+	//Nodes whose world transform was recomputed by the last update, in depth order
+	const std::vector<SceneNode>& getUpdatedNodes() const { return m_UpdatedNodes; };
+	size_t size() const { return m_Local.size(); };
+	unsigned int getDepthCount() const { return m_LevelStart.empty() ? 0 : (unsigned int)m_LevelStart.size() - 1; };
+	//World transforms in depth order, only valid until the next update which changes the hierarchy
+	const glm::mat4* getWorldTransforms() const { return m_World.data(); };
+	unsigned int getSortCount() const { return m_SortCount; };
+private:
+	static const uint32_t NO_PARENT = 0xFFFFFFFF;
+	static const uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+	void sortByDepth();
+
+	//Indexed by position in depth order
+	std::vector<glm::mat4> m_Local;
+	std::vector<glm::mat4> m_World;
+	std::vector<uint32_t> m_Parent;
+	std::vector<uint32_t> m_Depth;
+	std::vector<uint8_t> m_Dirty;
+	std::vector<SceneNode> m_IndexToNode;
+	//First index of each depth, with one past the last node at the end
+	std::vector<uint32_t> m_LevelStart;
+
+	//Indexed by handle slot, the parent here is the truth while the arrays above wait to be re-sorted
+	std::vector<uint32_t> m_NodeToIndex;
+	std::vector<SceneNode> m_ParentNode;
+	std::vector<uint8_t> m_Destroyed;
+	//Kept through clear, so handles from before it stay invalid
+	std::vector<uint32_t> m_Generation;
+	std::vector<uint32_t> m_FreeNodes;
+
+	//Scratch for update, kept to avoid reallocating each frame. Dirty indices are grouped by depth, since every
+	//node of one depth only reads from shallower ones they can be computed in any order or in parallel
+	std::vector<uint32_t> m_DirtyIndices;
+	std::vector<uint32_t> m_DirtyLevelStart;
+	std::vector<SceneNode> m_UpdatedNodes;
+
+	bool m_OrderDirty;
+	//Anything marked dirty since the last update, so an unchanged scene costs nothing
+	bool m_AnyDirty;
+	unsigned int m_SortCount;
+};
@@ -1,85 +1,112 @@
 #include "Shader.h"
+#include "ProgramBinaryCache.h"
+#include "ShaderPreprocessor.h"
 
 
-GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path)
+bool readShaderFile(const char* file_path, std::string& code)
 {
+	// Goes through the shared preprocessor so #include is resolved and unchanged files come from memory
+	return getShaderPreprocessor().preprocess(file_path, code);
+}
 
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+void printShaderInfoLog(GLuint shaderID)
+{
+	int InfoLogLength;
+	glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if (InfoLogLength > 0) {
+		std::vector<char> ShaderErrorMessage(InfoLogLength + 1);
+		glGetShaderInfoLog(shaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+		printf("%s\n", &ShaderErrorMessage[0]);
+	}
+}
 
+void printProgramInfoLog(GLuint programID)
+{
+	int InfoLogLength;
+	glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if (InfoLogLength > 0) {
+		std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
+		glGetProgramInfoLog(programID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+		printf("%s\n", &ProgramErrorMessage[0]);
+	}
+}
+
+GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path)
+{
 	// Read the Vertex Shader code from the file
 	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if (VertexShaderStream.is_open()) {
-		std::stringstream sstr;
-		sstr << VertexShaderStream.rdbuf();
-		VertexShaderCode = sstr.str();
-		VertexShaderStream.close();
-	}
-	else {
-		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
+	if (!readShaderFile(vertex_file_path, VertexShaderCode)) {
 		getchar();
 		return 0;
 	}
 
 	// Read the Fragment Shader code from the file
 	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if (FragmentShaderStream.is_open()) {
-		std::stringstream sstr;
-		sstr << FragmentShaderStream.rdbuf();
-		FragmentShaderCode = sstr.str();
-		FragmentShaderStream.close();
+	if (!readShaderFile(fragment_file_path, FragmentShaderCode)) {
+		return 0;
 	}
 
+	return LoadShadersFromSource(VertexShaderCode, FragmentShaderCode, vertex_file_path, fragment_file_path);
+}
+
+GLuint LoadShadersFromSource(const std::string& VertexShaderCode, const std::string& FragmentShaderCode, const char* vertex_name, const char* fragment_name)
+{
 	GLint Result = GL_FALSE;
-	int InfoLogLength;
+
+	// Try the program binary cache before compiling anything
+	bool useBinaryCache = isProgramBinaryCacheSupported();
+	uint64_t SourceHash = 0;
+	if (useBinaryCache) {
+		SourceHash = hashProgramSources({ VertexShaderCode, FragmentShaderCode });
+		GLuint CachedProgramID = glCreateProgram();
+		if (loadProgramBinary(SourceHash, CachedProgramID)) {
+			printf("Loaded cached program : %s, %s\n", vertex_name, fragment_name);
+			return CachedProgramID;
+		}
+		glDeleteProgram(CachedProgramID);
+	}
+
+	// Create the shaders
+	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
 
 	// Compile Vertex Shader
-	printf("Compiling shader : %s\n", vertex_file_path);
+	printf("Compiling shader : %s\n", vertex_name);
 	char const* VertexSourcePointer = VertexShaderCode.c_str();
 	glShaderSource(VertexShaderID, 1, &VertexSourcePointer, NULL);
 	glCompileShader(VertexShaderID);
 
 	// Check Vertex Shader
 	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if (InfoLogLength > 0) {
-		std::vector<char> VertexShaderErrorMessage(InfoLogLength + 1);
-		glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-		printf("%s\n", &VertexShaderErrorMessage[0]);
-	}
+	printShaderInfoLog(VertexShaderID);
 
 	// Compile Fragment Shader
-	printf("Compiling shader : %s\n", fragment_file_path);
+	printf("Compiling shader : %s\n", fragment_name);
 	char const* FragmentSourcePointer = FragmentShaderCode.c_str();
 	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, NULL);
 	glCompileShader(FragmentShaderID);
 
 	// Check Fragment Shader
 	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if (InfoLogLength > 0) {
-		std::vector<char> FragmentShaderErrorMessage(InfoLogLength + 1);
-		glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-		printf("%s\n", &FragmentShaderErrorMessage[0]);
-	}
+	printShaderInfoLog(FragmentShaderID);
 
 	// Link the program
 	printf("Linking program\n");
 	GLuint ProgramID = glCreateProgram();
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
+	if (useBinaryCache) {
+		glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 	glLinkProgram(ProgramID);
 
 	// Check the program
 	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if (InfoLogLength > 0) {
-		std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
-		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-		printf("%s\n", &ProgramErrorMessage[0]);
+	printProgramInfoLog(ProgramID);
+
+	// Store the binary so the next launch can skip compilation
+	if (useBinaryCache && Result == GL_TRUE) {
+		saveProgramBinary(SourceHash, ProgramID);
 	}
 
 	glDetachShader(ProgramID, VertexShaderID);
@@ -7,4 +7,11 @@
 #include <sstream>
 #include <vector>
 
-GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path);
\ No newline at end of file
+GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path);
+//Same as LoadShaders for sources which are already in memory, the names are only used in log messages
+GLuint LoadShadersFromSource(const std::string& VertexShaderCode, const std::string& FragmentShaderCode, const char* vertex_name, const char* fragment_name);
+
+//Helpers shared by LoadShaders and the batched loader, readShaderFile expands #include directives
+bool readShaderFile(const char* file_path, std::string& code);
+void printShaderInfoLog(GLuint shaderID);
+void printProgramInfoLog(GLuint programID);
\ No newline at end of file
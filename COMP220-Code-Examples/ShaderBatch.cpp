@@ -0,0 +1,267 @@
+#include "ShaderBatch.h"
+#include "Shader.h"
+#include "ProgramBinaryCache.h"
+
+#include <SDL.h>
+
+ShaderBatch::ShaderBatch()
+{
+	m_MaxCompilerThreads = 0xFFFFFFFF;
+	m_UseBinaryCache = false;
+	m_SubmitTime = 0;
+	m_CompileTime = 0.0;
+}
+
+ShaderBatch::~ShaderBatch()
+{
+	destroy();
+}
+
+void ShaderBatch::setMaxCompilerThreads(GLuint threads)
+{
+	m_MaxCompilerThreads = threads;
+}
+
+bool ShaderBatch::hasParallelCompile() const
+{
+	return GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+}
+
+int ShaderBatch::add(const char* vertex_file_path, const char* fragment_file_path)
+{
+	std::string vertexCode;
+	std::string fragmentCode;
+	if (!readShaderFile(vertex_file_path, vertexCode) || !readShaderFile(fragment_file_path, fragmentCode))
+	{
+		return -1;
+	}
+	return addSource(std::string(vertex_file_path) + ", " + fragment_file_path, vertexCode, fragmentCode);
+}
+
+int ShaderBatch::addSource(const std::string& name, const std::string& vertexCode, const std::string& fragmentCode)
+{
+	PendingProgram program;
+	program.name = name;
+	program.vertexCode = vertexCode;
+	program.fragmentCode = fragmentCode;
+	m_Programs.push_back(program);
+	return (int)m_Programs.size() - 1;
+}
+
+void ShaderBatch::submit()
+{
+	bool anyPending = false;
+	for (const PendingProgram& program : m_Programs)
+	{
+		anyPending = anyPending || !program.submitted;
+	}
+	if (!anyPending)
+	{
+		return;
+	}
+
+	if (GLEW_KHR_parallel_shader_compile)
+	{
+		glMaxShaderCompilerThreadsKHR(m_MaxCompilerThreads);
+	}
+	else if (GLEW_ARB_parallel_shader_compile)
+	{
+		glMaxShaderCompilerThreadsARB(m_MaxCompilerThreads);
+	}
+
+	m_UseBinaryCache = isProgramBinaryCacheSupported();
+	m_SubmitTime = SDL_GetPerformanceCounter();
+	m_CompileTime = 0.0;
+
+	//First pass kicks off every compile, nothing in here may query compile or link status
+	for (PendingProgram& program : m_Programs)
+	{
+		if (program.submitted)
+		{
+			continue;
+		}
+
+		program.programID = glCreateProgram();
+		if (m_UseBinaryCache)
+		{
+			program.sourceHash = hashProgramSources({ program.vertexCode, program.fragmentCode });
+			//glProgramBinary does not go through the compiler so it is cheap to do inline
+			if (loadProgramBinary(program.sourceHash, program.programID))
+			{
+				program.submitted = true;
+				program.fromBinaryCache = true;
+				continue;
+			}
+			glDeleteProgram(program.programID);
+			program.programID = glCreateProgram();
+		}
+
+		const char* vertexSourcePointer = program.vertexCode.c_str();
+		program.vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(program.vertexShaderID, 1, &vertexSourcePointer, NULL);
+		glCompileShader(program.vertexShaderID);
+
+		const char* fragmentSourcePointer = program.fragmentCode.c_str();
+		program.fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(program.fragmentShaderID, 1, &fragmentSourcePointer, NULL);
+		glCompileShader(program.fragmentShaderID);
+	}
+
+	//Second pass queues the links, the driver resolves the compiles first
+	for (PendingProgram& program : m_Programs)
+	{
+		if (program.submitted)
+		{
+			continue;
+		}
+
+		glAttachShader(program.programID, program.vertexShaderID);
+		glAttachShader(program.programID, program.fragmentShaderID);
+		if (m_UseBinaryCache)
+		{
+			glProgramParameteri(program.programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+		glLinkProgram(program.programID);
+		program.submitted = true;
+	}
+}
+
+bool ShaderBatch::isComplete()
+{
+	bool parallel = hasParallelCompile();
+	bool complete = true;
+	for (PendingProgram& program : m_Programs)
+	{
+		if (program.finished)
+		{
+			continue;
+		}
+		if (!program.submitted)
+		{
+			complete = false;
+			continue;
+		}
+
+		//Without the extension any status query blocks, so only report done once everything has been waited on
+		GLint status = GL_TRUE;
+		if (parallel)
+		{
+			glGetProgramiv(program.programID, GL_COMPLETION_STATUS_KHR, &status);
+		}
+		if (status == GL_TRUE && parallel)
+		{
+			finish(program);
+		}
+		else
+		{
+			complete = false;
+		}
+	}
+
+	if (complete && m_CompileTime == 0.0 && m_SubmitTime != 0)
+	{
+		m_CompileTime = (double)(SDL_GetPerformanceCounter() - m_SubmitTime) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+	}
+	return complete;
+}
+
+bool ShaderBatch::wait()
+{
+	submit();
+
+	bool allLinked = true;
+	for (PendingProgram& program : m_Programs)
+	{
+		if (!program.finished)
+		{
+			finish(program);
+		}
+		allLinked = allLinked && program.linked;
+	}
+
+	//Reported by callers which care, such as the shader_compile benchmark, through getCompileTime
+	if (m_CompileTime == 0.0 && m_SubmitTime != 0)
+	{
+		m_CompileTime = (double)(SDL_GetPerformanceCounter() - m_SubmitTime) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+	}
+	return allLinked;
+}
+
+void ShaderBatch::finish(PendingProgram& program)
+{
+	GLint Result = GL_FALSE;
+	glGetProgramiv(program.programID, GL_LINK_STATUS, &Result);
+	program.linked = Result == GL_TRUE;
+
+	if (!program.linked)
+	{
+		printf("Linking program %s failed\n", program.name.c_str());
+		if (program.vertexShaderID != 0)
+		{
+			printShaderInfoLog(program.vertexShaderID);
+			printShaderInfoLog(program.fragmentShaderID);
+		}
+		printProgramInfoLog(program.programID);
+	}
+	else if (m_UseBinaryCache && !program.fromBinaryCache)
+	{
+		saveProgramBinary(program.sourceHash, program.programID);
+	}
+
+	if (program.vertexShaderID != 0)
+	{
+		glDetachShader(program.programID, program.vertexShaderID);
+		glDetachShader(program.programID, program.fragmentShaderID);
+		glDeleteShader(program.vertexShaderID);
+		glDeleteShader(program.fragmentShaderID);
+		program.vertexShaderID = 0;
+		program.fragmentShaderID = 0;
+	}
+
+	if (!program.linked)
+	{
+		glDeleteProgram(program.programID);
+		program.programID = 0;
+	}
+
+	//The sources are no longer needed once the program exists
+	program.vertexCode.clear();
+	program.vertexCode.shrink_to_fit();
+	program.fragmentCode.clear();
+	program.fragmentCode.shrink_to_fit();
+	program.finished = true;
+}
+
+GLuint ShaderBatch::getProgram(int index) const
+{
+	if (index < 0 || index >= (int)m_Programs.size() || !m_Programs[index].finished)
+	{
+		return 0;
+	}
+	return m_Programs[index].programID;
+}
+
+void ShaderBatch::release()
+{
+	for (PendingProgram& program : m_Programs)
+	{
+		program.programID = 0;
+	}
+}
+
+void ShaderBatch::destroy()
+{
+	for (PendingProgram& program : m_Programs)
+	{
+		if (program.vertexShaderID != 0)
+		{
+			glDeleteShader(program.vertexShaderID);
+			glDeleteShader(program.fragmentShaderID);
+		}
+		if (program.programID != 0)
+		{
+			glDeleteProgram(program.programID);
+		}
+	}
+	m_Programs.clear();
+}
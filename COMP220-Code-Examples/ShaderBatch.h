@@ -0,0 +1,66 @@
+#pragma once
+
+#include <GL\glew.h>
+#include <SDL_opengl.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Compiles many programs at once. Every compile and link is submitted before any status is queried,
+//so drivers with KHR/ARB_parallel_shader_compile can spread the work over their compiler threads
+class ShaderBatch
+{
+public:
+	ShaderBatch();
+	~ShaderBatch();
+
+	//Number of driver compiler threads to ask for, 0xFFFFFFFF lets the driver decide
+	void setMaxCompilerThreads(GLuint threads);
+
+	//Queues a program and returns its index in the batch, or -1 if a source file could not be read
+	int add(const char* vertex_file_path, const char* fragment_file_path);
+	int addSource(const std::string& name, const std::string& vertexCode, const std::string& fragmentCode);
+
+	//Submits everything queued so far without waiting on the driver
+	void submit();
+	//Non blocking, true once every program has finished linking. Without parallel compile there is no way to ask
+	//the driver without blocking, so this stays false and callers must finish with wait()
+	bool isComplete();
+	//Blocks until all programs have linked, prints any errors and returns false if one failed
+	bool wait();
+
+	//Program for the given index, 0 if it failed to link
+	GLuint getProgram(int index) const;
+	size_t getProgramCount() const { return m_Programs.size(); };
+	//Milliseconds between the last submit and its programs completing, 0 until they have
+	double getCompileTime() const { return m_CompileTime; };
+
+	//Releases ownership of the programs, the caller becomes responsible for deleting them
+	void release();
+	void destroy();
+private:
+	struct PendingProgram
+	{
+		std::string name;
+		std::string vertexCode;
+		std::string fragmentCode;
+		GLuint vertexShaderID = 0;
+		GLuint fragmentShaderID = 0;
+		GLuint programID = 0;
+		uint64_t sourceHash = 0;
+		bool submitted = false;
+		bool fromBinaryCache = false;
+		bool finished = false;
+		bool linked = false;
+	};
+
+	bool hasParallelCompile() const;
+	void finish(PendingProgram& program);
+
+	std::vector<PendingProgram> m_Programs;
+	GLuint m_MaxCompilerThreads;
+	bool m_UseBinaryCache;
+	uint64_t m_SubmitTime;
+	double m_CompileTime;
+};
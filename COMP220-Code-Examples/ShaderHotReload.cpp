@@ -0,0 +1,298 @@
+#include "ShaderHotReload.h"
+#include "GLStateCache.h"
+#include "Shader.h"
+#include "ShaderPreprocessor.h"
+
+#include <SDL.h>
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <set>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+ShaderHotReload::ShaderHotReload()
+{
+	m_Running = false;
+	m_ReloadCount = 0;
+	m_FailedCount = 0;
+	m_StallTime = 0.0;
+}
+
+ShaderHotReload::~ShaderHotReload()
+{
+	stop();
+	for (WatchedProgram& program : m_Programs)
+	{
+		delete program.pBatch;
+	}
+}
+
+void ShaderHotReload::watch(GLuint* pProgramID, const std::string& vertexPath, const std::string& fragmentPath)
+{
+	//The watch thread reads m_Programs, so programs have to be registered before it starts
+	if (m_Running)
+	{
+		printf("ShaderHotReload::watch called after start, %s will not be reloaded\n", vertexPath.c_str());
+		return;
+	}
+
+	WatchedProgram program;
+	program.pProgramID = pProgramID;
+	program.vertexPath = normaliseShaderPath(vertexPath);
+	program.fragmentPath = normaliseShaderPath(fragmentPath);
+	m_Programs.push_back(program);
+}
+
+void ShaderHotReload::watch(ShaderProgram* pProgram, const std::string& vertexPath, const std::string& fragmentPath)
+{
+	watch((GLuint*)nullptr, vertexPath, fragmentPath);
+	if (!m_Running)
+	{
+		m_Programs.back().pProgram = pProgram;
+	}
+}
+
+void ShaderHotReload::start()
+{
+	if (m_Running || m_Programs.empty())
+	{
+		return;
+	}
+	m_Running = true;
+	m_Thread = std::thread(&ShaderHotReload::watchThread, this);
+}
+
+void ShaderHotReload::stop()
+{
+	m_Running = false;
+	if (m_Thread.joinable())
+	{
+		m_Thread.join();
+	}
+}
+
+std::set<std::string> ShaderHotReload::collectWatchedFiles()
+{
+	std::set<std::string> files;
+	for (const WatchedProgram& program : m_Programs)
+	{
+		files.insert(program.vertexPath);
+		files.insert(program.fragmentPath);
+		for (const std::string& dependency : getShaderPreprocessor().getDependencies(program.vertexPath))
+		{
+			files.insert(dependency);
+		}
+		for (const std::string& dependency : getShaderPreprocessor().getDependencies(program.fragmentPath))
+		{
+			files.insert(dependency);
+		}
+	}
+	return files;
+}
+
+void ShaderHotReload::onFileChanged(const std::string& path)
+{
+	//Only programs whose sources include the changed file, directly or not, are rebuilt
+	std::vector<std::string> dependents = getShaderPreprocessor().getDependents(path);
+	std::set<std::string> affectedRoots(dependents.begin(), dependents.end());
+	affectedRoots.insert(path);
+
+	//Runs on the watch thread, reading the sources here keeps file IO off the frame
+	for (size_t i = 0; i < m_Programs.size(); i++)
+	{
+		const WatchedProgram& program = m_Programs[i];
+		if (!affectedRoots.count(program.vertexPath) && !affectedRoots.count(program.fragmentPath))
+		{
+			continue;
+		}
+
+		ReloadRequest request;
+		request.programIndex = i;
+		if (!readShaderFile(program.vertexPath.c_str(), request.vertexCode) ||
+			!readShaderFile(program.fragmentPath.c_str(), request.fragmentCode))
+		{
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lock(m_RequestMutex);
+		//A newer edit supersedes any request which has not been picked up yet
+		for (auto it = m_Requests.begin(); it != m_Requests.end(); ++it)
+		{
+			if (it->programIndex == i)
+			{
+				m_Requests.erase(it);
+				break;
+			}
+		}
+		m_Requests.push_back(request);
+	}
+}
+
+#ifdef __linux__
+void ShaderHotReload::watchThread()
+{
+	int inotifyFD = inotify_init1(IN_NONBLOCK);
+	if (inotifyFD < 0)
+	{
+		printf("inotify_init1 failed, shader hot reload is disabled\n");
+		return;
+	}
+
+	//Editors often save by writing a new file and renaming it over the old one, so watch the directories.
+	//Adding a directory which is already watched just returns its existing descriptor
+	std::map<int, std::string> directories;
+	auto addWatches = [&]()
+	{
+		for (const std::string& file : collectWatchedFiles())
+		{
+			std::string directory = std::filesystem::path(file).parent_path().string();
+			int watchDescriptor = inotify_add_watch(inotifyFD, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+			if (watchDescriptor >= 0)
+			{
+				directories[watchDescriptor] = directory;
+			}
+		}
+	};
+	addWatches();
+
+	alignas(inotify_event) char buffer[4096];
+	while (m_Running)
+	{
+		//Wake up regularly so stop() is never left waiting on an idle directory
+		pollfd pollDescriptor = { inotifyFD, POLLIN, 0 };
+		if (poll(&pollDescriptor, 1, 100) <= 0)
+		{
+			continue;
+		}
+
+		ssize_t length;
+		while ((length = read(inotifyFD, buffer, sizeof(buffer))) > 0)
+		{
+			std::set<std::string> changed;
+			for (char* pPosition = buffer; pPosition < buffer + length;)
+			{
+				inotify_event* pEvent = (inotify_event*)pPosition;
+				if (pEvent->len > 0 && directories.count(pEvent->wd))
+				{
+					changed.insert((std::filesystem::path(directories[pEvent->wd]) / pEvent->name).string());
+				}
+				pPosition += sizeof(inotify_event) + pEvent->len;
+			}
+			for (const std::string& path : changed)
+			{
+				onFileChanged(path);
+			}
+		}
+
+		//An edit may have added an include from a directory we are not watching yet
+		addWatches();
+	}
+
+	close(inotifyFD);
+}
+#else
+void ShaderHotReload::watchThread()
+{
+	//No inotify here, fall back to polling modification times
+	std::map<std::string, std::filesystem::file_time_type> modifiedTimes;
+	while (m_Running)
+	{
+		//Pick up includes added since the last poll, their current time is the baseline
+		for (const std::string& file : collectWatchedFiles())
+		{
+			if (!modifiedTimes.count(file))
+			{
+				std::error_code error;
+				modifiedTimes[file] = std::filesystem::last_write_time(file, error);
+			}
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+		for (auto& file : modifiedTimes)
+		{
+			std::error_code error;
+			std::filesystem::file_time_type modifiedTime = std::filesystem::last_write_time(file.first, error);
+			if (!error && modifiedTime != file.second)
+			{
+				file.second = modifiedTime;
+				onFileChanged(file.first);
+			}
+		}
+	}
+}
+#endif
+
+void ShaderHotReload::update()
+{
+	std::vector<ReloadRequest> requests;
+	{
+		std::lock_guard<std::mutex> lock(m_RequestMutex);
+		requests.swap(m_Requests);
+	}
+
+	//Kick off compiles for anything that changed, without waiting on them
+	for (ReloadRequest& request : requests)
+	{
+		WatchedProgram& program = m_Programs[request.programIndex];
+		delete program.pBatch;
+		program.pBatch = new ShaderBatch();
+		program.pBatch->addSource(program.vertexPath + ", " + program.fragmentPath, request.vertexCode, request.fragmentCode);
+		program.pBatch->submit();
+		program.framesInFlight = 0;
+		printf("Reloading shader : %s, %s\n", program.vertexPath.c_str(), program.fragmentPath.c_str());
+	}
+
+	//Swap in any program which has finished, this is the frame boundary so nothing is using the old one
+	for (WatchedProgram& program : m_Programs)
+	{
+		if (program.pBatch == nullptr)
+		{
+			continue;
+		}
+
+		//Without parallel compile isComplete never reports done, give the driver a few frames then wait on it
+		program.framesInFlight++;
+		bool done = program.pBatch->isComplete();
+		if (!done && program.framesInFlight > BLOCKING_WAIT_FRAMES && !(GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile))
+		{
+			uint64_t waitStart = SDL_GetPerformanceCounter();
+			program.pBatch->wait();
+			m_StallTime += (double)(SDL_GetPerformanceCounter() - waitStart) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+			done = true;
+		}
+		if (!done)
+		{
+			continue;
+		}
+
+		GLuint newProgramID = program.pBatch->getProgram(0);
+		if (newProgramID != 0)
+		{
+			program.pBatch->release();
+			if (program.pProgram != nullptr)
+			{
+				program.pProgram->reload(newProgramID);
+			}
+			else
+			{
+				getGLState().deleteProgram(*program.pProgramID);
+				*program.pProgramID = newProgramID;
+			}
+			m_ReloadCount++;
+		}
+		else
+		{
+			//Keep running with the last good program
+			printf("Shader reload failed, keeping the previous program\n");
+			m_FailedCount++;
+		}
+		delete program.pBatch;
+		program.pBatch = nullptr;
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <GL\glew.h>
+#include <SDL_opengl.h>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ShaderBatch.h"
+#include "ShaderProgram.h"
+
+//Watches shader source files, and anything they #include, and recompiles programs whose files change. Files are watched and read on a
+//background thread, compiles go through ShaderBatch so they never block a frame when the driver supports
+//parallel compile, and the new program only replaces the old one at a frame boundary once it has linked.
+//Limitation: without KHR/ARB_parallel_shader_compile GL has no way to ask whether a link has finished without
+//blocking, so update() waits on it BLOCKING_WAIT_FRAMES frames after submitting. Drivers which compile on their own
+//threads are usually done by then, others stall that frame for the whole compile and link; getStallTime reports it
+class ShaderHotReload
+{
+public:
+	//Frames given to a compile before update() blocks on it, only without parallel compile
+	static const unsigned int BLOCKING_WAIT_FRAMES = 4;
+
+	ShaderHotReload();
+	~ShaderHotReload();
+
+	//Registers a program, the GLuint pointed to is replaced in update() whenever a new version links
+	void watch(GLuint* pProgramID, const std::string& vertexPath, const std::string& fragmentPath);
+	//As above but the program is reflected again after each reload
+	void watch(ShaderProgram* pProgram, const std::string& vertexPath, const std::string& fragmentPath);
+
+	void start();
+	void stop();
+
+	//Call once per frame, before any drawing, from the thread which owns the GL context
+	void update();
+
+	unsigned int getReloadCount() const { return m_ReloadCount; };
+	unsigned int getFailedCount() const { return m_FailedCount; };
+	//Milliseconds update() has spent blocked on compiles, always 0 with parallel compile
+	double getStallTime() const { return m_StallTime; };
+private:
+	struct WatchedProgram
+	{
+		GLuint* pProgramID = nullptr;
+		ShaderProgram* pProgram = nullptr;
+		std::string vertexPath;
+		std::string fragmentPath;
+		//Compile in flight for this program, null when idle
+		ShaderBatch* pBatch = nullptr;
+		unsigned int framesInFlight = 0;
+	};
+
+	struct ReloadRequest
+	{
+		size_t programIndex;
+		std::string vertexCode;
+		std::string fragmentCode;
+	};
+
+	void watchThread();
+	void onFileChanged(const std::string& path);
+	//Every file the watched programs depend on, includes and all
+	std::set<std::string> collectWatchedFiles();
+
+	std::vector<WatchedProgram> m_Programs;
+
+	std::thread m_Thread;
+	std::atomic<bool> m_Running;
+	std::mutex m_RequestMutex;
+	std::vector<ReloadRequest> m_Requests;
+
+	unsigned int m_ReloadCount;
+	unsigned int m_FailedCount;
+	double m_StallTime;
+};
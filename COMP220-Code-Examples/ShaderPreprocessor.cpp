@@ -0,0 +1,202 @@
+#include "ShaderPreprocessor.h"
+
+#include <fstream>
+#include <sstream>
+
+//Deep enough for any sane include tree, stops runaway recursion through odd relative paths
+static const int MAX_INCLUDE_DEPTH = 32;
+
+std::string normaliseShaderPath(const std::string& path)
+{
+	std::error_code error;
+	std::filesystem::path absolutePath = std::filesystem::absolute(path, error);
+	if (error)
+	{
+		return path;
+	}
+	return absolutePath.lexically_normal().string();
+}
+
+//Returns true and fills in the file name if the line is an #include directive
+static bool parseInclude(const std::string& line, std::string& includeName)
+{
+	size_t position = line.find_first_not_of(" \t");
+	if (position == std::string::npos || line[position] != '#')
+	{
+		return false;
+	}
+	position = line.find_first_not_of(" \t", position + 1);
+	if (position == std::string::npos || line.compare(position, 7, "include") != 0)
+	{
+		return false;
+	}
+	position = line.find_first_of("\"<", position + 7);
+	if (position == std::string::npos)
+	{
+		return false;
+	}
+
+	char closing = (line[position] == '"') ? '"' : '>';
+	size_t end = line.find(closing, position + 1);
+	if (end == std::string::npos)
+	{
+		return false;
+	}
+	includeName = line.substr(position + 1, end - position - 1);
+	return true;
+}
+
+ShaderPreprocessor::ShaderPreprocessor()
+{
+	m_FileReads = 0;
+	m_CacheHits = 0;
+}
+
+ShaderPreprocessor::~ShaderPreprocessor()
+{
+}
+
+bool ShaderPreprocessor::readFile(const std::string& path, std::string& contents)
+{
+	std::error_code error;
+	std::filesystem::file_time_type modifiedTime = std::filesystem::last_write_time(path, error);
+	if (error)
+	{
+		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", path.c_str());
+		return false;
+	}
+
+	auto it = m_Files.find(path);
+	if (it != m_Files.end() && it->second.modifiedTime == modifiedTime)
+	{
+		m_CacheHits++;
+		contents = it->second.contents;
+		return true;
+	}
+
+	std::ifstream ShaderStream(path, std::ios::in);
+	if (!ShaderStream.is_open())
+	{
+		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", path.c_str());
+		return false;
+	}
+	std::stringstream sstr;
+	sstr << ShaderStream.rdbuf();
+
+	m_FileReads++;
+	CachedFile& file = m_Files[path];
+	file.modifiedTime = modifiedTime;
+	file.contents = sstr.str();
+	contents = file.contents;
+	return true;
+}
+
+bool ShaderPreprocessor::expand(const std::string& path, std::string& output, std::set<std::string>& included, int depth)
+{
+	if (depth > MAX_INCLUDE_DEPTH)
+	{
+		printf("Include depth exceeded in %s\n", path.c_str());
+		return false;
+	}
+	included.insert(path);
+
+	std::string contents;
+	if (!readFile(path, contents))
+	{
+		return false;
+	}
+
+	std::filesystem::path directory = std::filesystem::path(path).parent_path();
+	std::istringstream lines(contents);
+	std::string line;
+	std::string includeName;
+	while (std::getline(lines, line))
+	{
+		if (!parseInclude(line, includeName))
+		{
+			output += line;
+			output += '\n';
+			continue;
+		}
+
+		std::string includePath = normaliseShaderPath((directory / includeName).string());
+		if (included.count(includePath))
+		{
+			continue;
+		}
+		if (!expand(includePath, output, included, depth + 1))
+		{
+			printf("Included from %s\n", path.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ShaderPreprocessor::preprocess(const std::string& path, std::string& output)
+{
+	std::string rootPath = normaliseShaderPath(path);
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	std::set<std::string> included;
+	output.clear();
+	bool result = expand(rootPath, output, included, 0);
+
+	//Record dependencies even on failure, fixing a broken include should still trigger a rebuild
+	setDependencies(rootPath, included);
+	return result;
+}
+
+void ShaderPreprocessor::setDependencies(const std::string& rootPath, const std::set<std::string>& dependencies)
+{
+	auto it = m_Dependencies.find(rootPath);
+	if (it != m_Dependencies.end())
+	{
+		for (const std::string& dependency : it->second)
+		{
+			m_Dependents[dependency].erase(rootPath);
+		}
+	}
+
+	m_Dependencies[rootPath] = dependencies;
+	for (const std::string& dependency : dependencies)
+	{
+		m_Dependents[dependency].insert(rootPath);
+	}
+}
+
+std::vector<std::string> ShaderPreprocessor::getDependents(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto it = m_Dependents.find(normaliseShaderPath(path));
+	if (it == m_Dependents.end())
+	{
+		return std::vector<std::string>();
+	}
+	return std::vector<std::string>(it->second.begin(), it->second.end());
+}
+
+std::vector<std::string> ShaderPreprocessor::getDependencies(const std::string& rootPath)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto it = m_Dependencies.find(normaliseShaderPath(rootPath));
+	if (it == m_Dependencies.end())
+	{
+		return std::vector<std::string>();
+	}
+	return std::vector<std::string>(it->second.begin(), it->second.end());
+}
+
+void ShaderPreprocessor::clear()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Files.clear();
+	m_Dependencies.clear();
+	m_Dependents.clear();
+}
+
+ShaderPreprocessor& getShaderPreprocessor()
+{
+	static ShaderPreprocessor preprocessor;
+	return preprocessor;
+}
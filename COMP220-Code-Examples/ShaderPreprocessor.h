@@ -0,0 +1,58 @@
+#pragma once
+
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//Absolute, normalised form of a path, used as the key everywhere shader files are tracked
+std::string normaliseShaderPath(const std::string& path);
+
+//Resolves #include "file" directives in shader sources. File contents are cached and only read again when the
+//modification time changes, and every root file remembers what it includes so that editing a shared snippet can
+//be traced back to exactly the shaders which use it. Safe to use from the hot reload thread and the main thread
+class ShaderPreprocessor
+{
+public:
+	ShaderPreprocessor();
+	~ShaderPreprocessor();
+
+	//Expands includes in the file at path, includes are relative to the including file and each one is
+	//pasted at most once per root so shared snippets can include each other freely
+	bool preprocess(const std::string& path, std::string& output);
+
+	//Every root file which includes path, directly or indirectly, plus path itself if it is a root
+	std::vector<std::string> getDependents(const std::string& path);
+	//Every file the root pulled in the last time it was preprocessed, including itself
+	std::vector<std::string> getDependencies(const std::string& rootPath);
+
+	unsigned int getFileReads() const { return m_FileReads; };
+	unsigned int getCacheHits() const { return m_CacheHits; };
+
+	void clear();
+private:
+	struct CachedFile
+	{
+		std::filesystem::file_time_type modifiedTime;
+		std::string contents;
+	};
+
+	bool readFile(const std::string& path, std::string& contents);
+	bool expand(const std::string& path, std::string& output, std::set<std::string>& included, int depth);
+	void setDependencies(const std::string& rootPath, const std::set<std::string>& dependencies);
+
+	std::mutex m_Mutex;
+	std::unordered_map<std::string, CachedFile> m_Files;
+	//Root file to everything it includes
+	std::unordered_map<std::string, std::set<std::string>> m_Dependencies;
+	//Any file to the roots which include it
+	std::unordered_map<std::string, std::set<std::string>> m_Dependents;
+
+	unsigned int m_FileReads;
+	unsigned int m_CacheHits;
+};
+
+//Shared preprocessor used by LoadShaders and the hot reloader
+ShaderPreprocessor& getShaderPreprocessor();
@@ -0,0 +1,399 @@
+#include "ShaderProgram.h"
+#include "GLStateCache.h"
+
+#include <cstring>
+
+#include <glm/gtc/type_ptr.hpp>
+
+static size_t uniformTypeSize(GLenum type)
+{
+	switch (type)
+	{
+	case GL_FLOAT_VEC2:
+	case GL_INT_VEC2:
+		return 8;
+	case GL_FLOAT_VEC3:
+	case GL_INT_VEC3:
+		return 12;
+	case GL_FLOAT_VEC4:
+	case GL_INT_VEC4:
+	case GL_FLOAT_MAT2:
+		return 16;
+	case GL_FLOAT_MAT3:
+		return 36;
+	case GL_FLOAT_MAT4:
+		return 64;
+	default:
+		//Scalars, bools and samplers
+		return 4;
+	}
+}
+
+ShaderProgram::ShaderProgram()
+{
+	m_ProgramID = 0;
+	m_Uploads = 0;
+	m_SkippedUploads = 0;
+}
+
+ShaderProgram::~ShaderProgram()
+{
+	destroy();
+}
+
+bool ShaderProgram::init(GLuint programID)
+{
+	GLint Result = GL_FALSE;
+	if (programID != 0)
+	{
+		glGetProgramiv(programID, GL_LINK_STATUS, &Result);
+	}
+	if (Result != GL_TRUE)
+	{
+		printf("ShaderProgram::init was passed a program which has not linked\n");
+		return false;
+	}
+
+	m_ProgramID = programID;
+	reflect();
+	return true;
+}
+
+bool ShaderProgram::reload(GLuint programID)
+{
+	if (programID == m_ProgramID)
+	{
+		return true;
+	}
+
+	GLuint oldProgramID = m_ProgramID;
+	if (!init(programID))
+	{
+		return false;
+	}
+	if (oldProgramID != 0)
+	{
+		getGLState().deleteProgram(oldProgramID);
+	}
+	return true;
+}
+
+void ShaderProgram::destroy()
+{
+	if (m_ProgramID != 0)
+	{
+		getGLState().deleteProgram(m_ProgramID);
+		m_ProgramID = 0;
+	}
+	m_Uniforms.clear();
+	m_UniformBlocks.clear();
+	m_Attributes.clear();
+	m_ValueCache.clear();
+}
+
+void ShaderProgram::bind()
+{
+	getGLState().useProgram(m_ProgramID);
+}
+
+void ShaderProgram::reflect()
+{
+	m_Uniforms.clear();
+	m_UniformBlocks.clear();
+	m_Attributes.clear();
+	m_ValueCache.clear();
+
+	GLint maxNameLength = 0;
+	GLint count = 0;
+	std::vector<char> name;
+
+	//Uniforms, skipping those which live in a block as they have no location
+	glGetProgramiv(m_ProgramID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(m_ProgramID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+	name.resize(maxNameLength + 1);
+	size_t cacheSize = 0;
+	for (GLint i = 0; i < count; i++)
+	{
+		GLint arraySize = 0;
+		GLenum type = 0;
+		glGetActiveUniform(m_ProgramID, i, (GLsizei)name.size(), nullptr, &arraySize, &type, name.data());
+		GLint location = glGetUniformLocation(m_ProgramID, name.data());
+		if (location < 0)
+		{
+			continue;
+		}
+
+		//Arrays are reported as "name[0]", register them under the plain name as well
+		std::string uniformName = name.data();
+		size_t bracket = uniformName.find('[');
+		if (bracket != std::string::npos)
+		{
+			uniformName = uniformName.substr(0, bracket);
+		}
+
+		UniformInfo uniform;
+		uniform.name = uniformName;
+		uniform.hash = hashUniformName(uniformName.c_str());
+		uniform.location = location;
+		uniform.type = type;
+		uniform.arraySize = arraySize;
+		uniform.cacheOffset = cacheSize;
+		uniform.cacheSize = uniformTypeSize(type);
+		uniform.cacheValid = false;
+		cacheSize += uniform.cacheSize;
+		m_Uniforms.push_back(uniform);
+	}
+	m_ValueCache.resize(cacheSize);
+
+	glGetProgramiv(m_ProgramID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+	glGetProgramiv(m_ProgramID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxNameLength);
+	name.resize(maxNameLength + 1);
+	for (GLint i = 0; i < count; i++)
+	{
+		glGetActiveUniformBlockName(m_ProgramID, i, (GLsizei)name.size(), nullptr, name.data());
+
+		UniformBlockInfo block;
+		block.name = name.data();
+		block.hash = hashUniformName(name.data());
+		block.index = i;
+		glGetActiveUniformBlockiv(m_ProgramID, i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+		m_UniformBlocks.push_back(block);
+	}
+
+	glGetProgramiv(m_ProgramID, GL_ACTIVE_ATTRIBUTES, &count);
+	glGetProgramiv(m_ProgramID, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxNameLength);
+	name.resize(maxNameLength + 1);
+	for (GLint i = 0; i < count; i++)
+	{
+		AttributeInfo attribute;
+		glGetActiveAttrib(m_ProgramID, i, (GLsizei)name.size(), nullptr, &attribute.arraySize, &attribute.type, name.data());
+		attribute.name = name.data();
+		attribute.hash = hashUniformName(name.data());
+		attribute.location = glGetAttribLocation(m_ProgramID, name.data());
+		m_Attributes.push_back(attribute);
+	}
+
+	m_UniformHashes.clear();
+	for (const UniformInfo& uniform : m_Uniforms)
+	{
+		m_UniformHashes.push_back(uniform.hash);
+	}
+	buildTable(m_UniformTable, m_UniformHashes);
+
+	m_UniformBlockHashes.clear();
+	for (const UniformBlockInfo& block : m_UniformBlocks)
+	{
+		m_UniformBlockHashes.push_back(block.hash);
+	}
+	buildTable(m_UniformBlockTable, m_UniformBlockHashes);
+
+	m_AttributeHashes.clear();
+	for (const AttributeInfo& attribute : m_Attributes)
+	{
+		m_AttributeHashes.push_back(attribute.hash);
+	}
+	buildTable(m_AttributeTable, m_AttributeHashes);
+}
+
+void ShaderProgram::buildTable(std::vector<int>& table, const std::vector<uint32_t>& hashes)
+{
+	//Keep the load factor at or below a half so probe sequences stay short
+	size_t tableSize = 4;
+	while (tableSize < hashes.size() * 2)
+	{
+		tableSize *= 2;
+	}
+	table.assign(tableSize, -1);
+
+	for (size_t i = 0; i < hashes.size(); i++)
+	{
+		size_t slot = hashes[i] & (tableSize - 1);
+		while (table[slot] != -1)
+		{
+			if (hashes[table[slot]] == hashes[i])
+			{
+				printf("Shader interface name hash collision on %08x, the second name will not be found\n", hashes[i]);
+				break;
+			}
+			slot = (slot + 1) & (tableSize - 1);
+		}
+		if (table[slot] == -1)
+		{
+			table[slot] = (int)i;
+		}
+	}
+}
+
+int ShaderProgram::findSlot(const std::vector<int>& table, const std::vector<uint32_t>& hashes, uint32_t hash) const
+{
+	if (table.empty())
+	{
+		return -1;
+	}
+
+	size_t mask = table.size() - 1;
+	for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+	{
+		int index = table[slot];
+		if (index == -1 || hashes[index] == hash)
+		{
+			return index;
+		}
+	}
+}
+
+const UniformInfo* ShaderProgram::findUniform(uint32_t hash) const
+{
+	int index = findSlot(m_UniformTable, m_UniformHashes, hash);
+	return index < 0 ? nullptr : &m_Uniforms[index];
+}
+
+const UniformBlockInfo* ShaderProgram::findUniformBlock(uint32_t hash) const
+{
+	int index = findSlot(m_UniformBlockTable, m_UniformBlockHashes, hash);
+	return index < 0 ? nullptr : &m_UniformBlocks[index];
+}
+
+const AttributeInfo* ShaderProgram::findAttribute(uint32_t hash) const
+{
+	int index = findSlot(m_AttributeTable, m_AttributeHashes, hash);
+	return index < 0 ? nullptr : &m_Attributes[index];
+}
+
+const UniformInfo* ShaderProgram::findUniform(const char* name) const
+{
+	const UniformInfo* pUniform = findUniform(hashUniformName(name));
+	return pUniform != nullptr && pUniform->name == name ? pUniform : nullptr;
+}
+
+const UniformBlockInfo* ShaderProgram::findUniformBlock(const char* name) const
+{
+	const UniformBlockInfo* pBlock = findUniformBlock(hashUniformName(name));
+	return pBlock != nullptr && pBlock->name == name ? pBlock : nullptr;
+}
+
+const AttributeInfo* ShaderProgram::findAttribute(const char* name) const
+{
+	const AttributeInfo* pAttribute = findAttribute(hashUniformName(name));
+	return pAttribute != nullptr && pAttribute->name == name ? pAttribute : nullptr;
+}
+
+GLint ShaderProgram::getUniformLocation(uint32_t hash) const
+{
+	const UniformInfo* pUniform = findUniform(hash);
+	return pUniform == nullptr ? -1 : pUniform->location;
+}
+
+GLint ShaderProgram::getAttributeLocation(uint32_t hash) const
+{
+	const AttributeInfo* pAttribute = findAttribute(hash);
+	return pAttribute == nullptr ? -1 : pAttribute->location;
+}
+
+UniformInfo* ShaderProgram::checkValue(uint32_t hash, const void* pValue, size_t size)
+{
+	int index = findSlot(m_UniformTable, m_UniformHashes, hash);
+	if (index < 0)
+	{
+		return nullptr;
+	}
+
+	UniformInfo& uniform = m_Uniforms[index];
+	//Samplers and bools are set through the int and float setters, only the size has to match
+	if (uniform.cacheSize != size)
+	{
+		printf("Uniform %s set with a value of the wrong type\n", uniform.name.c_str());
+		return nullptr;
+	}
+
+	unsigned char* pCached = &m_ValueCache[uniform.cacheOffset];
+	if (uniform.cacheValid && memcmp(pCached, pValue, size) == 0)
+	{
+		m_SkippedUploads++;
+		return nullptr;
+	}
+
+	memcpy(pCached, pValue, size);
+	uniform.cacheValid = true;
+	m_Uploads++;
+	return &uniform;
+}
+
+bool ShaderProgram::setUniform(uint32_t hash, int value)
+{
+	UniformInfo* pUniform = checkValue(hash, &value, sizeof(value));
+	if (pUniform != nullptr)
+	{
+		glUniform1i(pUniform->location, value);
+	}
+	return pUniform != nullptr;
+}
+
+bool ShaderProgram::setUniform(uint32_t hash, float value)
+{
+	UniformInfo* pUniform = checkValue(hash, &value, sizeof(value));
+	if (pUniform != nullptr)
+	{
+		glUniform1f(pUniform->location, value);
+	}
+	return pUniform != nullptr;
+}
+
+bool ShaderProgram::setUniform(uint32_t hash, const glm::vec2& value)
+{
+	UniformInfo* pUniform = checkValue(hash, glm::value_ptr(value), sizeof(value));
+	if (pUniform != nullptr)
+	{
+		glUniform2fv(pUniform->location, 1, glm::value_ptr(value));
+	}
+	return pUniform != nullptr;
+}
+
+bool ShaderProgram::setUniform(uint32_t hash, const glm::vec3& value)
+{
+	UniformInfo* pUniform = checkValue(hash, glm::value_ptr(value), sizeof(value));
+	if (pUniform != nullptr)
+	{
+		glUniform3fv(pUniform->location, 1, glm::value_ptr(value));
+	}
+	return pUniform != nullptr;
+}
+
+bool ShaderProgram::setUniform(uint32_t hash, const glm::vec4& value)
+{
+	UniformInfo* pUniform = checkValue(hash, glm::value_ptr(value), sizeof(value));
+	if (pUniform != nullptr)
+	{
+		glUniform4fv(pUniform->location, 1, glm::value_ptr(value));
+	}
+	return pUniform != nullptr;
+}
+
+bool ShaderProgram::setUniform(uint32_t hash, const glm::mat3& value)
+{
+	UniformInfo* pUniform = checkValue(hash, glm::value_ptr(value), sizeof(value));
+	if (pUniform != nullptr)
+	{
+		glUniformMatrix3fv(pUniform->location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+	return pUniform != nullptr;
+}
+
+bool ShaderProgram::setUniform(uint32_t hash, const glm::mat4& value)
+{
+	UniformInfo* pUniform = checkValue(hash, glm::value_ptr(value), sizeof(value));
+	if (pUniform != nullptr)
+	{
+		glUniformMatrix4fv(pUniform->location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+	return pUniform != nullptr;
+}
+
+void ShaderProgram::bindUniformBlock(uint32_t hash, GLuint bindingPoint)
+{
+	const UniformBlockInfo* pBlock = findUniformBlock(hash);
+	if (pBlock != nullptr)
+	{
+		glUniformBlockBinding(m_ProgramID, pBlock->index, bindingPoint);
+	}
+}
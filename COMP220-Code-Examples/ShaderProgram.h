@@ -0,0 +1,124 @@
+#pragma once
+
+#include <GL\glew.h>
+#include <SDL_opengl.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//FNV-1a over the name, constexpr so that hot paths can hash uniform names at compile time
+constexpr uint32_t hashUniformName(const char* name, uint32_t hash = 2166136261u)
+{
+	return (*name == '\0') ? hash : hashUniformName(name + 1, (hash ^ (uint32_t)(unsigned char)*name) * 16777619u);
+}
+
+struct UniformInfo
+{
+	std::string name;
+	uint32_t hash;
+	GLint location;
+	GLenum type;
+	GLint arraySize;
+	//Offset and size of the last uploaded value in the program's value cache
+	size_t cacheOffset;
+	size_t cacheSize;
+	bool cacheValid;
+};
+
+struct UniformBlockInfo
+{
+	std::string name;
+	uint32_t hash;
+	GLuint index;
+	GLint dataSize;
+};
+
+struct AttributeInfo
+{
+	std::string name;
+	uint32_t hash;
+	GLint location;
+	GLenum type;
+	GLint arraySize;
+};
+
+//Wraps a linked program and reflects its interface once, so nothing calls glGetUniformLocation per frame.
+//Setters skip the GL call when the value matches what was last uploaded, the program must be bound to set uniforms
+class ShaderProgram
+{
+public:
+	ShaderProgram();
+	~ShaderProgram();
+
+	//Takes ownership of a linked program and reflects its uniforms, blocks and attributes
+	bool init(GLuint programID);
+	//Swaps in a relinked program, e.g. after a hot reload, and reflects it again
+	bool reload(GLuint programID);
+	void destroy();
+
+	void bind();
+	GLuint getID() const { return m_ProgramID; };
+
+	//Lookups by hash alone trust it, a name which is not in the program but shares a hash with one that is would
+	//find that one. The name overloads also compare the name
+	const UniformInfo* findUniform(uint32_t hash) const;
+	const UniformBlockInfo* findUniformBlock(uint32_t hash) const;
+	const AttributeInfo* findAttribute(uint32_t hash) const;
+	const UniformInfo* findUniform(const char* name) const;
+	const UniformBlockInfo* findUniformBlock(const char* name) const;
+	const AttributeInfo* findAttribute(const char* name) const;
+	GLint getUniformLocation(uint32_t hash) const;
+	GLint getAttributeLocation(uint32_t hash) const;
+
+	//Setters return true if a GL upload was issued, false if the value was unchanged or the uniform is not active
+	bool setUniform(uint32_t hash, int value);
+	bool setUniform(uint32_t hash, float value);
+	bool setUniform(uint32_t hash, const glm::vec2& value);
+	bool setUniform(uint32_t hash, const glm::vec3& value);
+	bool setUniform(uint32_t hash, const glm::vec4& value);
+	bool setUniform(uint32_t hash, const glm::mat3& value);
+	bool setUniform(uint32_t hash, const glm::mat4& value);
+	void bindUniformBlock(uint32_t hash, GLuint bindingPoint);
+
+	template<class T>
+	bool setUniform(const char* name, const T& value)
+	{
+		const UniformInfo* pUniform = findUniform(name);
+		return pUniform != nullptr && setUniform(pUniform->hash, value);
+	}
+
+	const std::vector<UniformInfo>& getUniforms() const { return m_Uniforms; };
+	const std::vector<UniformBlockInfo>& getUniformBlocks() const { return m_UniformBlocks; };
+	const std::vector<AttributeInfo>& getAttributes() const { return m_Attributes; };
+
+	unsigned int getUploadCount() const { return m_Uploads; };
+	unsigned int getSkippedUploadCount() const { return m_SkippedUploads; };
+private:
+	void reflect();
+	void buildTable(std::vector<int>& table, const std::vector<uint32_t>& hashes);
+	int findSlot(const std::vector<int>& table, const std::vector<uint32_t>& hashes, uint32_t hash) const;
+	//Returns the uniform if the value differs from the cache and updates the cache, null if the upload can be skipped
+	UniformInfo* checkValue(uint32_t hash, const void* pValue, size_t size);
+
+	GLuint m_ProgramID;
+
+	std::vector<UniformInfo> m_Uniforms;
+	std::vector<UniformBlockInfo> m_UniformBlocks;
+	std::vector<AttributeInfo> m_Attributes;
+
+	//Open addressed tables of indices into the vectors above, sized to a power of two
+	std::vector<uint32_t> m_UniformHashes;
+	std::vector<int> m_UniformTable;
+	std::vector<uint32_t> m_UniformBlockHashes;
+	std::vector<int> m_UniformBlockTable;
+	std::vector<uint32_t> m_AttributeHashes;
+	std::vector<int> m_AttributeTable;
+
+	std::vector<unsigned char> m_ValueCache;
+
+	unsigned int m_Uploads;
+	unsigned int m_SkippedUploads;
+};
@@ -0,0 +1,234 @@
+#include "ShaderVariants.h"
+#include "Shader.h"
+#include "ShaderBatch.h"
+#include "GLStateCache.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+std::string injectDefines(const std::string& source, const std::vector<std::string>& defines)
+{
+	if (defines.empty())
+	{
+		return source;
+	}
+
+	std::string defineBlock;
+	for (const std::string& define : defines)
+	{
+		defineBlock += "#define " + define + "\n";
+	}
+
+	//#version has to stay the first directive, so the defines go on the line after it
+	size_t insertPosition = 0;
+	size_t versionPosition = source.find("#version");
+	if (versionPosition != std::string::npos)
+	{
+		size_t lineEnd = source.find('\n', versionPosition);
+		insertPosition = (lineEnd == std::string::npos) ? source.size() : lineEnd + 1;
+	}
+
+	std::string result = source;
+	if (insertPosition == result.size() && !result.empty() && result.back() != '\n')
+	{
+		result += '\n';
+		insertPosition++;
+	}
+	result.insert(insertPosition, defineBlock);
+	return result;
+}
+
+ShaderVariants::ShaderVariants()
+{
+}
+
+ShaderVariants::~ShaderVariants()
+{
+	destroy();
+}
+
+bool ShaderVariants::init(const char* vertex_file_path, const char* fragment_file_path)
+{
+	std::string vertexCode;
+	std::string fragmentCode;
+	if (!readShaderFile(vertex_file_path, vertexCode) || !readShaderFile(fragment_file_path, fragmentCode))
+	{
+		return false;
+	}
+
+	m_VertexPath = vertex_file_path;
+	m_FragmentPath = fragment_file_path;
+	setSources(vertexCode, fragmentCode);
+	return true;
+}
+
+void ShaderVariants::destroy()
+{
+	for (auto& variant : m_Variants)
+	{
+		if (variant.second.programID != 0)
+		{
+			getGLState().deleteProgram(variant.second.programID);
+		}
+	}
+	m_Variants.clear();
+}
+
+void ShaderVariants::setSources(const std::string& vertexCode, const std::string& fragmentCode)
+{
+	destroy();
+	m_VertexCode = vertexCode;
+	m_FragmentCode = fragmentCode;
+}
+
+std::string ShaderVariants::makeDefineString(const std::vector<std::string>& defines)
+{
+	std::vector<std::string> sorted = defines;
+	std::sort(sorted.begin(), sorted.end());
+	sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+	std::string defineString;
+	for (const std::string& define : sorted)
+	{
+		if (!defineString.empty())
+		{
+			defineString += ';';
+		}
+		defineString += define;
+	}
+	return defineString;
+}
+
+uint64_t ShaderVariants::hashDefineString(const std::string& defineString)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : defineString)
+	{
+		hash ^= (unsigned char)c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::vector<std::string> ShaderVariants::splitDefineString(const std::string& defineString)
+{
+	std::vector<std::string> defines;
+	size_t start = 0;
+	while (start < defineString.size())
+	{
+		size_t end = defineString.find(';', start);
+		if (end == std::string::npos)
+		{
+			end = defineString.size();
+		}
+		if (end > start)
+		{
+			defines.push_back(defineString.substr(start, end - start));
+		}
+		start = end + 1;
+	}
+	return defines;
+}
+
+const ShaderVariants::Variant* ShaderVariants::findVariant(uint64_t key, const std::string& defineString) const
+{
+	auto range = m_Variants.equal_range(key);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second.defineString == defineString)
+		{
+			return &it->second;
+		}
+	}
+	return nullptr;
+}
+
+bool ShaderVariants::hasVariant(const std::vector<std::string>& defines) const
+{
+	std::string defineString = makeDefineString(defines);
+	return findVariant(hashDefineString(defineString), defineString) != nullptr;
+}
+
+GLuint ShaderVariants::getVariant(const std::vector<std::string>& defines)
+{
+	std::string defineString = makeDefineString(defines);
+	uint64_t key = hashDefineString(defineString);
+
+	const Variant* pVariant = findVariant(key, defineString);
+	if (pVariant != nullptr)
+	{
+		return pVariant->programID;
+	}
+
+	std::vector<std::string> sortedDefines = splitDefineString(defineString);
+	std::string vertexName = m_VertexPath + " [" + defineString + "]";
+	std::string fragmentName = m_FragmentPath + " [" + defineString + "]";
+	GLuint programID = LoadShadersFromSource(injectDefines(m_VertexCode, sortedDefines), injectDefines(m_FragmentCode, sortedDefines),
+		vertexName.c_str(), fragmentName.c_str());
+
+	GLint Result = GL_FALSE;
+	glGetProgramiv(programID, GL_LINK_STATUS, &Result);
+	if (Result != GL_TRUE)
+	{
+		getGLState().deleteProgram(programID);
+		programID = 0;
+	}
+
+	//Failed variants are remembered too so a broken permutation is not recompiled every frame
+	m_Variants.insert({ key, { defineString, programID } });
+	return programID;
+}
+
+bool ShaderVariants::saveUsedVariants(const std::string& filename) const
+{
+	std::ofstream variantStream(filename, std::ios::out | std::ios::trunc);
+	if (!variantStream.is_open())
+	{
+		printf("Impossible to write %s\n", filename.c_str());
+		return false;
+	}
+
+	for (const auto& variant : m_Variants)
+	{
+		variantStream << variant.second.defineString << "\n";
+	}
+	return true;
+}
+
+int ShaderVariants::prewarm(const std::string& filename)
+{
+	std::ifstream variantStream(filename, std::ios::in);
+	if (!variantStream.is_open())
+	{
+		return 0;
+	}
+
+	ShaderBatch batch;
+	std::vector<std::pair<uint64_t, std::string>> pending;
+	//Lines which normalise to the same defines are compiled once, a second program would be dropped without deleting it
+	std::unordered_set<std::string> pendingDefines;
+	std::string defineString;
+	while (std::getline(variantStream, defineString))
+	{
+		//Normalise in case the file was edited by hand
+		defineString = makeDefineString(splitDefineString(defineString));
+		uint64_t key = hashDefineString(defineString);
+		if (findVariant(key, defineString) != nullptr || !pendingDefines.insert(defineString).second)
+		{
+			continue;
+		}
+
+		std::vector<std::string> defines = splitDefineString(defineString);
+		batch.addSource(m_VertexPath + " [" + defineString + "]", injectDefines(m_VertexCode, defines), injectDefines(m_FragmentCode, defines));
+		pending.push_back({ key, defineString });
+	}
+
+	batch.wait();
+	for (size_t i = 0; i < pending.size(); i++)
+	{
+		m_Variants.insert({ pending[i].first, { pending[i].second, batch.getProgram((int)i) } });
+	}
+	batch.release();
+
+	return (int)pending.size();
+}
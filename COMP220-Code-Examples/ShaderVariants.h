@@ -0,0 +1,61 @@
+#pragma once
+
+#include <GL\glew.h>
+#include <SDL_opengl.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//Inserts a #define line for each entry after the #version directive, entries may be "NAME" or "NAME VALUE"
+std::string injectDefines(const std::string& source, const std::vector<std::string>& defines);
+
+//Builds permutations of one vertex/fragment pair from #define lists, e.g. { "SKINNED", "FOG" }.
+//Each variant is compiled the first time it is asked for, or up front from a list recorded in an earlier run
+class ShaderVariants
+{
+public:
+	ShaderVariants();
+	~ShaderVariants();
+
+	bool init(const char* vertex_file_path, const char* fragment_file_path);
+	void destroy();
+
+	//Returns the program for this set of defines, compiling it if this is the first request
+	GLuint getVariant(const std::vector<std::string>& defines);
+	//True if the variant has already been compiled, never triggers a compile
+	bool hasVariant(const std::vector<std::string>& defines) const;
+
+	//Writes every variant requested so far, one define list per line
+	bool saveUsedVariants(const std::string& filename) const;
+	//Compiles every variant listed in the file as a single batch so drivers can compile them in parallel
+	int prewarm(const std::string& filename);
+
+	//Replaces the base sources, e.g. after a hot reload, dropping all compiled variants
+	void setSources(const std::string& vertexCode, const std::string& fragmentCode);
+
+	size_t getVariantCount() const { return m_Variants.size(); };
+	const std::string& getVertexPath() const { return m_VertexPath; };
+	const std::string& getFragmentPath() const { return m_FragmentPath; };
+private:
+	struct Variant
+	{
+		std::string defineString;
+		GLuint programID;
+	};
+
+	//Sorts the defines so that { "A", "B" } and { "B", "A" } are the same variant
+	static std::string makeDefineString(const std::vector<std::string>& defines);
+	static uint64_t hashDefineString(const std::string& defineString);
+	static std::vector<std::string> splitDefineString(const std::string& defineString);
+	//The variant with exactly this define string, variants whose strings only share a hash are told apart here
+	const Variant* findVariant(uint64_t key, const std::string& defineString) const;
+
+	std::string m_VertexPath;
+	std::string m_FragmentPath;
+	std::string m_VertexCode;
+	std::string m_FragmentCode;
+
+	std::unordered_multimap<uint64_t, Variant> m_Variants;
+};
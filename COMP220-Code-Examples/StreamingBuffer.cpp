@@ -0,0 +1,188 @@
+#include "StreamingBuffer.h"
+#include "GLStateCache.h"
+
+#include <SDL.h>
+
+#include <cstdio>
+
+StreamingBuffer::StreamingBuffer()
+{
+	m_Buffer = 0;
+	m_RegionSize = 0;
+	m_Persistent = false;
+	m_pMapped = nullptr;
+	m_MappedOffset = 0;
+	m_CurrentRegion = 0;
+	m_RegionOffset = 0;
+	for (int i = 0; i < REGION_COUNT; i++)
+	{
+		m_Fences[i] = 0;
+	}
+	m_WaitTime = 0.0;
+	m_HighWaterMark = 0;
+}
+
+StreamingBuffer::~StreamingBuffer()
+{
+	destroy();
+}
+
+bool StreamingBuffer::init(GLsizeiptr regionSize)
+{
+	m_RegionSize = regionSize;
+	GLsizeiptr totalSize = regionSize * REGION_COUNT;
+
+	glGenBuffers(1, &m_Buffer);
+	//GL_COPY_WRITE_BUFFER has no other meaning, so binding here disturbs nothing
+	getGLState().bindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+
+	m_Persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+	if (m_Persistent)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, totalSize, nullptr, flags);
+		m_pMapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, totalSize, flags);
+		if (m_pMapped == nullptr)
+		{
+			printf("Persistent mapping of the streaming buffer failed\n");
+			destroy();
+			return false;
+		}
+	}
+	else
+	{
+		//Fallback maps the region unsynchronised as allocations need it and unmaps before drawing, still guarded
+		//by the same fences
+		glBufferData(GL_COPY_WRITE_BUFFER, totalSize, nullptr, GL_STREAM_DRAW);
+	}
+
+	m_CurrentRegion = REGION_COUNT - 1;
+	return true;
+}
+
+void StreamingBuffer::destroy()
+{
+	for (int i = 0; i < REGION_COUNT; i++)
+	{
+		if (m_Fences[i] != 0)
+		{
+			glDeleteSync(m_Fences[i]);
+			m_Fences[i] = 0;
+		}
+	}
+	if (m_Buffer != 0)
+	{
+		if (m_pMapped != nullptr)
+		{
+			getGLState().bindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			m_pMapped = nullptr;
+		}
+		getGLState().deleteBuffers(1, &m_Buffer);
+		m_Buffer = 0;
+	}
+}
+
+void StreamingBuffer::waitForRegion(int region)
+{
+	GLsync fence = m_Fences[region];
+	if (fence == 0)
+	{
+		return;
+	}
+
+	//Flush on the first wait so the fence is guaranteed to be submitted, then poll with a timeout
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		uint64_t waitStart = SDL_GetPerformanceCounter();
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		do
+		{
+			result = glClientWaitSync(fence, flags, 1000000);
+			flags = 0;
+		} while (result == GL_TIMEOUT_EXPIRED);
+		m_WaitTime += (double)(SDL_GetPerformanceCounter() - waitStart) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+	}
+
+	glDeleteSync(fence);
+	m_Fences[region] = 0;
+}
+
+void StreamingBuffer::beginFrame()
+{
+	m_CurrentRegion = (m_CurrentRegion + 1) % REGION_COUNT;
+	m_RegionOffset = 0;
+	waitForRegion(m_CurrentRegion);
+}
+
+void StreamingBuffer::endFrame()
+{
+	flush();
+	m_Fences[m_CurrentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+StreamAllocation StreamingBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment)
+{
+	StreamAllocation allocation = { nullptr, 0, 0 };
+	if (m_Buffer == 0)
+	{
+		return allocation;
+	}
+
+	//Alignment is relative to the start of the buffer so offsets are usable as uniform buffer offsets or base instances
+	GLintptr regionStart = m_CurrentRegion * m_RegionSize;
+	GLintptr offset = regionStart + m_RegionOffset;
+	GLintptr remainder = offset % alignment;
+	if (remainder != 0)
+	{
+		offset += alignment - remainder;
+	}
+	if (offset + size > regionStart + m_RegionSize)
+	{
+		return allocation;
+	}
+
+	if (!m_Persistent && m_pMapped == nullptr)
+	{
+		//Map from here to the end of the region so later allocations before the next flush share the mapping.
+		//The fence has already been waited on and nothing queued reads past the last flush, so the driver must not
+		//synchronise
+		getGLState().bindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+		m_pMapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, regionStart + m_RegionSize - offset,
+			GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+		if (m_pMapped == nullptr)
+		{
+			return allocation;
+		}
+		m_MappedOffset = offset;
+	}
+
+	m_RegionOffset = offset + size - regionStart;
+	if (m_RegionOffset > m_HighWaterMark)
+	{
+		m_HighWaterMark = m_RegionOffset;
+	}
+
+	allocation.pData = m_Persistent ? m_pMapped + offset : m_pMapped + (offset - m_MappedOffset);
+	allocation.offset = offset;
+	allocation.size = size;
+	return allocation;
+}
+
+void StreamingBuffer::flush()
+{
+	if (m_Persistent || m_pMapped == nullptr)
+	{
+		return;
+	}
+
+	getGLState().bindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+	GLintptr written = m_CurrentRegion * m_RegionSize + m_RegionOffset - m_MappedOffset;
+	if (written > 0)
+	{
+		glFlushMappedBufferRange(GL_COPY_WRITE_BUFFER, 0, written);
+	}
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	m_pMapped = nullptr;
+}
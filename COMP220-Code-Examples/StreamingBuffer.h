@@ -0,0 +1,64 @@
+#pragma once
+
+#include <GL\glew.h>
+#include <SDL_opengl.h>
+
+//A piece of the streaming buffer handed out for this frame, write through pData and source the GPU at offset
+struct StreamAllocation
+{
+	void* pData;
+	GLintptr offset;
+	GLsizeiptr size;
+};
+
+//Ring buffer for data written every frame (uniforms, particle vertices, instance transforms). The buffer is split
+//into one region per frame in flight, the CPU writes into the current region while the GPU reads the older ones and
+//a fence per region stops the CPU from overwriting data the GPU has not consumed. With ARB_buffer_storage the buffer
+//is mapped once, persistently and coherently, so writes go straight to memory the GPU reads with no driver copies
+class StreamingBuffer
+{
+public:
+	static const int REGION_COUNT = 3;
+
+	StreamingBuffer();
+	~StreamingBuffer();
+
+	bool init(GLsizeiptr regionSize);
+	void destroy();
+
+	//Moves to the next region, waiting only if the GPU is still reading it from REGION_COUNT frames ago
+	void beginFrame();
+	//Fences the current region so it is not reused until the GPU has finished with it
+	void endFrame();
+
+	//Sub allocates from this frame's region, alignment need not be a power of two so that it can be the size of a
+	//vertex or instance struct. Returns a null pData when the region is full
+	StreamAllocation allocate(GLsizeiptr size, GLsizeiptr alignment = 16);
+	//Makes everything allocated so far visible to the GPU, call after writing and before any draw which reads it.
+	//Without persistent mapping this unmaps the buffer, as GL forbids drawing from a mapped buffer, so pData from
+	//earlier allocations must not be written afterwards. Does nothing when persistent
+	void flush();
+
+	GLuint getBuffer() const { return m_Buffer; };
+	bool isPersistent() const { return m_Persistent; };
+	//Milliseconds spent waiting on fences since init, non zero means the GPU is more than REGION_COUNT frames behind
+	double getWaitTime() const { return m_WaitTime; };
+	GLsizeiptr getHighWaterMark() const { return m_HighWaterMark; };
+private:
+	void waitForRegion(int region);
+
+	GLuint m_Buffer;
+	GLsizeiptr m_RegionSize;
+	bool m_Persistent;
+	//Whole buffer when persistent, otherwise from m_MappedOffset to the end of the current region between an
+	//allocate and the next flush
+	unsigned char* m_pMapped;
+	GLintptr m_MappedOffset;
+
+	int m_CurrentRegion;
+	GLsizeiptr m_RegionOffset;
+	GLsync m_Fences[REGION_COUNT];
+
+	double m_WaitTime;
+	GLsizeiptr m_HighWaterMark;
+};
@@ -1,13 +1,14 @@
 #include "Texture.h"
+#include "GLStateCache.h"
+#include "JobSystem.h"
 
 GLuint loadTextureFromFile(const std::string& filename)
 {
-	GLuint textureID;
-
-
-	GLenum	textureFormat = GL_RGB;
-	GLenum	internalFormat = GL_RGB8;
+	return loadTextureFromFile(filename, TextureOptions());
+}
 
+GLuint loadTextureFromFile(const std::string& filename, const TextureOptions& options, size_t* pSizeInBytes)
+{
 	SDL_Surface * surface = IMG_Load(filename.c_str());
 	if (surface == nullptr)
 	{
@@ -15,6 +16,19 @@ GLuint loadTextureFromFile(const std::string& filename)
 		return 0;
 	}
 
+	GLuint textureID = createTextureFromSurface(surface, options, pSizeInBytes);
+	SDL_FreeSurface(surface);
+
+	return textureID;
+}
+
+GLuint createTextureFromSurface(SDL_Surface* surface, const TextureOptions& options, size_t* pSizeInBytes)
+{
+	GLuint textureID;
+
+	GLenum	textureFormat = GL_RGB;
+	GLenum	internalFormat = GL_RGB8;
+
 	GLint	nOfColors = surface->format->BytesPerPixel;
 	if (nOfColors == 4)					//	contains	an	alpha	channel
 	{
@@ -39,22 +53,60 @@ GLuint loadTextureFromFile(const std::string& filename)
 		}
 	}
 
+	if (options.sRGB)
+	{
+		internalFormat = (internalFormat == GL_RGBA8) ? GL_SRGB8_ALPHA8 : GL_SRGB8;
+	}
+
 	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_2D, textureID);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	getGLState().bindTexture(GL_TEXTURE_2D, textureID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, options.minFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, options.magFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, options.wrapS);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, options.wrapT);
 	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, surface->w, surface->h, 0, textureFormat, GL_UNSIGNED_BYTE, surface->pixels);
 
-
-	SDL_FreeSurface(surface);
+	size_t sizeInBytes = (size_t)surface->w * surface->h * ((internalFormat == GL_RGBA8 || internalFormat == GL_SRGB8_ALPHA8) ? 4 : 3);
+	if (options.generateMipmaps)
+	{
+		glGenerateMipmap(GL_TEXTURE_2D);
+		//A full mip chain adds roughly a third on top of the base level
+		sizeInBytes += sizeInBytes / 3;
+	}
+	if (pSizeInBytes != nullptr)
+	{
+		*pSizeInBytes = sizeInBytes;
+	}
 
 	return textureID;
 }
 
+void loadTextureFromFileAsync(const std::string& filename, const TextureOptions& options, GLuint* pTextureID, JobCounter* pCounter)
+{
+	*pTextureID = 0;
+	//Decoding is the slow part and needs no GL, the upload is scheduled from inside the decode job so pCounter
+	//cannot reach zero between the two
+	getJobSystem().schedule([filename, options, pTextureID, pCounter]()
+	{
+		SDL_Surface* surface = IMG_Load(filename.c_str());
+		if (surface == nullptr)
+		{
+			printf("Could not load file %s\n", IMG_GetError());
+			return;
+		}
+		getJobSystem().scheduleOnMainThread([surface, options, pTextureID]()
+		{
+			*pTextureID = createTextureFromSurface(surface, options);
+			SDL_FreeSurface(surface);
+		}, pCounter);
+	}, pCounter);
+}
+
 GLuint CreateTexture(int width, int height)
 {
 	GLuint textureID = 0;
 	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_2D, textureID);
+	getGLState().bindTexture(GL_TEXTURE_2D, textureID);
 
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
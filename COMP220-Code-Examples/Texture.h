@@ -7,6 +7,29 @@
 
 #include <string>
 
+//Sampler and format options used when uploading a texture, these form part of the texture cache key
+struct TextureOptions
+{
+	GLint minFilter = GL_LINEAR;
+	GLint magFilter = GL_LINEAR;
+	GLint wrapS = GL_REPEAT;
+	GLint wrapT = GL_REPEAT;
+	bool generateMipmaps = false;
+	bool sRGB = false;
+};
+
+class JobCounter;
+
 GLuint loadTextureFromFile(const std::string& filename);
 
-GLuint CreateTexture(int width, int height);
\ No newline at end of file
+//Loads a texture using the passed in options, if pSizeInBytes is not null it is filled in with an estimate of the GPU memory used
+GLuint loadTextureFromFile(const std::string& filename, const TextureOptions& options, size_t* pSizeInBytes = nullptr);
+
+//Uploads an already decoded image, the surface is left for the caller to free
+GLuint createTextureFromSurface(SDL_Surface* surface, const TextureOptions& options, size_t* pSizeInBytes = nullptr);
+
+//Decodes the image as a job and uploads it on the main thread, *pTextureID is set (0 on failure) before pCounter
+//reaches zero. pTextureID must stay valid until then
+void loadTextureFromFileAsync(const std::string& filename, const TextureOptions& options, GLuint* pTextureID, JobCounter* pCounter);
+
+GLuint CreateTexture(int width, int height);
@@ -0,0 +1,155 @@
+#include "TextureCache.h"
+#include "GLStateCache.h"
+
+#include <filesystem>
+
+CachedTexture::~CachedTexture()
+{
+	if (textureID != 0)
+	{
+		getGLState().deleteTextures(1, &textureID);
+	}
+}
+
+TextureCache::TextureCache()
+{
+	//Default to 256MB of textures
+	m_MemoryBudget = 256 * 1024 * 1024;
+	m_MemoryUsed = 0;
+	m_Hits = 0;
+	m_Misses = 0;
+	m_Evictions = 0;
+}
+
+TextureCache::~TextureCache()
+{
+	destroy();
+}
+
+std::string TextureCache::makeKey(const std::string& filename, const TextureOptions& options) const
+{
+	//Resolve the path so that "Crate.jpg" and "./Crate.jpg" end up as the same texture
+	std::error_code error;
+	std::string path = std::filesystem::weakly_canonical(std::filesystem::path(filename), error).string();
+	if (error)
+	{
+		path = filename;
+	}
+
+	char optionString[128];
+	snprintf(optionString, sizeof(optionString), "|%x|%x|%x|%x|%d|%d", options.minFilter, options.magFilter,
+		options.wrapS, options.wrapT, options.generateMipmaps, options.sRGB);
+	return path + optionString;
+}
+
+TextureHandle TextureCache::acquire(const std::string& filename, const TextureOptions& options)
+{
+	std::string key = makeKey(filename, options);
+
+	auto it = m_Textures.find(key);
+	if (it != m_Textures.end())
+	{
+		m_Hits++;
+		//Move to the front of the LRU list
+		m_LRU.splice(m_LRU.begin(), m_LRU, it->second.lruPosition);
+		return it->second.texture;
+	}
+
+	m_Misses++;
+	size_t sizeInBytes = 0;
+	GLuint textureID = loadTextureFromFile(filename, options, &sizeInBytes);
+	if (textureID == 0)
+	{
+		return nullptr;
+	}
+
+	std::shared_ptr<CachedTexture> texture = std::make_shared<CachedTexture>();
+	texture->textureID = textureID;
+	texture->sizeInBytes = sizeInBytes;
+	texture->key = key;
+
+	m_LRU.push_front(key);
+	m_Textures[key] = { texture, m_LRU.begin() };
+	m_MemoryUsed += sizeInBytes;
+
+	evictToBudget();
+
+	return texture;
+}
+
+void TextureCache::setMemoryBudget(size_t budgetInBytes)
+{
+	m_MemoryBudget = budgetInBytes;
+	evictToBudget();
+}
+
+void TextureCache::evictToBudget()
+{
+	//Walk from least recently used, skipping anything which still has handles outstanding
+	auto lruIt = m_LRU.end();
+	while (m_MemoryUsed > m_MemoryBudget && lruIt != m_LRU.begin())
+	{
+		--lruIt;
+		auto it = m_Textures.find(*lruIt);
+		if (it->second.texture.use_count() > 1)
+		{
+			continue;
+		}
+
+		//Step back past the entry before erasing it from the list
+		auto next = lruIt;
+		++next;
+		remove(it);
+		m_Evictions++;
+		lruIt = next;
+	}
+
+	if (m_MemoryUsed > m_MemoryBudget)
+	{
+		printf("Texture cache over budget, %zu of %zu bytes in use by live handles\n", m_MemoryUsed, m_MemoryBudget);
+	}
+}
+
+void TextureCache::remove(std::unordered_map<std::string, Entry>::iterator it)
+{
+	m_MemoryUsed -= it->second.texture->sizeInBytes;
+	m_LRU.erase(it->second.lruPosition);
+	m_Textures.erase(it);
+}
+
+float TextureCache::getHitRate() const
+{
+	unsigned int total = m_Hits + m_Misses;
+	if (total == 0)
+	{
+		return 0.0f;
+	}
+	return (float)m_Hits / (float)total;
+}
+
+void TextureCache::printStats() const
+{
+	printf("Texture cache: %u hits, %u misses, %u evictions, hit rate %.1f%%, %zu/%zu bytes\n",
+		m_Hits, m_Misses, m_Evictions, getHitRate() * 100.0f, m_MemoryUsed, m_MemoryBudget);
+}
+
+void TextureCache::purgeUnused()
+{
+	for (auto it = m_Textures.begin(); it != m_Textures.end();)
+	{
+		auto next = std::next(it);
+		if (it->second.texture.use_count() == 1)
+		{
+			remove(it);
+		}
+		it = next;
+	}
+}
+
+void TextureCache::destroy()
+{
+	//Outstanding handles keep their texture alive, the cache simply forgets about them
+	m_Textures.clear();
+	m_LRU.clear();
+	m_MemoryUsed = 0;
+}
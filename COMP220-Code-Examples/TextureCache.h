@@ -0,0 +1,68 @@
+#pragma once
+
+#include <GL\glew.h>
+#include <SDL_opengl.h>
+
+#include <string>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "Texture.h"
+
+//A single texture owned by the cache, the GL texture is deleted when the last reference goes away
+struct CachedTexture
+{
+	~CachedTexture();
+
+	GLuint textureID = 0;
+	size_t sizeInBytes = 0;
+	std::string key;
+};
+
+//Handles are reference counted, while any handle to a texture is alive the cache will not evict it
+typedef std::shared_ptr<const CachedTexture> TextureHandle;
+
+class TextureCache
+{
+public:
+	TextureCache();
+	~TextureCache();
+
+	//Returns a shared handle to the texture, loading it from disk only if this path and options have not been seen before
+	TextureHandle acquire(const std::string& filename, const TextureOptions& options = TextureOptions());
+
+	void setMemoryBudget(size_t budgetInBytes);
+	size_t getMemoryBudget() const { return m_MemoryBudget; };
+	size_t getMemoryUsed() const { return m_MemoryUsed; };
+
+	unsigned int getHits() const { return m_Hits; };
+	unsigned int getMisses() const { return m_Misses; };
+	unsigned int getEvictions() const { return m_Evictions; };
+	float getHitRate() const;
+	void printStats() const;
+
+	//Drops every texture which has no handles outstanding
+	void purgeUnused();
+	void destroy();
+private:
+	struct Entry
+	{
+		std::shared_ptr<CachedTexture> texture;
+		std::list<std::string>::iterator lruPosition;
+	};
+
+	std::string makeKey(const std::string& filename, const TextureOptions& options) const;
+	void evictToBudget();
+	void remove(std::unordered_map<std::string, Entry>::iterator it);
+
+	std::unordered_map<std::string, Entry> m_Textures;
+	//Most recently used key at the front, least recently used at the back
+	std::list<std::string> m_LRU;
+
+	size_t m_MemoryBudget;
+	size_t m_MemoryUsed;
+	unsigned int m_Hits;
+	unsigned int m_Misses;
+	unsigned int m_Evictions;
+};
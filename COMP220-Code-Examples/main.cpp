@@ -1,16 +1,94 @@
 #include <iostream>
+#include <string>
 #include <SDL.h>
 #include <gl\glew.h>
 #include <SDL_opengl.h>
 
+#include "Benchmarks.h"
+#include "FrameAllocator.h"
+#include "FrameStats.h"
+#include "GeometryArena.h"
+#include "GLStateCache.h"
+#include "HeadlessContext.h"
+#include "JobSystem.h"
+#include "Mesh.h"
+#include "Profiler.h"
+#include "RenderQueue.h"
+#include "RenderTargetPool.h"
+#include "RenderThread.h"
 #include "Shader.h"
+#include "ShaderHotReload.h"
 #include "Vertex.h"
 
 int main(int argc, char ** argsv)
 {
+	//Command line options, --headless renders into a framebuffer object with no window for a fixed number of
+	//frames and then prints frame statistics, so it can run on build machines without a display or GPU
+	bool headless = false;
+	int frameLimit = 0;
+	int width = 1280;
+	int height = 720;
+	std::string benchmarkName;
+	std::string traceFilename;
+	bool useRenderThread = false;
+	int maxFramesAhead = 1;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argsv[i];
+		bool hasValue = i + 1 < argc;
+		if (argument == "--headless")
+		{
+			headless = true;
+		}
+		else if (argument == "--frames" && hasValue)
+		{
+			frameLimit = atoi(argsv[++i]);
+		}
+		else if (argument == "--width" && hasValue)
+		{
+			width = atoi(argsv[++i]);
+		}
+		else if (argument == "--height" && hasValue)
+		{
+			height = atoi(argsv[++i]);
+		}
+		else if (argument == "--bench" && hasValue)
+		{
+			benchmarkName = argsv[++i];
+		}
+		else if (argument == "--trace" && hasValue)
+		{
+			traceFilename = argsv[++i];
+		}
+		else if (argument == "--render-thread")
+		{
+			useRenderThread = true;
+		}
+		else if (argument == "--max-frames-ahead" && hasValue)
+		{
+			maxFramesAhead = atoi(argsv[++i]);
+		}
+		else
+		{
+			printf("Usage: %s [--headless] [--frames N] [--width W] [--height H] [--bench NAME] [--trace FILE] [--render-thread] [--max-frames-ahead N]\n", argsv[0]);
+			listBenchmarks();
+			return 1;
+		}
+	}
+	if (headless && frameLimit == 0)
+	{
+		frameLimit = 1000;
+	}
+	if (maxFramesAhead < 1)
+	{
+		printf("--max-frames-ahead must be at least 1\n");
+		return 1;
+	}
+
 	//Initialises the SDL Library, passing in SDL_INIT_VIDEO to only initialise the video subsystems
+	//Headless runs only need the timer, there may be no video device at all
 	//https://wiki.libsdl.org/SDL_Init
-	if (SDL_Init(SDL_INIT_VIDEO) < 0)
+	if (SDL_Init(headless ? SDL_INIT_TIMER : SDL_INIT_VIDEO) < 0)
 	{
 		//Display an error message box
 		//https://wiki.libsdl.org/SDL_ShowSimpleMessageBox
@@ -18,47 +96,196 @@ int main(int argc, char ** argsv)
 		return 1;
 	}
 
-	//Create a window, note we have to free the pointer returned using the DestroyWindow Function
-	//https://wiki.libsdl.org/SDL_CreateWindow
-	SDL_Window* window = SDL_CreateWindow("SDL2 Window", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 1280, 720, SDL_WINDOW_OPENGL);
-	//Checks to see if the window has been created, the pointer will have a value of some kind
-	if (window == nullptr)
+	SDL_Window* window = nullptr;
+	SDL_GLContext glContext = nullptr;
+	HeadlessContext headlessContext;
+	if (headless)
 	{
-		//Show error
-		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "SDL_CreateWindow failed", SDL_GetError(), NULL);
-		//Close the SDL Library
-		//https://wiki.libsdl.org/SDL_Quit
-		SDL_Quit();
-		return 1;
+		if (!headlessContext.init(3, 3) || !headlessContext.initGLEW())
+		{
+			headlessContext.destroy();
+			SDL_Quit();
+			return 1;
+		}
+	}
+	else
+	{
+		//Create a window, note we have to free the pointer returned using the DestroyWindow Function
+		//https://wiki.libsdl.org/SDL_CreateWindow
+		window = SDL_CreateWindow("SDL2 Window", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_OPENGL);
+		//Checks to see if the window has been created, the pointer will have a value of some kind
+		if (window == nullptr)
+		{
+			//Show error
+			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "SDL_CreateWindow failed", SDL_GetError(), NULL);
+			//Close the SDL Library
+			//https://wiki.libsdl.org/SDL_Quit
+			SDL_Quit();
+			return 1;
+		}
+
+		glContext = SDL_GL_CreateContext(window);
+
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+
+		//Initialize GLEW
+		glewExperimental = GL_TRUE;
+		GLenum glewError = glewInit();
+		if (glewError != GLEW_OK)
+		{
+			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Unable to initialise GLEW", (char*)glewGetErrorString(glewError), NULL);
+		}
 	}
 
-	SDL_GLContext glContext = SDL_GL_CreateContext(window);
+	getProfiler().init();
+	//Worker threads for culling, loading and anything else that splits into jobs, this thread owns GL
+	getJobSystem().init();
+	//Transient per-frame memory, one arena for the frame being recorded and one for each the render thread may have
+	//queued, so nothing is reset while it is still to be drawn
+	getFrameAllocator().init(maxFramesAhead + 1);
 
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
-	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+	//Benchmarks replace the normal frame loop
+	if (!benchmarkName.empty())
+	{
+		bool found = runBenchmark(benchmarkName);
+		getJobSystem().destroy();
+		getFrameAllocator().destroy();
+		headlessContext.destroy();
+		if (window != nullptr)
+		{
+			SDL_GL_DeleteContext(glContext);
+			SDL_DestroyWindow(window);
+		}
+		SDL_Quit();
+		return found ? 0 : 1;
+	}
 
-	//Initialize GLEW
-	glewExperimental = GL_TRUE;
-	GLenum glewError = glewInit();
-	if (glewError != GLEW_OK)
+	//With no window there is no default framebuffer, so headless frames are drawn into one from the pool
+	RenderTargetPool renderTargetPool;
+	RenderTarget* pOffscreenTarget = nullptr;
+	if (headless)
 	{
-		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Unable to initialise GLEW", (char*)glewGetErrorString(glewError), NULL);
+		RenderTargetDesc offscreenDesc;
+		offscreenDesc.width = width;
+		offscreenDesc.height = height;
+		offscreenDesc.depthFormat = GL_DEPTH_COMPONENT24;
+		pOffscreenTarget = renderTargetPool.acquire(offscreenDesc);
+		if (pOffscreenTarget == nullptr)
+		{
+			headlessContext.destroy();
+			SDL_Quit();
+			return 1;
+		}
 	}
 
 	// Create and compile our GLSL program from the shaders
 	GLuint programID = LoadShaders("BasicVert.glsl", 
 		"BasicFrag.glsl");
 
+	//Recompile the shaders whenever they are saved, without restarting
+	ShaderHotReload shaderHotReload;
+	shaderHotReload.watch(&programID, "BasicVert.glsl", "BasicFrag.glsl");
+	shaderHotReload.start();
+
+	//Recorded into every frame's queue, by the main thread whether or not a render thread then draws it. Published
+	//straight away so the first frame recorded can see its range
+	Vertex triangleVertices[3] =
+	{
+		{ -0.5f, -0.5f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f },
+		{ 0.5f, -0.5f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f },
+		{ 0.0f, 0.5f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.5f, 1.0f }
+	};
+	unsigned int triangleIndices[3] = { 0, 1, 2 };
+	Mesh triangle;
+	triangle.init();
+	triangle.copyBufferData(triangleVertices, 3, triangleIndices, 3);
+	getGeometryArena().publishRanges();
+
+	//Everything which touches GL for one frame, on the render thread when --render-thread is used
+	RenderQueue singleThreadQueue;
+	auto renderFrame = [&](RenderQueue& queue)
+	{
+		getProfiler().beginFrame();
+
+		//Reset the per frame state change counters
+		getGLState().beginFrame();
+
+		//Swap in any shaders which have finished recompiling, before anything is drawn
+		shaderHotReload.update();
+
+		//Uploads and other GL work queued by jobs, such as models and textures which finished loading
+		getJobSystem().runMainThreadJobs();
+
+		//Move a few MB of fragmented geometry, at the frame boundary so the whole frame sees one layout
+		getGeometryArena().compact();
+
+		if (pOffscreenTarget != nullptr)
+		{
+			getGLState().bindFramebuffer(GL_FRAMEBUFFER, pOffscreenTarget->framebufferID);
+			glViewport(0, 0, width, height);
+		}
+
+		{
+			PROFILE_GPU_SCOPE("Draw");
+			glClearColor(1.0f, 0.0f, 0.0f, 1.0f); 
+			glClear(GL_COLOR_BUFFER_BIT);
+
+			getGLState().useProgram(programID);
+			queue.execute();
+		}
+
+		if (headless)
+		{
+			//Nothing presents the frame, so wait for the GPU to make the frame time meaningful
+			glFinish();
+		}
+		else
+		{
+			SDL_GL_SwapWindow(window);
+		}
+
+		getProfiler().endFrame();
+	};
+
+	//Hand the context to a render thread, the main thread then only polls events and records frames
+	RenderThread renderThread;
+	if (useRenderThread)
+	{
+		auto acquireContext = [&]()
+		{
+			headless ? (void)headlessContext.makeCurrent() : (void)SDL_GL_MakeCurrent(window, glContext);
+			//GL only jobs follow the context
+			getJobSystem().setMainThread();
+		};
+		auto releaseContext = [&]()
+		{
+			headless ? headlessContext.releaseCurrent() : (void)SDL_GL_MakeCurrent(window, nullptr);
+		};
+		releaseContext();
+		//Frames recorded before compaction's moves reach this thread still draw from the old ranges
+		if ((unsigned int)maxFramesAhead + 2 > getGeometryArena().getRetireFrames())
+		{
+			getGeometryArena().setRetireFrames(maxFramesAhead + 2);
+		}
+		renderThread.start(maxFramesAhead, acquireContext, renderFrame, releaseContext);
+	}
+
+	FrameStats frameStats;
+	int frameCount = 0;
+
 	//Event loop, we will loop until running is set to false, usually if escape has been pressed or window is closed
 	bool running = true;
 	//SDL Event structure, this will be checked in the while loop
 	SDL_Event ev;
 	while (running)
 	{
+		frameStats.beginFrame();
+
 		//Poll for the events which have happened in this frame
 		//https://wiki.libsdl.org/SDL_PollEvent
-		while (SDL_PollEvent(&ev))
+		while (!headless && SDL_PollEvent(&ev))
 		{
 			//Switch case for every message we are intereted in
 			switch (ev.type)
@@ -80,19 +307,77 @@ int main(int argc, char ** argsv)
 			}
 		}
 
-		glClearColor(1.0f, 0.0f, 0.0f, 1.0f); 
-		glClear(GL_COLOR_BUFFER_BIT);
+		//The render thread's beginFrame blocks until the frame whose allocator arena is about to be reused has
+		//been drawn, so the allocator moves on only after it
+		RenderQueue& queue = useRenderThread ? renderThread.beginFrame() : singleThreadQueue;
+		getFrameAllocator().beginFrame();
 
-		glUseProgram(programID);
+		//Simulation and draw recording go here, with a render thread they overlap drawing of the previous frame.
+		//Recording uses the arena ranges published by the last compaction, never the ones it is changing
+		getGeometryArena().beginRecording();
+		//Program 0 draws with the one renderFrame binds, which hot reload may swap on the render thread
+		queue.submit(makeSortKey(0, 0, 0, triangle.getGeometry(), 0.0f), 0, 0, triangle, -1, glm::mat4(1.0f));
+		if (useRenderThread)
+		{
+			renderThread.endFrame();
+		}
+		else
+		{
+			renderFrame(queue);
+		}
 
-		SDL_GL_SwapWindow(window);
+		frameStats.endFrame();
+		frameCount++;
+		if (frameLimit > 0 && frameCount >= frameLimit)
+		{
+			running = false;
+		}
 	}
 
-	glDeleteProgram(programID);
-	SDL_GL_DeleteContext(glContext);
-	//Destroy the window and quit SDL2, NB we should do this after all cleanup in this order!!!
-	//https://wiki.libsdl.org/SDL_DestroyWindow
-	SDL_DestroyWindow(window);
+	//Take the context back for shutdown
+	if (useRenderThread)
+	{
+		renderThread.stop();
+		headless ? (void)headlessContext.makeCurrent() : (void)SDL_GL_MakeCurrent(window, glContext);
+		getJobSystem().setMainThread();
+		printf("Main thread waited %.2fms on the render thread\n", renderThread.getWaitTime());
+	}
+
+	if (frameLimit > 0)
+	{
+		frameStats.print("frames");
+		getGLState().printFrameStats();
+		getGeometryArena().printStats();
+		getJobSystem().printStats();
+		getFrameAllocator().printStats();
+		getProfiler().printSummary();
+	}
+	if (!traceFilename.empty())
+	{
+		getProfiler().writeChromeTrace(traceFilename);
+	}
+	getProfiler().destroy();
+
+	//Before GL goes away, as destroy runs any main thread jobs still queued
+	getJobSystem().destroy();
+	//After the workers have stopped, they hold arenas of their own
+	getFrameAllocator().destroy();
+	shaderHotReload.stop();
+	getGLState().deleteProgram(programID);
+	renderTargetPool.destroy();
+	triangle.destroy();
+	getGeometryArena().destroy();
+	if (headless)
+	{
+		headlessContext.destroy();
+	}
+	else
+	{
+		SDL_GL_DeleteContext(glContext);
+		//Destroy the window and quit SDL2, NB we should do this after all cleanup in this order!!!
+		//https://wiki.libsdl.org/SDL_DestroyWindow
+		SDL_DestroyWindow(window);
+	}
 	//https://wiki.libsdl.org/SDL_Quit
 	SDL_Quit();
 